@@ -0,0 +1,211 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+// Adapted from the VirtualHeightfieldMesh plugin
+
+#include "GrassInstancingRenderer.h"
+
+static FAutoConsoleCommand CmdGrassBenchmarkThreadGroupSizes(
+	TEXT("r.Grass.BenchmarkThreadGroupSizes"),
+	TEXT("Cull a reference field with every thread group size of the culling passes and log the GPU time of each pass.\n")
+	TEXT("Arguments: [NumBlades=1048576] [Iterations=8]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const uint32 NumBlades = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 1 << 20;
+		const uint32 Iterations = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 8;
+
+		// The benchmark runs at the start of the next frames, even without any grass in the scene
+		GrassRendererExtension.RegisterExtension();
+		ENQUEUE_RENDER_COMMAND(GrassBenchmarkThreadGroupSizes)([NumBlades, Iterations](FRHICommandListImmediate&)
+		{
+			GrassRendererExtension.RequestThreadGroupBenchmark(NumBlades, Iterations);
+		});
+	}));
+
+void FGrassInstancingRendererExtension::RequestThreadGroupBenchmark(const uint32 InNumBlades, const uint32 InIterations)
+{
+	check(IsInRenderingThread());
+
+	if (Benchmark.IsValid())
+	{
+		UE_LOG(LogGrass, Warning, TEXT("A grass thread group benchmark is already running."));
+		return;
+	}
+
+	Benchmark = MakeUnique<FThreadGroupBenchmark>();
+	Benchmark->NumBlades = InNumBlades;
+	Benchmark->Iterations = InIterations;
+}
+
+void FGrassInstancingRendererExtension::AddThreadGroupBenchmarkPasses(FRDGBuilder& GraphBuilder)
+{
+	FThreadGroupBenchmark& Bench = *Benchmark;
+
+	// Reference field: a square of blades with random heights and facings, seen from its edge
+	constexpr float FieldSize = 4000.0f;
+	const int32 Side = FMath::CeilToInt(FMath::Sqrt(static_cast<float>(Bench.NumBlades)));
+	const float Spacing = FieldSize / Side;
+	FRandomStream RandomStream(0x67726173);
+
+	GrassUtils::FGrassLodPolicy::FSettings LodSettings;
+	LodSettings.MinMaxLod = FUintVector2(1, MAX_LOD_BUCKETS);
+	LodSettings.BladeHeightRange = FVector2f(20.0f, 60.0f);
+	LodSettings.CutoffDistance = FieldSize;
+	Bench.LodPolicy = GrassUtils::FGrassLodPolicy(LodSettings);
+
+	FGrassInstancingSectionProxy& Section = Bench.Section;
+	Section.GrassData.Reserve(Bench.NumBlades);
+	for (uint32 Index = 0; Index < Bench.NumBlades; Index++)
+	{
+		const FVector3f Position(
+			(Index % Side + RandomStream.FRand()) * Spacing,
+			(Index / Side + RandomStream.FRand()) * Spacing - FieldSize / 2,
+			0.0f);
+		const float Angle = RandomStream.FRand() * UE_TWO_PI;
+		Section.GrassData.Emplace(
+			Index, Position,
+			FVector3f::UpVector, FVector3f(FMath::Cos(Angle), FMath::Sin(Angle), 0.0f),
+			RandomStream.FRandRange(LodSettings.BladeHeightRange.X, LodSettings.BladeHeightRange.Y), 2.0f, 0.5f);
+	}
+	Section.GrassDataNum = Bench.NumBlades;
+	Section.Bounds = FBox(FVector(0.0f, -FieldSize / 2, 0.0f), FVector(FieldSize, FieldSize / 2, LodSettings.BladeHeightRange.Y));
+	Section.InstanceBounds = FBox3f(Section.Bounds);
+	Section.CutoffDistance = LodSettings.CutoffDistance;
+	Section.MinMaxLodSteps = LodSettings.MinMaxLod;
+	Section.LodPolicy = &Bench.LodPolicy;
+	for (uint32 Bucket = 0; Bucket < MAX_LOD_BUCKETS; Bucket++)
+	{
+		Section.LodNumIndices[Bucket] = 6 * (LodSettings.MinMaxLod.X + Bucket) + 3;
+	}
+	GrassUtils::InitializeGrassDataBuffer(&Section);
+	GrassUtils::InitializeInstanceBuffers(&Bench, Bench.NumBlades, Bench.Buffers);
+
+	// 1080p camera standing at the edge of the field, about half of the blades are in its frustum
+	const FVector ViewOrigin(-100.0, 0.0, 170.0);
+	const FMatrix ViewMatrix = FLookAtMatrix(ViewOrigin, FVector(FieldSize / 2, 0.0, 0.0), FVector::UpVector);
+	const FMatrix ProjectionMatrix = FReversedZPerspectiveMatrix(UE_HALF_PI / 2.0f, 1920.0f, 1080.0f, 10.0f);
+	FConvexVolume ViewFrustum;
+	GetViewFrustumBounds(ViewFrustum, ViewMatrix * ProjectionMatrix, true);
+
+	GrassUtils::FMainViewDesc MainViewDesc;
+	MainViewDesc.IsValid = true;
+	MainViewDesc.ViewDebug = nullptr;
+	MainViewDesc.ViewOrigin = FVector3f(ViewOrigin);
+	MainViewDesc.ViewMatrix = FMatrix44f(ViewMatrix);
+	MainViewDesc.ViewProjectionMatrix = FMatrix44f(ViewMatrix * ProjectionMatrix);
+	MainViewDesc.LodView.Origin = ViewOrigin;
+	MainViewDesc.LodView.ScreenScale = 0.5f * 1080.0f * ProjectionMatrix.M[1][1];
+
+	GrassUtils::FChildViewDesc CullViewDesc;
+	CullViewDesc.IsValid = true;
+	CullViewDesc.ViewDebug = nullptr;
+	CullViewDesc.bIsMainView = true;
+	GrassUtils::GetCullPlanes(ViewFrustum, FVector::ZeroVector, CullViewDesc);
+
+	GrassUtils::FProxyDesc ProxyDesc;
+	ProxyDesc.IsValid = true;
+	ProxyDesc.bIsCullingEnabled = true;
+	ProxyDesc.GrassDataBufferSRV = Section.GrassDataBufferSRV;
+	ProxyDesc.GrassDataNum = Section.GrassDataNum;
+	ProxyDesc.CutoffDistance = Section.CutoffDistance;
+	ProxyDesc.MinMaxLod = Section.MinMaxLodSteps;
+	ProxyDesc.LodPolicy = Section.LodPolicy;
+	ProxyDesc.InstanceBounds = Section.InstanceBounds;
+
+	RDG_EVENT_SCOPE(GraphBuilder, "GrassThreadGroupBenchmark");
+	TGuardValue<bool> GraphicsPipeGuard(GrassUtils::bCullingOnGraphicsPipe, true);
+	const FGlobalShaderMap* GlobalShaderMap = GetGlobalShaderMap(GMaxRHIFeatureLevel);
+	const TRDGUniformBufferRef<GrassUtils::FGrassViewParameters> ViewUniformBuffer =
+		GrassUtils::CreateViewUniformBuffer(GraphBuilder, MainViewDesc, CullViewDesc);
+
+	// The wind, the interactors and the bend states are left out, they would only add the same lookups to every size
+	GrassUtils::FGrassWindParameters BenchWindParameters = WindParameters;
+	BenchWindParameters.WindDirectionStrength = FVector4f::Zero();
+	const GrassUtils::FGrassForceMapParameters* BenchForceMapParameters = NoForceMapParameters;
+
+	for (const uint32 ThreadGroupSize : GrassUtils::GrassThreadGroupSizes)
+	{
+		for (uint32 Iteration = 0; Iteration < Bench.Iterations; Iteration++)
+		{
+			FRenderQueryRHIRef Timestamps[3];
+			for (FRenderQueryRHIRef& Timestamp : Timestamps)
+			{
+				Timestamp = RHICreateRenderQuery(RQT_AbsoluteTime);
+				Bench.Timestamps.Add(Timestamp);
+			}
+
+			GrassUtils::FVolatileResources VolatileResources;
+			GrassUtils::InitializeResources(GraphBuilder, Bench.Buffers, false, VolatileResources);
+			GrassUtils::AddPass_InitIndirectArgs(GraphBuilder, GlobalShaderMap, VolatileResources, Section.LodNumIndices);
+
+			GrassUtils::AddPass_Timestamp(GraphBuilder, Timestamps[0]);
+			GrassUtils::AddPass_CullInstances(
+				GraphBuilder, GlobalShaderMap,
+				VolatileResources,
+				ProxyDesc, ViewUniformBuffer, nullptr, BenchWindParameters, *BenchForceMapParameters, BendStatesSRV,
+				FUintVector2(0, MAX_LOD_BUCKETS - 1), false, false, ThreadGroupSize);
+			GrassUtils::AddPass_Timestamp(GraphBuilder, Timestamps[1]);
+			GrassUtils::AddPass_ComputeSlotOffsets(GraphBuilder, GlobalShaderMap, VolatileResources, false);
+			GrassUtils::AddPass_ComputeInstanceData(
+				GraphBuilder, GlobalShaderMap, VolatileResources, Section.InstanceBounds, BenchWindParameters, *BenchForceMapParameters,
+				false, ThreadGroupSize);
+			GrassUtils::AddPass_Timestamp(GraphBuilder, Timestamps[2]);
+		}
+	}
+}
+
+void FGrassInstancingRendererExtension::UpdateThreadGroupBenchmark(FRDGBuilder& GraphBuilder)
+{
+	FThreadGroupBenchmark& Bench = *Benchmark;
+	if (Bench.Timestamps.Num() == 0)
+	{
+		AddThreadGroupBenchmarkPasses(GraphBuilder);
+		return;
+	}
+
+	// Poll the timestamps once per frame rather than stalling on them
+	TArray<uint64> Times;
+	Times.SetNumUninitialized(Bench.Timestamps.Num());
+	for (int32 Index = 0; Index < Bench.Timestamps.Num(); Index++)
+	{
+		if (!RHIGetRenderQueryResult(Bench.Timestamps[Index], Times[Index], false))
+		{
+			if (++Bench.FramesWaited > 60u)
+			{
+				UE_LOG(LogGrass, Warning, TEXT("The grass thread group benchmark timed out, timestamps may be unsupported."));
+				Benchmark.Reset();
+			}
+			return;
+		}
+	}
+
+	UE_LOG(LogGrass, Log, TEXT("Grass thread group benchmark, %u blades, average of %u iterations:"), Bench.NumBlades, Bench.Iterations);
+
+	uint32 BestThreadGroupSize = 0;
+	double BestTime = TNumericLimits<double>::Max();
+	for (int32 SizeIndex = 0; SizeIndex < static_cast<int32>(UE_ARRAY_COUNT(GrassUtils::GrassThreadGroupSizes)); SizeIndex++)
+	{
+		// Timestamps are in microseconds
+		double CullTime = 0.0;
+		double InstanceTime = 0.0;
+		for (uint32 Iteration = 0; Iteration < Bench.Iterations; Iteration++)
+		{
+			const int32 First = (SizeIndex * Bench.Iterations + Iteration) * 3;
+			CullTime += Times[First + 1] - Times[First];
+			InstanceTime += Times[First + 2] - Times[First + 1];
+		}
+		CullTime /= Bench.Iterations * 1000.0;
+		InstanceTime /= Bench.Iterations * 1000.0;
+
+		const uint32 ThreadGroupSize = GrassUtils::GrassThreadGroupSizes[SizeIndex];
+		UE_LOG(LogGrass, Log, TEXT("  %4u threads: cull %.3f ms, instance %.3f ms, total %.3f ms"),
+			ThreadGroupSize, CullTime, InstanceTime, CullTime + InstanceTime);
+
+		if (CullTime + InstanceTime < BestTime)
+		{
+			BestTime = CullTime + InstanceTime;
+			BestThreadGroupSize = ThreadGroupSize;
+		}
+	}
+	UE_LOG(LogGrass, Log, TEXT("Fastest: r.Grass.ThreadGroupSize %u"), BestThreadGroupSize);
+
+	Benchmark.Reset();
+}
@@ -0,0 +1,175 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+// Adapted from the VirtualHeightfieldMesh plugin
+
+#include "GrassBendState.h"
+
+#include "GrassInstancingRenderer.h"
+
+static TAutoConsoleVariable<int32> CVarGrassBendState(
+	TEXT("r.Grass.BendState"),
+	0,
+	TEXT("Give the blades near the view a persistent bend, integrated every frame as a spring under the wind and the interactors,\n")
+	TEXT("so that they sway and spring back instead of following the forces instantly. The other blades are bent without a state."),
+	ECVF_RenderThreadSafe | ECVF_Scalability);
+
+static TAutoConsoleVariable<int32> CVarGrassBendStatePoolSize(
+	TEXT("r.Grass.BendStatePoolSize"),
+	262144,
+	TEXT("Blades the bend states are allocated for, 16 bytes each. The sections nearest to the view that don't fit go without a state."),
+	ECVF_RenderThreadSafe | ECVF_Scalability);
+
+static TAutoConsoleVariable<float> CVarGrassBendStateRadius(
+	TEXT("r.Grass.BendStateRadius"),
+	1500.0f,
+	TEXT("Distance from the view within which the sections are given a bend state."),
+	ECVF_RenderThreadSafe | ECVF_Scalability);
+
+void FGrassInstancingRendererExtension::UpdateBendStates(FRDGBuilder& GraphBuilder)
+{
+	const uint32 Capacity = CVarGrassBendState.GetValueOnRenderThread() != 0 ?
+		static_cast<uint32>(FMath::Clamp(CVarGrassBendStatePoolSize.GetValueOnRenderThread(), 0, 1 << 24)) : 0;
+	if (Capacity != BendStatePool.GetCapacity())
+	{
+		BendStatePool.Reset(Capacity);
+		BendStateBuffer.SafeRelease();
+		BendStateSeenIds.Reset();
+	}
+
+	// The cull passes read the states whether the sections have one or not, an empty buffer can't be created
+	if (!NoBendStateBuffer.IsValid())
+	{
+		const GrassUtils::FGrassBendState NoBendState;
+		NoBendStateBuffer = GraphBuilder.ConvertToExternalBuffer(CreateStructuredBuffer(
+			GraphBuilder, TEXT("FGrass.NoBendStates"), sizeof(GrassUtils::FGrassBendState), 1, &NoBendState, sizeof(GrassUtils::FGrassBendState)));
+	}
+	BendStatesSRV = GraphBuilder.CreateSRV(GraphBuilder.RegisterExternalBuffer(NoBendStateBuffer));
+	if (Capacity == 0)
+		return;
+
+	// Blade sections culled this frame, the cards of the far field never bend
+	TMap<uint32, const FGrassInstancingSectionProxy*> FrameSections;
+	const auto GatherSections = [&FrameSections](const TConstArrayView<GrassUtils::FSectionWork> Works)
+	{
+		for (const GrassUtils::FSectionWork& Work : Works)
+		{
+			if (!Work.Section->bIsFarField && Work.Section->GrassDataNum > 0)
+			{
+				FrameSections.Add(Work.Section->Revision, Work.Section);
+			}
+		}
+	};
+	GatherSections(SectionWorks);
+	for (const FShadowWorkDesc& ShadowWork : PendingShadowWorks)
+	{
+		GatherSections(ShadowWork.Sections);
+	}
+
+	// Without a main view the states are kept as they are, there is no view to measure the distances from
+	const bool bHasOrigin = MainViews.Num() > 0;
+	const FVector ViewOrigin = bHasOrigin ? GrassUtils::GetLodView(MainViews[0]).Origin : FVector::ZeroVector;
+	const double Radius = FMath::Max(CVarGrassBendStateRadius.GetValueOnRenderThread(), 0.0f);
+
+	// The sections leaving the radius keep their state a little further, so that they don't flicker on its edge
+	for (auto It = BendStateSeenIds.CreateIterator(); It; ++It)
+	{
+		const FGrassInstancingSectionProxy* const* Section = FrameSections.Find(It.Key());
+		const bool bInRange = Section == nullptr || !bHasOrigin
+			|| (*Section)->Bounds.ComputeSquaredDistanceToPoint(ViewOrigin) <= FMath::Square(Radius * 1.25);
+		if (Section != nullptr)
+		{
+			It.Value() = DiscardId;
+		}
+
+		if (!bInRange || DiscardId - It.Value() > 4u)
+		{
+			BendStatePool.Free(It.Key());
+			It.RemoveCurrent();
+		}
+	}
+
+	// The nearest sections are given a state first, the ones that don't fit are bent without one
+	TSet<uint32> NewRevisions;
+	if (bHasOrigin)
+	{
+		TArray<TPair<double, const FGrassInstancingSectionProxy*>> Candidates;
+		for (const TPair<uint32, const FGrassInstancingSectionProxy*>& Pair : FrameSections)
+		{
+			const double DistanceSquared = Pair.Value->Bounds.ComputeSquaredDistanceToPoint(ViewOrigin);
+			if (!BendStateSeenIds.Contains(Pair.Key) && DistanceSquared <= FMath::Square(Radius))
+			{
+				Candidates.Emplace(DistanceSquared, Pair.Value);
+			}
+		}
+		Candidates.Sort([](const TPair<double, const FGrassInstancingSectionProxy*>& A, const TPair<double, const FGrassInstancingSectionProxy*>& B)
+		{
+			return A.Key < B.Key;
+		});
+
+		for (const TPair<double, const FGrassInstancingSectionProxy*>& Candidate : Candidates)
+		{
+			if (BendStatePool.Allocate(Candidate.Value->Revision, Candidate.Value->GrassDataNum) != NO_BEND_STATE)
+			{
+				BendStateSeenIds.Add(Candidate.Value->Revision, DiscardId);
+				NewRevisions.Add(Candidate.Value->Revision);
+			}
+		}
+	}
+
+	if (BendStatePool.GetNumAllocated() == 0)
+		return;
+
+	RDG_EVENT_SCOPE(GraphBuilder, "GrassBendStates");
+
+	if (!BendStateBuffer.IsValid())
+	{
+		BendStateBuffer = AllocatePooledBuffer(
+			FRDGBufferDesc::CreateStructuredDesc(sizeof(GrassUtils::FGrassBendState), Capacity), TEXT("FGrass.BendStates"));
+	}
+	FRDGBufferRef Buffer = GraphBuilder.RegisterExternalBuffer(BendStateBuffer);
+
+	// Every section steps its own range of the states, the passes don't wait on each other
+	FRDGBufferUAVRef BufferUAV = GraphBuilder.CreateUAV(FRDGBufferUAVDesc(Buffer), ERDGUnorderedAccessViewFlags::SkipBarrier);
+	const TShaderMapRef<GrassUtils::FIntegrateBendState_CS> ComputeShader(GetGlobalShaderMap(GMaxRHIFeatureLevel));
+	const float DeltaTime = FrameTime.GetDeltaWorldTimeSeconds();
+
+	for (const TPair<uint32, const FGrassInstancingSectionProxy*>& Pair : FrameSections)
+	{
+		const uint32 Offset = BendStatePool.Find(Pair.Key);
+		if (Offset == NO_BEND_STATE)
+			continue;
+
+		// The bend settles under both forces, whichever of them is enabled, a disabled one bends by nothing
+		const GrassUtils::FGrassForceMapParameters& ForceMapParameters = GetForceMapParameters(Pair.Value->Scene);
+		const float MaxAngle = FMath::Max(WindParameters.WindDirectionStrength.W, ForceMapParameters.ForceMapMaxBend);
+
+		GrassUtils::FIntegrateBendState_CS::FParameters* PassParameters = GraphBuilder.AllocParameters<GrassUtils::FIntegrateBendState_CS::FParameters>();
+		PassParameters->Wind = WindParameters;
+		PassParameters->ForceMap = ForceMapParameters;
+		PassParameters->GrassDataSize = Pair.Value->GrassDataNum;
+		PassParameters->GrassDataBuffer = Pair.Value->GrassDataBufferSRV;
+		PassParameters->BendStateOffset = Offset;
+		PassParameters->BendStateDeltaTime = DeltaTime;
+		PassParameters->BendStateMaxAngle = MaxAngle;
+		PassParameters->bResetBendState = NewRevisions.Contains(Pair.Key);
+		PassParameters->RWBendStates = BufferUAV;
+
+		FComputeShaderUtils::AddPass(
+			GraphBuilder,
+			RDG_EVENT_NAME("IntegrateGrassBendState(Blades=%u)", Pair.Value->GrassDataNum),
+			ComputeShader, PassParameters,
+			FComputeShaderUtils::GetGroupCount(static_cast<int32>(Pair.Value->GrassDataNum), BEND_STATE_GROUP_SIZE));
+	}
+
+	BendStatesSRV = GraphBuilder.CreateSRV(Buffer);
+	for (GrassUtils::FSectionWork& SectionWork : SectionWorks)
+	{
+		SectionWork.BendStateOffset = BendStatePool.Find(SectionWork.Section->Revision);
+	}
+	for (FShadowWorkDesc& ShadowWork : PendingShadowWorks)
+	{
+		for (GrassUtils::FSectionWork& SectionWork : ShadowWork.Sections)
+		{
+			SectionWork.BendStateOffset = BendStatePool.Find(SectionWork.Section->Revision);
+		}
+	}
+}
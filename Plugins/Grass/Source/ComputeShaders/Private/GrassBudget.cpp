@@ -0,0 +1,74 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+// Adapted from the VirtualHeightfieldMesh plugin
+
+#include "GrassBudget.h"
+
+#include "GrassInstancingRenderer.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Requested Instances"), STAT_GrassRequestedInstances, STATGROUP_Grass);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Granted Instances"), STAT_GrassGrantedInstances, STATGROUP_Grass);
+
+static TAutoConsoleVariable<int32> CVarGrassInstanceBudget(
+	TEXT("r.Grass.InstanceBudget"),
+	0,
+	TEXT("Maximum number of blades all the grass fields together can draw in a view, 0 for no limit.\n")
+	TEXT("Past it the sections are thinned out by priority, the closest and largest on screen keeping their blades the longest,\n")
+	TEXT("the ones granted less than 1/64 of their blades aren't drawn. The thinned out blades aren't widened, unlike the density falloff.\n")
+	TEXT("The budget is solved from the requests of the last frame and bounds the blades the sections can draw, not the visible ones."),
+	ECVF_RenderThreadSafe | ECVF_Scalability);
+
+void FGrassInstancingRendererExtension::ApplyInstanceBudget(const FSceneView* InMainView, TArrayView<GrassUtils::FSectionWork> InOutSections)
+{
+	const int32 Budget = CVarGrassInstanceBudget.GetValueOnRenderThread();
+	if (Budget <= 0)
+		return;
+
+	const GrassUtils::FGrassLodView LodView = GrassUtils::GetLodView(InMainView);
+	FInstanceBudget& ViewBudget = InstanceBudgets.FindOrAdd(LodView.ViewKey);
+	ViewBudget.RequestedId = DiscardId;
+
+	for (GrassUtils::FSectionWork& SectionWork : InOutSections)
+	{
+		const FGrassInstancingSectionProxy* Section = SectionWork.Section;
+
+		// The cards of the far field are a small fixed cost, thinning them would only open holes
+		if (Section->bIsFarField)
+			continue;
+
+		// Upper bound of the blades the section can draw: all of them, thinned by the falloff at its closest point
+		const float MinDistance = FMath::Sqrt(Section->Bounds.ComputeSquaredDistanceToPoint(LodView.Origin));
+		const float FalloffKeepFraction = GrassUtils::ComputeDensityKeepFraction(
+			MinDistance, Section->LodPolicy->GetSettings().DensityFalloff.GetShaderParameter());
+
+		GrassUtils::FGrassBudgetRequest Request;
+		Request.Instances = FMath::CeilToInt(Section->GrassDataNum * FalloffKeepFraction);
+		Request.Priority = GrassUtils::ComputeBudgetPriority(Section->Bounds, LodView.Origin);
+		ViewBudget.Requests.Add(Request);
+
+		SectionWork.DensityScale = GrassUtils::GetBudgetKeepFraction(Request.Priority, ViewBudget.Scale);
+
+		INC_DWORD_STAT_BY(STAT_GrassRequestedInstances, Request.Instances);
+		INC_DWORD_STAT_BY(STAT_GrassGrantedInstances, static_cast<uint32>(Request.Instances * SectionWork.DensityScale));
+	}
+}
+
+void FGrassInstancingRendererExtension::UpdateInstanceBudgets()
+{
+	const int32 Budget = CVarGrassInstanceBudget.GetValueOnRenderThread();
+	for (auto It = InstanceBudgets.CreateIterator(); It; ++It)
+	{
+		FInstanceBudget& ViewBudget = It.Value();
+		if (Budget <= 0 || DiscardId - ViewBudget.RequestedId > 4u)
+		{
+			It.RemoveCurrent();
+			continue;
+		}
+
+		// The views of the frame have all been gathered, the next frame is granted what fits in the budget
+		if (ViewBudget.RequestedId == DiscardId)
+		{
+			ViewBudget.Scale = GrassUtils::SolveBudgetScale(ViewBudget.Requests, static_cast<uint32>(Budget));
+		}
+		ViewBudget.Requests.Reset();
+	}
+}
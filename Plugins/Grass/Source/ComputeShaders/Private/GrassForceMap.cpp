@@ -0,0 +1,215 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+// Adapted from the VirtualHeightfieldMesh plugin
+
+#include "GrassForceMap.h"
+
+#include "GrassInstancingRenderer.h"
+#include "SystemTextures.h"
+
+static TAutoConsoleVariable<int32> CVarGrassForceMap(
+	TEXT("r.Grass.ForceMap"),
+	1,
+	TEXT("Bend and flatten the blades around the grass interactors through a force map per scene, centered on its view.\n")
+	TEXT("The interactors of a world are splatted into its map in a single pass per frame and their forces decay over time."),
+	ECVF_RenderThreadSafe | ECVF_Scalability);
+
+static TAutoConsoleVariable<int32> CVarGrassForceMapResolution(
+	TEXT("r.Grass.ForceMapResolution"),
+	256,
+	TEXT("Side of the force map in texels."),
+	ECVF_RenderThreadSafe | ECVF_Scalability);
+
+static TAutoConsoleVariable<float> CVarGrassForceMapSize(
+	TEXT("r.Grass.ForceMapSize"),
+	4000.0f,
+	TEXT("Side of the force map in world units, the interactors further from the view don't affect the blades."),
+	ECVF_RenderThreadSafe | ECVF_Scalability);
+
+static TAutoConsoleVariable<float> CVarGrassForceMapDecay(
+	TEXT("r.Grass.ForceMapDecay"),
+	2.0f,
+	TEXT("Rate per second the forces of the interactors decay at once they moved on, the blades stand back up as they do."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarGrassForceMapMaxBend(
+	TEXT("r.Grass.ForceMapMaxBend"),
+	1.4f,
+	TEXT("Largest angle in radians the interactors bend the blades by."),
+	ECVF_RenderThreadSafe);
+
+/** Force left in the map under which the blades are considered standing. */
+static constexpr float GrassForceMapThreshold = 1.0f / 256.0f;
+
+void FGrassInstancingRendererExtension::UpdateForceMaps(FRDGBuilder& GraphBuilder)
+{
+	GrassUtils::FGrassForceMap Settings;
+	Settings.Resolution = FMath::Clamp(CVarGrassForceMapResolution.GetValueOnRenderThread(), 0, 2048);
+	Settings.WorldSize = CVarGrassForceMapSize.GetValueOnRenderThread();
+	Settings.DecayRate = CVarGrassForceMapDecay.GetValueOnRenderThread();
+	Settings.MaxBendAngle = FMath::Clamp(CVarGrassForceMapMaxBend.GetValueOnRenderThread(), 0.0f, UE_HALF_PI);
+
+	// The instance passes sample the map whether there are interactors or not
+	GrassUtils::FGrassForceMapParameters* Parameters = GraphBuilder.AllocParameters<GrassUtils::FGrassForceMapParameters>();
+	Parameters->ForceMapTexture = GSystemTextures.GetBlackDummy(GraphBuilder);
+	Parameters->ForceMapSampler = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp, AM_Clamp>::GetRHI();
+	Parameters->ForceMapOrigin = FVector3f::ZeroVector;
+	Parameters->ForceMapInvSize = 0.0f;
+	Parameters->ForceMapMaxBend = 0.0f;
+	NoForceMapParameters = Parameters;
+
+	// Every scene is centered on its own first main view, the views of a frame may draw several worlds
+	TMap<const FSceneInterface*, FVector> ViewOrigins;
+	for (const FSceneView* MainView : MainViews)
+	{
+		const FSceneInterface* Scene = MainView->Family->Scene;
+		if (Scene != nullptr && !ViewOrigins.Contains(Scene))
+		{
+			ViewOrigins.Add(Scene, GrassUtils::GetLodView(MainView).Origin);
+		}
+	}
+
+	const bool bEnabled = CVarGrassForceMap.GetValueOnRenderThread() != 0 && Settings.IsEnabled();
+	for (auto It = SceneForces.CreateIterator(); It; ++It)
+	{
+		FSceneForces& Forces = It.Value();
+		const FVector* ViewOrigin = ViewOrigins.Find(It.Key());
+		if (ViewOrigin != nullptr)
+		{
+			Forces.SeenId = DiscardId;
+		}
+
+		// The game thread doesn't tell when a world goes away, its scene is dropped once neither drawn nor fed for a while
+		if (DiscardId - Forces.SeenId > 4u)
+		{
+			It.RemoveCurrent();
+			continue;
+		}
+
+		Forces.Parameters = nullptr;
+		if (!bEnabled)
+		{
+			Forces.ForceMap = FForceMapState();
+			continue;
+		}
+		UpdateForceMap(GraphBuilder, Settings, ViewOrigin, Forces);
+	}
+}
+
+void FGrassInstancingRendererExtension::UpdateForceMap(FRDGBuilder& GraphBuilder, const GrassUtils::FGrassForceMap& Settings, const FVector* InViewOrigin, FSceneForces& Forces)
+{
+	FForceMapState& ForceMap = Forces.ForceMap;
+
+	// Without a view to center the map on, the interactors can't affect any blade
+	if (InViewOrigin == nullptr && !ForceMap.Texture.IsValid())
+		return;
+
+	const FVector ViewOrigin = InViewOrigin != nullptr ? *InViewOrigin : ForceMap.ViewOrigin;
+	const float TexelSize = Settings.GetTexelSize();
+	const FIntPoint OriginTexel = Settings.GetOriginTexel(ViewOrigin);
+	const FVector2D Corner = FVector2D(OriginTexel) * TexelSize;
+	const FBox2D MapBox(Corner, Corner + FVector2D(Settings.Resolution * TexelSize));
+	// Snapped as well, so that the bottoms carried over don't drift with every move of the view
+	const float ReferenceZ = static_cast<float>(FMath::FloorToDouble(ViewOrigin.Z / TexelSize) * TexelSize);
+
+	// Interactors off the map are dropped, the closest to the view are kept past the upload limit
+	TArray<GrassUtils::FGrassInteractor> FrameInteractors;
+	FrameInteractors.Reserve(Forces.Interactors.Num());
+	for (const GrassUtils::FGrassInteractor& Interactor : Forces.Interactors)
+	{
+		const FVector2D Min(FMath::Min(Interactor.Start.X, Interactor.End.X) - Interactor.Radius, FMath::Min(Interactor.Start.Y, Interactor.End.Y) - Interactor.Radius);
+		const FVector2D Max(FMath::Max(Interactor.Start.X, Interactor.End.X) + Interactor.Radius, FMath::Max(Interactor.Start.Y, Interactor.End.Y) + Interactor.Radius);
+		if (Interactor.Strength > 0.0f && MapBox.Intersect(FBox2D(Min, Max)))
+		{
+			FrameInteractors.Add(Interactor);
+		}
+	}
+	if (FrameInteractors.Num() > MAX_GRASS_INTERACTORS)
+	{
+		const FVector3f Origin(ViewOrigin);
+		FrameInteractors.Sort([&Origin](const GrassUtils::FGrassInteractor& A, const GrassUtils::FGrassInteractor& B)
+		{
+			return FVector3f::DistSquared((A.Start + A.End) * 0.5f, Origin) < FVector3f::DistSquared((B.Start + B.End) * 0.5f, Origin);
+		});
+		FrameInteractors.SetNum(MAX_GRASS_INTERACTORS);
+	}
+
+	// Without any force left the blades all stand, the map is dropped until an interactor comes by
+	const float Decay = Settings.GetDecay(FrameTime.GetDeltaWorldTimeSeconds());
+	ForceMap.Remaining = FrameInteractors.Num() > 0 ? 1.0f : ForceMap.Remaining * Decay;
+	if (ForceMap.Remaining < GrassForceMapThreshold)
+	{
+		ForceMap = FForceMapState();
+		return;
+	}
+
+	RDG_EVENT_SCOPE(GraphBuilder, "GrassForceMap");
+
+	// The last map is carried over while it has the same texels, scrolled by the move of the view
+	const bool bHistory = ForceMap.Texture.IsValid()
+		&& ForceMap.Settings.Resolution == Settings.Resolution && ForceMap.Settings.WorldSize == Settings.WorldSize;
+	const FIntPoint Shift = bHistory ? OriginTexel - ForceMap.OriginTexel : FIntPoint(Settings.Resolution);
+
+	FRDGTextureRef Texture = GraphBuilder.CreateTexture(
+		FRDGTextureDesc::Create2D(FIntPoint(Settings.Resolution), PF_FloatRGBA, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV),
+		TEXT("FGrass.ForceMap"));
+
+	// All the interactors of the frame in a single upload, an empty buffer can't be created
+	const GrassUtils::FGrassInteractor NoInteractor{};
+	FRDGBufferRef InteractorBuffer = CreateStructuredBuffer(
+		GraphBuilder, TEXT("FGrass.Interactors"),
+		sizeof(GrassUtils::FGrassInteractor), FMath::Max(FrameInteractors.Num(), 1),
+		FrameInteractors.Num() > 0 ? FrameInteractors.GetData() : &NoInteractor,
+		sizeof(GrassUtils::FGrassInteractor) * FMath::Max(FrameInteractors.Num(), 1));
+
+	GrassUtils::FSplatForceMap_CS::FParameters* PassParameters = GraphBuilder.AllocParameters<GrassUtils::FSplatForceMap_CS::FParameters>();
+	PassParameters->PreviousForceMap = bHistory ? GraphBuilder.RegisterExternalTexture(ForceMap.Texture) : GSystemTextures.GetBlackDummy(GraphBuilder);
+	PassParameters->RWForceMap = GraphBuilder.CreateUAV(Texture);
+	PassParameters->Interactors = GraphBuilder.CreateSRV(InteractorBuffer);
+	PassParameters->NumInteractors = FrameInteractors.Num();
+	PassParameters->ForceMapShift = Shift;
+	PassParameters->ForceMapResolution = Settings.Resolution;
+	PassParameters->ForceMapOrigin = FVector3f(Corner.X, Corner.Y, ReferenceZ);
+	PassParameters->ForceMapTexelSize = TexelSize;
+	PassParameters->ForceMapDecay = Decay;
+	PassParameters->ForceMapHeightShift = bHistory ? ReferenceZ - ForceMap.ReferenceZ : 0.0f;
+
+	const TShaderMapRef<GrassUtils::FSplatForceMap_CS> ComputeShader(GetGlobalShaderMap(GMaxRHIFeatureLevel));
+	FComputeShaderUtils::AddPass(
+		GraphBuilder,
+		RDG_EVENT_NAME("SplatGrassForceMap(Interactors=%d)", FrameInteractors.Num()),
+		ComputeShader, PassParameters,
+		FComputeShaderUtils::GetGroupCount(FIntPoint(Settings.Resolution), FORCE_MAP_GROUP_SIZE));
+
+	ForceMap.Texture = GraphBuilder.ConvertToExternalTexture(Texture);
+	ForceMap.Settings = Settings;
+	ForceMap.ViewOrigin = ViewOrigin;
+	ForceMap.OriginTexel = OriginTexel;
+	ForceMap.ReferenceZ = ReferenceZ;
+
+	GrassUtils::FGrassForceMapParameters* Parameters = GraphBuilder.AllocParameters<GrassUtils::FGrassForceMapParameters>();
+	*Parameters = *NoForceMapParameters;
+	Parameters->ForceMapTexture = Texture;
+	Parameters->ForceMapOrigin = PassParameters->ForceMapOrigin;
+	Parameters->ForceMapInvSize = 1.0f / (Settings.Resolution * TexelSize);
+	Parameters->ForceMapMaxBend = Settings.MaxBendAngle;
+	Forces.Parameters = Parameters;
+}
+
+void FGrassInstancingRendererExtension::SetInteractors(const FSceneInterface* InScene, TArray<GrassUtils::FGrassInteractor>&& InInteractors)
+{
+	FSceneForces& Forces = SceneForces.FindOrAdd(InScene);
+	Forces.Interactors = MoveTemp(InInteractors);
+	Forces.SeenId = DiscardId;
+}
+
+const GrassUtils::FGrassForceMapParameters& FGrassInstancingRendererExtension::GetForceMapParameters(const FSceneInterface* InScene) const
+{
+	const FSceneForces* Forces = SceneForces.Find(InScene);
+	return Forces != nullptr && Forces->Parameters != nullptr ? *Forces->Parameters : *NoForceMapParameters;
+}
+
+void GrassUtils::SetGrassInteractors(const FSceneInterface* InScene, TArray<FGrassInteractor>&& InInteractors)
+{
+	check(IsInRenderingThread());
+	GrassRendererExtension.SetInteractors(InScene, MoveTemp(InInteractors));
+}
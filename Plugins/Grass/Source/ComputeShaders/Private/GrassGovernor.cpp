@@ -0,0 +1,90 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+// Adapted from the VirtualHeightfieldMesh plugin
+
+#include "GrassGovernor.h"
+
+#include "GrassInstancingRenderer.h"
+
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Governor GPU Time (ms)"), STAT_GrassGovernorGpuTime, STATGROUP_Grass);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Governor Quality"), STAT_GrassGovernorQuality, STATGROUP_Grass);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Governor LOD Bias"), STAT_GrassGovernorLodBias, STATGROUP_Grass);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Governor Density Scale"), STAT_GrassGovernorDensityScale, STATGROUP_Grass);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Governor Cutoff Scale"), STAT_GrassGovernorCutoffScale, STATGROUP_Grass);
+
+static TAutoConsoleVariable<float> CVarGrassGovernorTargetMs(
+	TEXT("r.Grass.GovernorTargetMs"),
+	0.0f,
+	TEXT("GPU time in milliseconds the culling and instance passes of the grass are held to by lowering the density first,\n")
+	TEXT("then the cutoff distance, and raising them back once there is room. 0 disables the governor.\n")
+	TEXT("The LOD bias is lowered along with the density, it only lightens the draws, which aren't timed.\n")
+	TEXT("The passes are only timed on the graphics pipe, the quality is held while they run on async compute, see r.Grass.AsyncCompute."),
+	ECVF_RenderThreadSafe | ECVF_Scalability);
+
+static TAutoConsoleVariable<float> CVarGrassGovernorSmoothing(
+	TEXT("r.Grass.GovernorSmoothing"),
+	0.1f,
+	TEXT("Weight of the timing of a new frame in the moving average the governor reacts to."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarGrassGovernorHysteresis(
+	TEXT("r.Grass.GovernorHysteresis"),
+	0.1f,
+	TEXT("Relative deviation from r.Grass.GovernorTargetMs the average time has to exceed before the governor changes the quality."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarGrassGovernorMinLodBias(
+	TEXT("r.Grass.GovernorMinLodBias"),
+	-2.0f,
+	TEXT("Lowest LOD bias the governor can add to r.Grass.LodBias, reached with r.Grass.GovernorMinDensityScale."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarGrassGovernorMinDensityScale(
+	TEXT("r.Grass.GovernorMinDensityScale"),
+	0.25f,
+	TEXT("Lowest fraction of the blades the governor can keep."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarGrassGovernorMinCutoffScale(
+	TEXT("r.Grass.GovernorMinCutoffScale"),
+	0.5f,
+	TEXT("Lowest scale the governor can apply to the cutoff distance of the fields."),
+	ECVF_RenderThreadSafe);
+
+void FGrassInstancingRendererExtension::UpdateGovernor()
+{
+	GrassUtils::FGrassGovernor::FSettings Settings;
+	Settings.TargetMs = FMath::Max(CVarGrassGovernorTargetMs.GetValueOnRenderThread(), 0.0f);
+	Settings.Smoothing = CVarGrassGovernorSmoothing.GetValueOnRenderThread();
+	Settings.HysteresisBand = FMath::Max(CVarGrassGovernorHysteresis.GetValueOnRenderThread(), 0.0f);
+	Settings.MinLodBias = FMath::Min(CVarGrassGovernorMinLodBias.GetValueOnRenderThread(), 0.0f);
+	Settings.MinDensityScale = FMath::Clamp(CVarGrassGovernorMinDensityScale.GetValueOnRenderThread(), 1.0f / BUDGET_KEEP_FRACTION_STEPS, 1.0f);
+	Settings.MinCutoffScale = FMath::Clamp(CVarGrassGovernorMinCutoffScale.GetValueOnRenderThread(), 0.0f, 1.0f);
+	Governor.SetSettings(Settings);
+
+	if (!Governor.IsEnabled())
+	{
+		GovernorTimestamps.Reset();
+		return;
+	}
+
+	// Poll the timestamps once per frame rather than stalling on them, the frames are read in order
+	while (GovernorTimestamps.Num() > 0)
+	{
+		uint64 Begin = 0;
+		uint64 End = 0;
+		if (!RHIGetRenderQueryResult(GovernorTimestamps[0].Key, Begin, false)
+			|| !RHIGetRenderQueryResult(GovernorTimestamps[0].Value, End, false))
+			break;
+
+		// Timestamps are in microseconds
+		Governor.AddSample((End - Begin) / 1000.0f);
+		GovernorTimestamps.RemoveAt(0);
+	}
+
+	const GrassUtils::FGrassGovernor::FState& State = Governor.GetState();
+	SET_FLOAT_STAT(STAT_GrassGovernorGpuTime, State.SmoothedMs);
+	SET_FLOAT_STAT(STAT_GrassGovernorQuality, State.Quality);
+	SET_FLOAT_STAT(STAT_GrassGovernorLodBias, State.LodBias);
+	SET_FLOAT_STAT(STAT_GrassGovernorDensityScale, State.DensityScale);
+	SET_FLOAT_STAT(STAT_GrassGovernorCutoffScale, State.CutoffScale);
+}
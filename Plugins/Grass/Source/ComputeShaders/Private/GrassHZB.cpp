@@ -0,0 +1,133 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+// Adapted from the VirtualHeightfieldMesh plugin
+
+#include "GrassInstancingRenderer.h"
+#include "SceneViewExtension.h"
+
+static TAutoConsoleVariable<int32> CVarGrassHZBOcclusion(
+	TEXT("r.Grass.HZBOcclusion"),
+	0,
+	TEXT("Test the blades against a furthest depth pyramid built from the depth of the last frame of the view.\n")
+	TEXT("Work items culled with it aren't cached, and blades uncovered by moving occluders can be missing for a frame."),
+	ECVF_RenderThreadSafe | ECVF_Scalability);
+
+/** Hands the depth of every view to the renderer extension once the base pass has filled it. */
+class FGrassOcclusionViewExtension : public FSceneViewExtensionBase
+{
+public:
+	explicit FGrassOcclusionViewExtension(const FAutoRegister& AutoRegister)
+		: FSceneViewExtensionBase(AutoRegister)
+	{
+	}
+
+	//~ Begin ISceneViewExtension Interface
+	virtual void SetupViewFamily(FSceneViewFamily& InViewFamily) override {}
+	virtual void SetupView(FSceneViewFamily& InViewFamily, FSceneView& InView) override {}
+	virtual void BeginRenderViewFamily(FSceneViewFamily& InViewFamily) override {}
+	virtual void PostRenderBasePassDeferred_RenderThread(
+		FRDGBuilder& GraphBuilder,
+		FSceneView& InView,
+		const FRenderTargetBindingSlots& RenderTargets,
+		TRDGUniformBufferRef<FSceneTextureUniformParameters> SceneTextures) override
+	{
+		GrassRendererExtension.CaptureOcclusionHZB(GraphBuilder, InView, RenderTargets.DepthStencil.GetTexture());
+	}
+	//~ End ISceneViewExtension Interface
+};
+
+namespace GrassUtils
+{
+	/**
+	 * Reduce the depth in InViewRect into a furthest depth pyramid. Mip 0 takes the furthest depth
+	 * of OutFootprint x OutFootprint pixels, the smallest power of two keeping it under MaxOcclusionHZBSize.
+	 */
+	FRDGTextureRef AddPasses_BuildHZB(
+		FRDGBuilder& GraphBuilder,
+		const FGlobalShaderMap* InGlobalShaderMap,
+		FRDGTextureRef InSceneDepth,
+		const FIntRect& InViewRect,
+		uint32& OutFootprint)
+	{
+		const FIntPoint ViewSize = InViewRect.Size();
+		OutFootprint = 2;
+		while (FMath::DivideAndRoundUp<int32>(ViewSize.GetMax(), OutFootprint) > MaxOcclusionHZBSize)
+		{
+			OutFootprint *= 2;
+		}
+
+		// Power of two so that every mip covers the rounded up half of its parent
+		FIntPoint MipSize = FIntPoint::DivideAndRoundUp(ViewSize, OutFootprint);
+		const FIntPoint TextureSize(FMath::RoundUpToPowerOfTwo(MipSize.X), FMath::RoundUpToPowerOfTwo(MipSize.Y));
+		const int32 NumMips = FMath::FloorLog2(TextureSize.GetMax()) + 1;
+
+		FRDGTextureRef HZBTexture = GraphBuilder.CreateTexture(
+			FRDGTextureDesc::Create2D(TextureSize, PF_R32_FLOAT, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV, NumMips),
+			TEXT("FGrass.OcclusionHZB"));
+
+		TShaderMapRef<GrassUtils::FBuildHZB_CS> ComputeShader(InGlobalShaderMap);
+		FIntPoint ParentSize = ViewSize;
+		for (int32 Mip = 0; Mip < NumMips; Mip++)
+		{
+			GrassUtils::FBuildHZB_CS::FParameters* PassParameters =
+				GraphBuilder.AllocParameters<GrassUtils::FBuildHZB_CS::FParameters>();
+			PassParameters->ParentTexture = Mip == 0 ?
+				GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(InSceneDepth)) :
+				GraphBuilder.CreateSRV(FRDGTextureSRVDesc::CreateForMipLevel(HZBTexture, Mip - 1));
+			PassParameters->ParentOffset = Mip == 0 ? FUintVector2(InViewRect.Min.X, InViewRect.Min.Y) : FUintVector2(0, 0);
+			PassParameters->ParentSize = FUintVector2(ParentSize.X, ParentSize.Y);
+			PassParameters->ParentFootprint = Mip == 0 ? OutFootprint : 2;
+			PassParameters->MipSize = FUintVector2(MipSize.X, MipSize.Y);
+			PassParameters->RWHZBMip = GraphBuilder.CreateUAV(FRDGTextureUAVDesc(HZBTexture, Mip));
+
+			FComputeShaderUtils::AddPass(
+				GraphBuilder,
+				RDG_EVENT_NAME("BuildGrassHZB(Mip=%d)", Mip),
+				ComputeShader, PassParameters,
+				FComputeShaderUtils::GetGroupCount(MipSize, HZB_GROUP_SIZE));
+
+			ParentSize = MipSize;
+			MipSize = FIntPoint::DivideAndRoundUp(MipSize, 2);
+		}
+
+		return HZBTexture;
+	}
+
+	void RegisterOcclusionViewExtension()
+	{
+		static TSharedPtr<FGrassOcclusionViewExtension, ESPMode::ThreadSafe> OcclusionViewExtension =
+			FSceneViewExtensions::NewExtension<FGrassOcclusionViewExtension>();
+	}
+}
+
+const FGrassInstancingRendererExtension::FOcclusionHZB* FGrassInstancingRendererExtension::FindOcclusionHZB(const FSceneView* InView) const
+{
+	if (CVarGrassHZBOcclusion.GetValueOnRenderThread() == 0 || InView->State == nullptr)
+		return nullptr;
+
+	// The depth has to be the one of the frame right before
+	const FOcclusionHZB* HZB = OcclusionHZBs.Find(InView->State->GetViewKey());
+	if (HZB == nullptr || InView->Family->FrameNumber - HZB->FrameNumber != 1u)
+		return nullptr;
+
+	return HZB;
+}
+
+void FGrassInstancingRendererExtension::CaptureOcclusionHZB(FRDGBuilder& GraphBuilder, const FSceneView& InView, FRDGTextureRef InSceneDepth)
+{
+	if (CVarGrassHZBOcclusion.GetValueOnRenderThread() == 0 || InView.State == nullptr || InSceneDepth == nullptr)
+		return;
+
+	RDG_EVENT_SCOPE(GraphBuilder, "GrassOcclusionHZB");
+	const FGlobalShaderMap* GlobalShaderMap = GetGlobalShaderMap(GMaxRHIFeatureLevel);
+
+	uint32 Footprint;
+	FRDGTextureRef HZBTexture = GrassUtils::AddPasses_BuildHZB(GraphBuilder, GlobalShaderMap, InSceneDepth, InView.ViewRect, Footprint);
+
+	FOcclusionHZB& HZB = OcclusionHZBs.FindOrAdd(InView.State->GetViewKey());
+	HZB.Texture = GraphBuilder.ConvertToExternalTexture(HZBTexture);
+	HZB.ViewProjection = InView.ViewMatrices.GetViewProjectionMatrix();
+	HZB.ViewSize = FVector2f(InView.ViewRect.Size()) / static_cast<float>(Footprint);
+	HZB.NumMips = HZBTexture->Desc.NumMips;
+	HZB.FrameNumber = InView.Family->FrameNumber;
+	HZB.CapturedId = DiscardId;
+}
@@ -0,0 +1,111 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+// Adapted from the VirtualHeightfieldMesh plugin
+
+#pragma once
+
+#include "GrassInstancingSceneProxy.h"
+
+/** Helpers shared by the translation units of the renderer extension, see GrassInstancingSceneProxy.cpp. */
+
+DECLARE_LOG_CATEGORY_EXTERN(LogGrass, Log, All);
+
+DECLARE_STATS_GROUP(TEXT("Grass"), STATGROUP_Grass, STATCAT_Advanced);
+
+/** Single global instance of the ISM renderer extension. */
+extern TGlobalResource<FGrassInstancingRendererExtension> GrassRendererExtension;
+
+namespace GrassUtils
+{
+	void ReleaseInstanceBuffers(FPersistentBuffers& InBuffers);
+
+	/** Upload the blades of a section. */
+	void InitializeGrassDataBuffer(FGrassInstancingSectionProxy* InSectionProxy);
+
+	void InitializeInstanceBuffers(
+		const void* InOwner,
+		const uint32 InCapacity,
+		FPersistentBuffers& InBuffers);
+
+	/** Fill the projection data used by the LOD metric from an FSceneView respecting the freezerendering mode. */
+	FGrassLodView GetLodView(FSceneView const* InSceneView);
+
+	/** Fill the inward facing planes tested by CullInstancesCS from a volume in world space translated by InTranslation. */
+	void GetCullPlanes(const FConvexVolume& InVolume, const FVector& InTranslation, FChildViewDesc& OutViewDesc);
+
+	/** Build the constants of the grass passes culling InCullViewDesc with the LODs of InMainViewDesc. */
+	TRDGUniformBufferRef<FGrassViewParameters> CreateViewUniformBuffer(
+		FRDGBuilder& GraphBuilder,
+		const FMainViewDesc& InMainViewDesc,
+		const FChildViewDesc& InCullViewDesc,
+		const float InCullMargin = 0.0f);
+
+	/** Thread group size of the culling passes selected by r.Grass.ThreadGroupSize. */
+	uint32 GetCullingThreadGroupSize();
+
+	/** Initialize the volatile resources used in the render graph. */
+	void InitializeResources(
+		FRDGBuilder& GraphBuilder,
+		const FPersistentBuffers& InOutputResources,
+		const bool bFusedInstanceData,
+		FVolatileResources& OutResources);
+
+	/** Initialise the draw indirect buffer. */
+	void AddPass_InitIndirectArgs(
+		FRDGBuilder& GraphBuilder,
+		const FGlobalShaderMap* InGlobalShaderMap,
+		const FVolatileResources& InVolatileResources,
+		const uint32 (&LodNumIndices)[MAX_LOD_BUCKETS]);
+
+	void AddPass_CullInstances(
+		FRDGBuilder& GraphBuilder,
+		const FGlobalShaderMap* InGlobalShaderMap,
+		const FVolatileResources& InVolatileResources,
+		const FProxyDesc& ProxyDesc,
+		const TRDGUniformBufferRef<FGrassViewParameters> InViewUniformBuffer,
+		const FGrassHZBParameters* InHZBParameters,
+		const FGrassWindParameters& InWindParameters,
+		const FGrassForceMapParameters& InForceMapParameters,
+		FRDGBufferSRVRef InBendStates,
+		const FUintVector2 LodBucketRange,
+		const bool bFusedInstanceData,
+		const bool bDistanceBins,
+		const uint32 ThreadGroupSize);
+
+	/** Compute the first instance of each slot of the culled blades, after the cull passes and before the instance pass. */
+	void AddPass_ComputeSlotOffsets(
+		FRDGBuilder& GraphBuilder,
+		const FGlobalShaderMap* InGlobalShaderMap,
+		const FVolatileResources& InVolatileResources,
+		const bool bDistanceBins);
+
+	/** Cull quads and write to the final output buffer. */
+	void AddPass_ComputeInstanceData(
+		FRDGBuilder& GraphBuilder,
+		const FGlobalShaderMap* InGlobalShaderMap,
+		const FVolatileResources& InVolatileResources,
+		const FBox3f& InstanceBounds,
+		const FGrassWindParameters& InWindParameters,
+		const FGrassForceMapParameters& InForceMapParameters,
+		const bool bDistanceBins,
+		const uint32 ThreadGroupSize);
+
+	/** Write the GPU time into a timestamp query once the passes added before it on the graphics pipe are done. */
+	void AddPass_Timestamp(FRDGBuilder& GraphBuilder, FRHIRenderQuery* InQuery);
+
+	/** Set while the benchmark adds its passes, so that they don't overlap with the async compute work of the frame. */
+	extern bool bCullingOnGraphicsPipe;
+
+	/**
+	 * Reduce the depth in InViewRect into a furthest depth pyramid. Mip 0 takes the furthest depth
+	 * of OutFootprint x OutFootprint pixels, the smallest power of two keeping it under MaxOcclusionHZBSize.
+	 */
+	FRDGTextureRef AddPasses_BuildHZB(
+		FRDGBuilder& GraphBuilder,
+		const FGlobalShaderMap* InGlobalShaderMap,
+		FRDGTextureRef InSceneDepth,
+		const FIntRect& InViewRect,
+		uint32& OutFootprint);
+
+	/** Create the view extension handing the depth of every view to the renderer extension, once. */
+	void RegisterOcclusionViewExtension();
+}
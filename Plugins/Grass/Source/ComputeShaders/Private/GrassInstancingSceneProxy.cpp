@@ -2,14 +2,147 @@
 // Adapted from the VirtualHeightfieldMesh plugin
 
 #include "GrassInstancingSceneProxy.h"
+#include "GrassInstancingRenderer.h"
 
 #include "Chaos/Plane.h"
 #include "Kismet/GameplayStatics.h"
 #include "Math/UnitConversion.h"
 
+DEFINE_LOG_CATEGORY(LogGrass);
+
 /** Single global instance of the ISM renderer extension. */
 TGlobalResource<FGrassInstancingRendererExtension> GrassRendererExtension;
 
+static TAutoConsoleVariable<float> CVarGrassLodBias(
+	TEXT("r.Grass.LodBias"),
+	0.0f,
+	TEXT("Blade steps added to the ones selected by the LOD metric, negative values make the grass coarser."),
+	ECVF_RenderThreadSafe | ECVF_Scalability);
+
+static TAutoConsoleVariable<float> CVarGrassLodSceneCaptureBias(
+	TEXT("r.Grass.LodSceneCaptureBias"),
+	-1.0f,
+	TEXT("Blade steps added on top of r.Grass.LodBias in scene capture views."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarGrassLodReferenceHeight(
+	TEXT("r.Grass.LodReferenceHeight"),
+	1080,
+	TEXT("Vertical resolution the LOD pixel error is measured at, so that the triangle count doesn't depend on the output resolution.\n")
+	TEXT("0 measures the error at the actual view resolution."),
+	ECVF_RenderThreadSafe | ECVF_Scalability);
+
+static TAutoConsoleVariable<int32> CVarGrassBatchSections(
+	TEXT("r.Grass.BatchSections"),
+	1,
+	TEXT("Cull all the visible sections of a grass field into shared buffers and draw them with one draw per LOD and view.\n")
+	TEXT("0 draws every section on its own."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarGrassShadowDensityStride(
+	TEXT("r.Grass.ShadowDensityStride"),
+	4,
+	TEXT("Only one blade every N is drawn in the shadow depth views."),
+	ECVF_RenderThreadSafe | ECVF_Scalability);
+
+static TAutoConsoleVariable<int32> CVarGrassShadowForceLowestLod(
+	TEXT("r.Grass.ShadowForceLowestLod"),
+	1,
+	TEXT("Draw all the blades with the coarsest LOD in the shadow depth views."),
+	ECVF_RenderThreadSafe | ECVF_Scalability);
+
+static TAutoConsoleVariable<int32> CVarGrassMergeViews(
+	TEXT("r.Grass.MergeViews"),
+	1,
+	TEXT("Cull the views of a family that look at the same region (stereo, close split screen views) once, over the union of their frusta."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarGrassMergeViewsMaxDistance(
+	TEXT("r.Grass.MergeViewsMaxDistance"),
+	50.0f,
+	TEXT("Maximum distance between the origins of two views sharing the culling."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarGrassMergeViewsMinDot(
+	TEXT("r.Grass.MergeViewsMinDot"),
+	0.9f,
+	TEXT("Minimum cosine of the angle between the directions of two views sharing the culling."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarGrassCullCompaction(
+	TEXT("r.Grass.CullCompaction"),
+	2,
+	TEXT("How the cull pass reserves the slots of the visible blades, to compare the paths:\n")
+	TEXT(" 0: two global atomics per blade\n")
+	TEXT(" 1: count in groupshared memory, one global atomic per group and LOD bucket\n")
+	TEXT(" 2: count with wave intrinsics, one global atomic per wave and LOD bucket (falls back to 1 without wave operations)"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarGrassFuseCulling(
+	TEXT("r.Grass.FuseCulling"),
+	0,
+	TEXT("Draw every work item with a single LOD bucket, the finest one its sections need, so that the cull pass\n")
+	TEXT("can write the instances directly instead of going through the culled buffers and the instance pass."),
+	ECVF_RenderThreadSafe | ECVF_Scalability);
+
+static TAutoConsoleVariable<int32> CVarGrassCacheCulling(
+	TEXT("r.Grass.CacheCulling"),
+	1,
+	TEXT("Skip the culling of the work items whose sections, LODs and views haven't changed since their buffers have been filled.\n")
+	TEXT("The work items culled against the HZB, and the ones with blades moved by the wind, the force map or a bend state,\n")
+	TEXT("are culled every frame, their instances change even when the views don't."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarGrassCacheCullingTolerance(
+	TEXT("r.Grass.CacheCullingTolerance"),
+	0.1f,
+	TEXT("Step the view origin and cull planes are quantized with by r.Grass.CacheCulling, in world units."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarGrassAmortizedRecullFrames(
+	TEXT("r.Grass.AmortizedRecullFrames"),
+	0,
+	TEXT("Cull the work items against their volume pushed out by r.Grass.AmortizedRecullMargin, and keep drawing the result\n")
+	TEXT("while the views stay within the margin, re-culling each work item at most once every N frames.\n")
+	TEXT("Work items are staggered, so about 1/N of them is re-culled every frame. 0 disables the amortized culling."),
+	ECVF_RenderThreadSafe | ECVF_Scalability);
+
+static TAutoConsoleVariable<float> CVarGrassAmortizedRecullMargin(
+	TEXT("r.Grass.AmortizedRecullMargin"),
+	100.0f,
+	TEXT("Distance in world units the cull volumes and the cutoff distance are pushed out by for r.Grass.AmortizedRecullFrames."),
+	ECVF_RenderThreadSafe | ECVF_Scalability);
+
+static TAutoConsoleVariable<int32> CVarGrassAsyncCompute(
+	TEXT("r.Grass.AsyncCompute"),
+	1,
+	TEXT("Run the grass culling passes on the async compute pipe when the platform supports it efficiently,\n")
+	TEXT("so that they overlap with the graphics work recorded before the draws consuming them."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarGrassOcclusionQueries(
+	TEXT("r.Grass.OcclusionQueries"),
+	1,
+	TEXT("Issue one occlusion query per section and skip the sections found occluded in the last frame."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarGrassThreadGroupSize(
+	TEXT("r.Grass.ThreadGroupSize"),
+	MAX_THREADS_PER_GROUP,
+	TEXT("Thread group size of the cull and instance passes: 64, 128, 256 or 1024, other values are rounded down to one of them.\n")
+	TEXT("r.Grass.BenchmarkThreadGroupSizes measures them on the running platform."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarGrassDistanceBins(
+	TEXT("r.Grass.DistanceBins"),
+	0,
+	TEXT("Order the blades of each LOD bucket near to far by coarse distance bins so that the nearest blades fill the depth buffer first.\n")
+	TEXT("Disables the fused cull pass of the work items drawn with a single LOD bucket."),
+	ECVF_RenderThreadSafe | ECVF_Scalability);
+
+/** Source of the section revisions. */
+static FThreadSafeCounter GrassSectionRevisionCounter;
+
 namespace GrassUtils
 {
 	static void InitOrUpdateResource(FRenderResource* InResource)
@@ -24,51 +157,44 @@ namespace GrassUtils
 	
 	void ReleaseInstanceBuffers(FPersistentBuffers& InBuffers)
 	{
-		InBuffers.GrassDataBuffer.SafeRelease();
-		InBuffers.GrassDataBufferSRV.SafeRelease();
-
 		InBuffers.InstanceBuffer.SafeRelease();
-		InBuffers.InstanceBufferUAV.SafeRelease();
 		InBuffers.InstanceBufferSRV.SafeRelease();
 		
 		InBuffers.IndirectArgsBuffer.SafeRelease();
-		InBuffers.IndirectArgsBufferUAV.SafeRelease();
+		InBuffers.IndirectArgsBufferSRV.SafeRelease();
+	}
+
+	/** Upload the blades of a section. */
+	void InitializeGrassDataBuffer(FGrassInstancingSectionProxy* InSectionProxy)
+	{
+		FRHIResourceCreateInfo CreateInfo(TEXT("FGrass.GrassDataBuffer"), &InSectionProxy->GrassData);
+		constexpr int32 GrassDataSize = sizeof(GrassUtils::FPackedGrassData);
+		const int32 GrassDataBufferSize = InSectionProxy->GrassDataNum * GrassDataSize;
+		InSectionProxy->GrassDataBuffer = RHICreateStructuredBuffer(GrassDataSize, GrassDataBufferSize, BUF_ShaderResource, ERHIAccess::SRVMask, CreateInfo);
+		InSectionProxy->GrassDataBufferSRV = RHICreateShaderResourceView(InSectionProxy->GrassDataBuffer);
 	}
 
 	void InitializeInstanceBuffers(
-		FGrassInstancingSectionProxy* InSectionProxy,
+		const void* InOwner,
+		const uint32 InCapacity,
 		GrassUtils::FPersistentBuffers& InBuffers)
 	{
-		InBuffers.SectionProxy = InSectionProxy;
-		const int32 GrassDataNum = InSectionProxy->GrassData.Num();
-		{
-			FRHIResourceCreateInfo CreateInfo(TEXT("FGrass.GrassDataBuffer"), &InSectionProxy->GrassData);
-			constexpr int32 GrassDataSize = sizeof(GrassUtils::FPackedGrassData);
-			const int32 GrassDataBufferSize = GrassDataNum * GrassDataSize;
-			InBuffers.GrassDataBuffer = RHICreateStructuredBuffer(GrassDataSize, GrassDataBufferSize, BUF_ShaderResource, ERHIAccess::SRVMask, CreateInfo);
-			InBuffers.GrassDataBufferSRV = RHICreateShaderResourceView(InBuffers.GrassDataBuffer);
-		}
+		InBuffers.Owner = InOwner;
+		InBuffers.Capacity = InCapacity;
+		const int32 GrassDataNum = FMath::Max<uint32>(InCapacity, 1);
 		{
-			FRHIResourceCreateInfo CreateInfo(TEXT("FGrass.InstanceBuffer"));
-			constexpr int32 InstanceSize = sizeof(GrassUtils::FGrassInstance);
-			const int32 InstanceBufferSize = GrassDataNum * InstanceSize;
-			InBuffers.InstanceBuffer = RHICreateStructuredBuffer(
-				InstanceSize, InstanceBufferSize,
-				BUF_UnorderedAccess | BUF_ShaderResource, ERHIAccess::SRVMask, CreateInfo);
-			InBuffers.InstanceBufferUAV = RHICreateUnorderedAccessView(InBuffers.InstanceBuffer, PF_R32_UINT);
-			InBuffers.InstanceBufferSRV = RHICreateShaderResourceView(InBuffers.InstanceBuffer);
+			const uint32 InstanceSize = UseCompactInstances() ? sizeof(GrassUtils::FGrassCompactInstance) : sizeof(GrassUtils::FGrassInstance);
+			InBuffers.InstanceBuffer = AllocatePooledBuffer(
+				FRDGBufferDesc::CreateStructuredDesc(InstanceSize, GrassDataNum),
+				TEXT("FGrass.InstanceBuffer"));
+			InBuffers.InstanceBufferSRV = RHICreateShaderResourceView(InBuffers.InstanceBuffer->GetRHI());
 		}
 		{
-			FRHIResourceCreateInfo CreateInfo(TEXT("FGrass.IndirectArgsBuffer"));
-			InBuffers.IndirectArgsBuffer = RHICreateStructuredBuffer(
-				IndirectArgsPerElementSize, IndirectArgsBytesSize,
-				BUF_UnorderedAccess | BUF_ShaderResource | BUF_DrawIndirect,
-				ERHIAccess::IndirectArgs, CreateInfo);
-			InBuffers.IndirectArgsBufferUAV = RHICreateUnorderedAccessView(
-				InBuffers.IndirectArgsBuffer, PF_R32_UINT);
-			InBuffers.IndirectArgsBufferSRV = RHICreateShaderResourceView(InBuffers.IndirectArgsBuffer);
+			FRDGBufferDesc Desc = FRDGBufferDesc::CreateStructuredDesc(IndirectArgsPerElementSize, IndirectArgsBytesSize / IndirectArgsPerElementSize);
+			Desc.Usage |= EBufferUsageFlags::DrawIndirect;
+			InBuffers.IndirectArgsBuffer = AllocatePooledBuffer(Desc, TEXT("FGrass.IndirectArgsBuffer"));
+			InBuffers.IndirectArgsBufferSRV = RHICreateShaderResourceView(InBuffers.IndirectArgsBuffer->GetRHI());
 		}
-
 	}
 
 	/** Fill the FViewData from an FSceneView respecting the freezerendering mode. */
@@ -95,16 +221,347 @@ namespace GrassUtils
 		}
 	}
 
+	/** Fill the projection data used by the LOD metric from an FSceneView respecting the freezerendering mode. */
+	FGrassLodView GetLodView(FSceneView const* InSceneView)
+	{
+		FViewData ViewData;
+		GetViewData(InSceneView, ViewData);
+
+		// Use the unscaled rect so that dynamic resolution doesn't change the LODs
+		const FIntRect ViewRect = InSceneView->UnscaledViewRect;
+		const float ViewHeight = FMath::Max(ViewRect.Height(), 1);
+		float ScreenScale = FMath::Max(
+			0.5f * ViewRect.Width() * ViewData.ProjectionMatrix.M[0][0],
+			0.5f * ViewHeight * ViewData.ProjectionMatrix.M[1][1]);
+
+		const int32 ReferenceHeight = CVarGrassLodReferenceHeight.GetValueOnRenderThread();
+		if (ReferenceHeight > 0)
+		{
+			ScreenScale *= ReferenceHeight / ViewHeight;
+		}
+
+		FGrassLodView LodView;
+		LodView.Origin = ViewData.ViewOrigin;
+		LodView.ScreenScale = ScreenScale / FMath::Max(InSceneView->LODDistanceFactor, UE_KINDA_SMALL_NUMBER);
+		LodView.LodBias = CVarGrassLodBias.GetValueOnRenderThread() + GrassRendererExtension.GetGovernorState().LodBias;
+		if (InSceneView->bIsSceneCapture)
+		{
+			LodView.LodBias += CVarGrassLodSceneCaptureBias.GetValueOnRenderThread();
+		}
+		LodView.ViewKey = InSceneView->State != nullptr ? InSceneView->State->GetViewKey() : 0;
+
+		return LodView;
+	}
+
+	/** Fill the inward facing planes tested by CullInstancesCS from a volume in world space translated by InTranslation. */
+	void GetCullPlanes(const FConvexVolume& InVolume, const FVector& InTranslation, FChildViewDesc& OutViewDesc)
+	{
+		OutViewDesc.CullPlanes.Reset();
+		for (const FPlane& Plane : InVolume.Planes)
+		{
+			// Dropping planes only makes the culling more conservative
+			if (OutViewDesc.CullPlanes.Num() == MAX_CULL_PLANES)
+				break;
+
+			const FVector Normal = Plane.GetNormal();
+			const double W = Plane.W - FVector::DotProduct(Normal, InTranslation);
+			OutViewDesc.CullPlanes.Add(FVector4(-Normal, W));
+		}
+	}
+
+	/** Fill the FMainViewDesc from an FSceneView respecting the freezerendering mode. */
+	inline void GetMainViewDesc(FSceneView const* InSceneView, FMainViewDesc& OutViewDesc)
+	{
+		FViewData ViewData;
+		GetViewData(InSceneView, ViewData);
+
+		OutViewDesc.IsValid = true;
+		OutViewDesc.ViewDebug = InSceneView;
+		OutViewDesc.ViewOrigin = FVector3f(ViewData.ViewOrigin);
+		OutViewDesc.ViewMatrix = FMatrix44f(ViewData.ViewMatrix);
+		OutViewDesc.ViewProjectionMatrix = FMatrix44f(ViewData.ViewProjectionMatrix);
+		OutViewDesc.LodView = GetLodView(InSceneView);
+	}
+
+	/** Fill the FChildViewDesc of a camera view from an FSceneView respecting the freezerendering mode.
+	 *  InCullVolume is the frustum of the view, or the union of the frusta of the views sharing its culling.
+	 */
+	inline void GetCullViewDesc(FSceneView const* InSceneView, const FConvexVolume& InCullVolume, FChildViewDesc& OutViewDesc)
+	{
+		FViewData ViewData;
+		GetViewData(InSceneView, ViewData);
+
+		OutViewDesc.IsValid = true;
+		OutViewDesc.ViewDebug = InSceneView;
+		OutViewDesc.ViewOrigin = FVector3f(ViewData.ViewOrigin);
+		OutViewDesc.ViewMatrix = FMatrix44f(ViewData.ViewMatrix);
+		OutViewDesc.ViewProjectionMatrix = FMatrix44f(ViewData.ViewProjectionMatrix);
+		OutViewDesc.bIsShadowView = false;
+		OutViewDesc.DensityStride = 1;
+
+		GetCullPlanes(InCullVolume, FVector::ZeroVector, OutViewDesc);
+	}
+
+	/** Build the constants of the grass passes culling InCullViewDesc with the LODs of InMainViewDesc. */
+	TRDGUniformBufferRef<FGrassViewParameters> CreateViewUniformBuffer(
+		FRDGBuilder& GraphBuilder,
+		const FMainViewDesc& InMainViewDesc,
+		const FChildViewDesc& InCullViewDesc,
+		const float InCullMargin)
+	{
+		FGrassViewParameters* Parameters = GraphBuilder.AllocParameters<FGrassViewParameters>();
+
+		const FVector ViewOrigin = InMainViewDesc.LodView.Origin;
+		Parameters->ViewOriginHigh = FVector3f(ViewOrigin);
+		Parameters->ViewOriginLow = FVector3f(ViewOrigin - FVector(Parameters->ViewOriginHigh));
+
+		// Normalized and moved to the view relative space of the blades
+		for (int32 PlaneIndex = 0; PlaneIndex < InCullViewDesc.CullPlanes.Num(); PlaneIndex++)
+		{
+			const FVector4& Plane = InCullViewDesc.CullPlanes[PlaneIndex];
+			const FVector Normal(Plane);
+			const double InvLength = 1.0 / FMath::Max(Normal.Size(), UE_DOUBLE_SMALL_NUMBER);
+			const double W = (Plane.W + FVector::DotProduct(Normal, ViewOrigin)) * InvLength + InCullMargin;
+			Parameters->CullPlanes[PlaneIndex] = FVector4f(FVector3f(Normal * InvLength), static_cast<float>(W));
+		}
+		Parameters->NumCullPlanes = InCullViewDesc.CullPlanes.Num();
+		Parameters->DensityStride = FMath::Max<uint32>(InCullViewDesc.DensityStride, 1);
+
+		Parameters->LodViewScale = InMainViewDesc.LodView.ScreenScale * LOD_CURVATURE_ERROR_SCALE;
+		Parameters->LodBias = InMainViewDesc.LodView.LodBias;
+
+		return GraphBuilder.CreateUniformBuffer(Parameters);
+	}
+
+	/** Views sharing a culling pass over the union of their frusta. */
+	struct FViewGroup
+	{
+		/** The first view is the one the work is added for. */
+		TArray<int32, TInlineAllocator<2>> ViewIndices;
+		FConvexVolume CullVolume;
+	};
+
+	/** Near corners and corners at InDistance of the frustum of a perspective view. */
+	inline void GetFrustumCorners(const FViewData& InViewData, const float InDistance, FVector (&OutCorners)[8])
+	{
+		const FMatrix InvViewProjection = InViewData.ViewProjectionMatrix.Inverse();
+		const FVector Forward = InViewData.ViewMatrix.GetColumn(2);
+
+		int32 CornerIndex = 0;
+		for (const float X : { -1.0f, 1.0f })
+		{
+			for (const float Y : { -1.0f, 1.0f })
+			{
+				// Reversed Z, the near plane is at 1
+				const FVector4 Near = InvViewProjection.TransformFVector4(FVector4(X, Y, 1.0f, 1.0f));
+				const FVector NearCorner = FVector(Near) / Near.W;
+				const FVector Direction = (NearCorner - InViewData.ViewOrigin).GetSafeNormal();
+
+				OutCorners[CornerIndex++] = NearCorner;
+				OutCorners[CornerIndex++] = InViewData.ViewOrigin +
+					Direction * (InDistance / FMath::Max(FVector::DotProduct(Direction, Forward), UE_KINDA_SMALL_NUMBER));
+			}
+		}
+	}
+
+	/** Whether two views are close enough for the union of their frusta to be culled in place of each one. */
+	inline bool CanMergeViews(FSceneView const* InViewA, const FViewData& InViewDataA, FSceneView const* InViewB, const FViewData& InViewDataB)
+	{
+		if (!InViewA->IsPerspectiveProjection() || !InViewB->IsPerspectiveProjection())
+			return false;
+
+		const float MaxDistance = CVarGrassMergeViewsMaxDistance.GetValueOnRenderThread();
+		if (FVector::DistSquared(InViewDataA.ViewOrigin, InViewDataB.ViewOrigin) > FMath::Square(MaxDistance))
+			return false;
+
+		const FVector ForwardA = InViewDataA.ViewMatrix.GetColumn(2);
+		const FVector ForwardB = InViewDataB.ViewMatrix.GetColumn(2);
+		return FVector::DotProduct(ForwardA, ForwardB) >= CVarGrassMergeViewsMinDot.GetValueOnRenderThread();
+	}
+
+	/**
+	 * Group the views in InViewsMap that can share the culling, views that can't be merged get their own group.
+	 * The cull volume of a group is the frustum of its first view, with each plane pushed out
+	 * to contain the frusta of the other views up to InDistance.
+	 */
+	inline void GroupViews(
+		const TArray<const FSceneView*>& InViews,
+		const uint32 InViewsMap,
+		const float InDistance,
+		TArray<FViewGroup, TInlineAllocator<4>>& OutGroups)
+	{
+		const bool bMergeViews = CVarGrassMergeViews.GetValueOnRenderThread() != 0;
+
+		TArray<FViewData, TInlineAllocator<4>> GroupViewData;
+		for (int32 ViewIndex = 0; ViewIndex < InViews.Num(); ViewIndex++)
+		{
+			if (!(InViewsMap & (1 << ViewIndex)))
+				continue;
+
+			FViewData ViewData;
+			GetViewData(InViews[ViewIndex], ViewData);
+
+			int32 GroupIndex = 0;
+			for (; bMergeViews && GroupIndex < OutGroups.Num(); GroupIndex++)
+			{
+				if (CanMergeViews(InViews[OutGroups[GroupIndex].ViewIndices[0]], GroupViewData[GroupIndex], InViews[ViewIndex], ViewData))
+					break;
+			}
+
+			if (!bMergeViews || GroupIndex == OutGroups.Num())
+			{
+				FViewGroup& Group = OutGroups.AddDefaulted_GetRef();
+				Group.ViewIndices.Add(ViewIndex);
+				GetViewFrustumBounds(Group.CullVolume, ViewData.ViewProjectionMatrix, true);
+				GroupViewData.Add(ViewData);
+				continue;
+			}
+
+			FViewGroup& Group = OutGroups[GroupIndex];
+			Group.ViewIndices.Add(ViewIndex);
+
+			FVector Corners[8];
+			GetFrustumCorners(ViewData, InDistance, Corners);
+			for (FPlane& Plane : Group.CullVolume.Planes)
+			{
+				for (const FVector& Corner : Corners)
+				{
+					Plane.W = FMath::Max(Plane.W, FVector::DotProduct(Plane.GetNormal(), Corner));
+				}
+			}
+			Group.CullVolume.Init();
+		}
+	}
+
+	/** Hash of what the culling of a work item depends on besides the views. */
+	uint32 GetSectionsCacheKey(const TConstArrayView<FSectionWork> Sections)
+	{
+		uint32 Key = GetTypeHash(Sections.Num());
+		for (const FSectionWork& SectionWork : Sections)
+		{
+			Key = HashCombineFast(Key, SectionWork.Section->Revision);
+			Key = HashCombineFast(Key, GetTypeHash(SectionWork.LodBucketRange));
+			Key = HashCombineFast(Key, GetTypeHash(SectionWork.DensityScale));
+			Key = HashCombineFast(Key, GetTypeHash(SectionWork.CutoffScale));
+		}
+		// 0 is kept for the buffers that can't be reused
+		return FMath::Max(Key, 1u);
+	}
+
+	/** Hash of the views of a work item, quantized so that tiny movements don't invalidate the culling. */
+	uint32 GetViewCacheKey(FSceneView const* InMainView, const FConvexVolume& InCullVolume, const float InTolerance)
+	{
+		const double Step = FMath::Max(InTolerance, UE_KINDA_SMALL_NUMBER);
+		const auto Quantize = [](const double Value, const double InStep)
+		{
+			return GetTypeHash(FMath::RoundToDouble(Value / InStep));
+		};
+
+		const FGrassLodView LodView = GetLodView(InMainView);
+		uint32 Key = HashCombineFast(GetTypeHash(LodView.ScreenScale), GetTypeHash(LodView.LodBias));
+		for (int32 Axis = 0; Axis < 3; Axis++)
+		{
+			Key = HashCombineFast(Key, Quantize(LodView.Origin[Axis], Step));
+		}
+		for (const FPlane& Plane : InCullVolume.Planes)
+		{
+			// Normals are quantized so that they move the plane by about one step at a kilometer
+			for (int32 Axis = 0; Axis < 3; Axis++)
+			{
+				Key = HashCombineFast(Key, Quantize(Plane[Axis], Step * 1.0e-5));
+			}
+			Key = HashCombineFast(Key, Quantize(Plane.W, Step));
+		}
+		return Key;
+	}
+
+	/**
+	 * With r.Grass.FuseCulling, clamp all the sections of a work item to the finest bucket any of them needs.
+	 * The sections with several species keep their range, their blades can't be fused into a single draw anyway.
+	 */
+	void CollapseLodBucketRanges(const TArrayView<FSectionWork> Sections, FUintVector2& InOutLodBucketRange)
+	{
+		if (CVarGrassFuseCulling.GetValueOnRenderThread() == 0)
+			return;
+
+		for (const FSectionWork& SectionWork : Sections)
+		{
+			if (SectionWork.Section->NumSpecies > 1)
+				return;
+		}
+
+		InOutLodBucketRange.X = InOutLodBucketRange.Y;
+		for (FSectionWork& SectionWork : Sections)
+		{
+			SectionWork.LodBucketRange = InOutLodBucketRange;
+		}
+	}
+
+	/**
+	 * Whether all the blades of the sections end up in the same draw, a single bucket of a single species,
+	 * in which case the instances can be written by the cull pass.
+	 */
+	bool IsSingleLodBucket(const TConstArrayView<FSectionWork> Sections)
+	{
+		for (const FSectionWork& SectionWork : Sections)
+		{
+			if (SectionWork.Section->NumSpecies > 1
+				|| SectionWork.LodBucketRange.X != SectionWork.LodBucketRange.Y
+				|| SectionWork.LodBucketRange.X != Sections[0].LodBucketRange.X)
+				return false;
+		}
+		return true;
+	}
+
+	bool bCullingOnGraphicsPipe = false;
+
+	/** Pipe the grass culling passes are scheduled on. */
+	ERDGPassFlags GetCullingPassFlags()
+	{
+		return !bCullingOnGraphicsPipe && CVarGrassAsyncCompute.GetValueOnRenderThread() != 0 && GSupportsEfficientAsyncCompute ?
+			ERDGPassFlags::AsyncCompute : ERDGPassFlags::Compute;
+	}
+
+	/** Thread group size of the culling passes selected by r.Grass.ThreadGroupSize. */
+	uint32 GetCullingThreadGroupSize()
+	{
+		const int32 Requested = CVarGrassThreadGroupSize.GetValueOnRenderThread();
+		uint32 ThreadGroupSize = GrassThreadGroupSizes[0];
+		for (const uint32 Size : GrassThreadGroupSizes)
+		{
+			if (static_cast<int32>(Size) <= Requested)
+				ThreadGroupSize = Size;
+		}
+		return ThreadGroupSize;
+	}
+
 	/** Initialize the volatile resources used in the render graph. */
 	void InitializeResources(
 		FRDGBuilder& GraphBuilder,
-		const FGrassInstancingSectionProxy* Proxy,
-		const FProxyDesc& ProxyDesc,
-		const FMainViewDesc& InMainViewDesc,
+		const FPersistentBuffers& InOutputResources,
+		const bool bFusedInstanceData,
 		FVolatileResources& OutResources)
 	{
 		{
-			const int GrassDataNum = ProxyDesc.GrassData->Num();
+			OutResources.InstanceBuffer = GraphBuilder.RegisterExternalBuffer(InOutputResources.InstanceBuffer);
+			OutResources.InstanceBufferUAV = GraphBuilder.CreateUAV(OutResources.InstanceBuffer);
+			OutResources.IndirectArgsBuffer = GraphBuilder.RegisterExternalBuffer(InOutputResources.IndirectArgsBuffer);
+			OutResources.IndirectArgsBufferUAV = GraphBuilder.CreateUAV(OutResources.IndirectArgsBuffer);
+		}
+		{
+			OutResources.DispatchArgsBuffer =
+				GraphBuilder.CreateBuffer(
+					FRDGBufferDesc::CreateIndirectDesc<FRHIDispatchIndirectParameters>(1),
+					TEXT("FGrass.DispatchArgsBuffer"));
+			OutResources.DispatchArgsBufferUAV = GraphBuilder.CreateUAV(OutResources.DispatchArgsBuffer, PF_R32_UINT);
+		}
+
+		// The fused cull pass writes the instances directly
+		if (bFusedInstanceData)
+			return;
+
+		const int GrassDataNum = FMath::Max<uint32>(InOutputResources.Capacity, 1);
+		{
 			OutResources.CulledGrassDataBuffer =
 				GraphBuilder.CreateBuffer(
 					FRDGBufferDesc::CreateStructuredDesc(sizeof(GrassUtils::FPackedGrassData), GrassDataNum),
@@ -112,26 +569,40 @@ namespace GrassUtils
 			OutResources.CulledGrassDataBufferSRV = GraphBuilder.CreateSRV(OutResources.CulledGrassDataBuffer);
 			OutResources.CulledGrassDataBufferUAV = GraphBuilder.CreateUAV(OutResources.CulledGrassDataBuffer);
 		}
+		{
+			OutResources.CulledLodBuffer =
+				GraphBuilder.CreateBuffer(
+					FRDGBufferDesc::CreateStructuredDesc(sizeof(uint32), GrassDataNum),
+					TEXT("FGrass.CulledLodBuffer"));
+			OutResources.CulledLodBufferSRV = GraphBuilder.CreateSRV(OutResources.CulledLodBuffer);
+			OutResources.CulledLodBufferUAV = GraphBuilder.CreateUAV(OutResources.CulledLodBuffer);
+		}
 	}
 
 	/** Initialise the draw indirect buffer. */
 	void AddPass_InitIndirectArgs(
 		FRDGBuilder& GraphBuilder,
 		const FGlobalShaderMap* InGlobalShaderMap,
-		const FPersistentBuffers& InOutputResources)
+		const FVolatileResources& InVolatileResources,
+		const uint32 (&LodNumIndices)[MAX_LOD_BUCKETS])
 	{
 		TShaderMapRef<GrassUtils::FInitInstanceBuffer_CS> ComputeShader(InGlobalShaderMap);
 		
 		GrassUtils::FInitInstanceBuffer_CS::FParameters* PassParameters =
 			GraphBuilder.AllocParameters<GrassUtils::FInitInstanceBuffer_CS::FParameters>();
-		PassParameters->RWIndirectArgsBuffer = InOutputResources.IndirectArgsBufferUAV;
-		PassParameters->NumIndices = InOutputResources.SectionProxy->NumIndices;
+		PassParameters->RWIndirectArgsBuffer = InVolatileResources.IndirectArgsBufferUAV;
+		PassParameters->RWDispatchArgsBuffer = InVolatileResources.DispatchArgsBufferUAV;
+		for (int32 Bucket = 0; Bucket < MAX_LOD_BUCKETS; Bucket++)
+		{
+			PassParameters->LodNumIndices[Bucket / 4][Bucket % 4] = LodNumIndices[Bucket];
+		}
 
 		const FIntVector GroupCount = FIntVector(1, 1, 1);
 		
 		FComputeShaderUtils::AddPass<GrassUtils::FInitInstanceBuffer_CS>(
 			GraphBuilder,
 			RDG_EVENT_NAME("InitInstancingIndirectArgs"),
+			GetCullingPassFlags(),
 			ComputeShader, PassParameters,
 			GroupCount);
 	}
@@ -140,63 +611,156 @@ namespace GrassUtils
 		FRDGBuilder& GraphBuilder,
 		const FGlobalShaderMap* InGlobalShaderMap,
 		const FVolatileResources& InVolatileResources,
-		const FPersistentBuffers& InOutputResources,
 		const FProxyDesc& ProxyDesc,
-		const FMainViewDesc& InViewDesc)
+		const TRDGUniformBufferRef<FGrassViewParameters> InViewUniformBuffer,
+		const FGrassHZBParameters* InHZBParameters,
+		const FGrassWindParameters& InWindParameters,
+		const FGrassForceMapParameters& InForceMapParameters,
+		FRDGBufferSRVRef InBendStates,
+		const FUintVector2 LodBucketRange,
+		const bool bFusedInstanceData,
+		const bool bDistanceBins,
+		const uint32 ThreadGroupSize)
 	{
 		GrassUtils::FCullInstances_CS::FParameters* PassParameters =
 			GraphBuilder.AllocParameters<GrassUtils::FCullInstances_CS::FParameters>();
-		const GrassUtils::FCullInstances_CS::FPermutationDomain PermutationVector;
+		EGrassCullCompaction Compaction = static_cast<EGrassCullCompaction>(
+			FMath::Clamp(CVarGrassCullCompaction.GetValueOnRenderThread(), 0, static_cast<int32>(EGrassCullCompaction::Num) - 1));
+		if (Compaction == EGrassCullCompaction::Wave && !GRHISupportsWaveOperations)
+		{
+			Compaction = EGrassCullCompaction::GroupShared;
+		}
+
+		GrassUtils::FCullInstances_CS::FPermutationDomain PermutationVector;
+		PermutationVector.Set<GrassUtils::FCullInstances_CS::FCompactionModeDim>(static_cast<int32>(Compaction));
+		PermutationVector.Set<GrassUtils::FCullInstances_CS::FFusedInstanceDataDim>(bFusedInstanceData);
+		PermutationVector.Set<GrassUtils::FCullInstances_CS::FHZBOcclusionDim>(InHZBParameters != nullptr);
+		PermutationVector.Set<GrassUtils::FThreadGroupSizeDim>(ThreadGroupSize);
+		PermutationVector.Set<GrassUtils::FDistanceBinsDim>(bDistanceBins);
+		PermutationVector.Set<GrassUtils::FCompactInstancesDim>(UseCompactInstances());
 		const TShaderMapRef<GrassUtils::FCullInstances_CS> ComputeShader(InGlobalShaderMap, PermutationVector);
 
+		PassParameters->GrassView = InViewUniformBuffer;
+		if (InHZBParameters != nullptr)
+		{
+			PassParameters->HZB = *InHZBParameters;
+		}
+		PassParameters->Wind = InWindParameters;
+		PassParameters->ForceMap = InForceMapParameters;
 		PassParameters->bIsCullingEnabled = ProxyDesc.bIsCullingEnabled;
-		PassParameters->VP_MATRIX = InViewDesc.ViewProjectionMatrix;
-		PassParameters->CameraPosition = InViewDesc.ViewOrigin;
-		PassParameters->CutoffDistance = ProxyDesc.CutoffDistance;
-		PassParameters->GrassDataSize = ProxyDesc.GrassData->Num();
+		PassParameters->CutoffDistanceSquared = FMath::Square(ProxyDesc.CutoffDistance);
+		PassParameters->MinMaxLod = ProxyDesc.MinMaxLod;
+		PassParameters->LodPixelErrorScale = ProxyDesc.LodPolicy->GetPixelErrorScale();
+		PassParameters->LodHysteresisBand = ProxyDesc.LodPolicy->GetSettings().HysteresisBand;
+		PassParameters->LodBucketRange = LodBucketRange;
+		PassParameters->NumSpecies = ProxyDesc.NumSpecies;
+		// The cards of the far field are already as sparse as they can be
+		PassParameters->DensityFalloff = ProxyDesc.bIsFarField ?
+			FGrassDensityFalloff().GetShaderParameter() : ProxyDesc.LodPolicy->GetSettings().DensityFalloff.GetShaderParameter();
+		PassParameters->DensityScale = ProxyDesc.DensityScale;
+		PassParameters->FarFieldFade = ProxyDesc.FarFieldFade;
+		PassParameters->bIsFarField = ProxyDesc.bIsFarField;
+		PassParameters->InstanceBoundsMin = ProxyDesc.InstanceBounds.Min;
+		PassParameters->InstanceBoundsSize = ProxyDesc.InstanceBounds.GetSize();
+		PassParameters->GrassDataSize = ProxyDesc.GrassDataNum;
 		
-		PassParameters->GrassDataBuffer = InOutputResources.GrassDataBufferSRV;
-		PassParameters->RWCulledGrassDataBuffer = InVolatileResources.CulledGrassDataBufferUAV;
-		PassParameters->RWIndirectArgsBuffer = InOutputResources.IndirectArgsBufferUAV;
+		PassParameters->GrassDataBuffer = ProxyDesc.GrassDataBufferSRV;
+		if (bFusedInstanceData)
+		{
+			PassParameters->RWInstanceBuffer = InVolatileResources.InstanceBufferUAV;
+		}
+		else
+		{
+			PassParameters->RWCulledGrassDataBuffer = InVolatileResources.CulledGrassDataBufferUAV;
+			PassParameters->RWCulledLodBuffer = InVolatileResources.CulledLodBufferUAV;
+			PassParameters->RWDispatchArgsBuffer = InVolatileResources.DispatchArgsBufferUAV;
+		}
+		PassParameters->RWIndirectArgsBuffer = InVolatileResources.IndirectArgsBufferUAV;
+		PassParameters->BendStates = InBendStates;
+		PassParameters->BendStateOffset = ProxyDesc.BendStateOffset;
 		
-		const int32 GrassDataNum = ProxyDesc.GrassData->Num();
-		const FIntVector GroupCount = FIntVector(FMath::CeilToInt(GrassDataNum / static_cast<float>(MAX_THREADS_PER_GROUP)), 1, 1);
+		const FIntVector GroupCount = FIntVector(static_cast<int32>(FMath::DivideAndRoundUp(ProxyDesc.GrassDataNum, ThreadGroupSize)), 1, 1);
 		FComputeShaderUtils::AddPass<GrassUtils::FCullInstances_CS>(
 			GraphBuilder,
 			RDG_EVENT_NAME("CullGrassData"),
+			GetCullingPassFlags(),
 			ComputeShader, PassParameters, GroupCount);
 	}
 
+	/** Compute the first instance of each slot of the culled blades, once for all the groups of the instance pass. */
+	void AddPass_ComputeSlotOffsets(
+		FRDGBuilder& GraphBuilder,
+		const FGlobalShaderMap* InGlobalShaderMap,
+		const FVolatileResources& InVolatileResources,
+		const bool bDistanceBins)
+	{
+		GrassUtils::FComputeSlotOffsets_CS::FParameters* PassParameters =
+			GraphBuilder.AllocParameters<GrassUtils::FComputeSlotOffsets_CS::FParameters>();
+		GrassUtils::FComputeSlotOffsets_CS::FPermutationDomain PermutationVector;
+		PermutationVector.Set<GrassUtils::FDistanceBinsDim>(bDistanceBins);
+		const TShaderMapRef<GrassUtils::FComputeSlotOffsets_CS> ComputeShader(InGlobalShaderMap, PermutationVector);
+
+		PassParameters->RWIndirectArgsBuffer = InVolatileResources.IndirectArgsBufferUAV;
+
+		FComputeShaderUtils::AddPass(
+			GraphBuilder,
+			RDG_EVENT_NAME("ComputeSlotOffsets"),
+			GetCullingPassFlags(),
+			ComputeShader, PassParameters,
+			FIntVector(1, 1, 1));
+	}
+
 	/** Cull quads and write to the final output buffer. */
 	void AddPass_ComputeInstanceData(
 		FRDGBuilder& GraphBuilder,
 		const FGlobalShaderMap* InGlobalShaderMap,
 		const FVolatileResources& InVolatileResources,
-		const FPersistentBuffers& InOutputResources,
-		const FProxyDesc& ProxyDesc,
-		const FMainViewDesc& InViewDesc)
+		const FBox3f& InstanceBounds,
+		const FGrassWindParameters& InWindParameters,
+		const FGrassForceMapParameters& InForceMapParameters,
+		const bool bDistanceBins,
+		const uint32 ThreadGroupSize)
 	{
 		GrassUtils::FComputeInstanceData_CS::FParameters* PassParameters =
 			GraphBuilder.AllocParameters<GrassUtils::FComputeInstanceData_CS::FParameters>();
-		const GrassUtils::FComputeInstanceData_CS::FPermutationDomain PermutationVector;
+		GrassUtils::FComputeInstanceData_CS::FPermutationDomain PermutationVector;
+		PermutationVector.Set<GrassUtils::FThreadGroupSizeDim>(ThreadGroupSize);
+		PermutationVector.Set<GrassUtils::FDistanceBinsDim>(bDistanceBins);
+		PermutationVector.Set<GrassUtils::FCompactInstancesDim>(UseCompactInstances());
 		const TShaderMapRef<GrassUtils::FComputeInstanceData_CS> ComputeShader(InGlobalShaderMap, PermutationVector);
 
-		PassParameters->RWIndirectArgsBuffer = InOutputResources.IndirectArgsBufferUAV;
+		PassParameters->Wind = InWindParameters;
+		PassParameters->ForceMap = InForceMapParameters;
+		PassParameters->InstanceBoundsMin = InstanceBounds.Min;
+		PassParameters->InstanceBoundsSize = InstanceBounds.GetSize();
+
+		PassParameters->RWIndirectArgsBuffer = InVolatileResources.IndirectArgsBufferUAV;
 		PassParameters->CulledGrassDataBuffer = InVolatileResources.CulledGrassDataBufferSRV;
-		PassParameters->RWInstanceBuffer = InOutputResources.InstanceBufferUAV;
+		PassParameters->CulledLodBuffer = InVolatileResources.CulledLodBufferSRV;
+		PassParameters->RWInstanceBuffer = InVolatileResources.InstanceBufferUAV;
+		PassParameters->DispatchArgsBuffer = InVolatileResources.DispatchArgsBuffer;
 		
-		const int32 GrassDataNum = ProxyDesc.GrassData->Num();
-		const FIntVector GroupCount = FIntVector(FMath::CeilToInt(GrassDataNum / static_cast<float>(MAX_THREADS_PER_GROUP)), 1, 1);
-		FComputeShaderUtils::AddPass<GrassUtils::FComputeInstanceData_CS>(
+		// One thread per visible blade, the group count has been written by the cull passes
+		FComputeShaderUtils::AddPass(
 			GraphBuilder,
 			RDG_EVENT_NAME("ComputeInstanceData"),
-			ComputeShader, PassParameters, GroupCount);
+			GetCullingPassFlags(),
+			ComputeShader, PassParameters,
+			InVolatileResources.DispatchArgsBuffer, 0);
 	}
-}
 
-FGrassInstancingSectionProxy::FGrassInstancingSectionProxy(const ERHIFeatureLevel::Type FeatureLevel)
-	: VertexFactory(FeatureLevel)
-{
+	/** Write the GPU time into a timestamp query once the passes added before it are done. */
+	void AddPass_Timestamp(FRDGBuilder& GraphBuilder, FRHIRenderQuery* InQuery)
+	{
+		// Queries are ended on the graphics pipe, ordered with the passes only when they run on it too
+		GraphBuilder.AddPass(
+			RDG_EVENT_NAME("GrassTimestamp"),
+			ERDGPassFlags::None | ERDGPassFlags::NeverCull,
+			[InQuery](FRHICommandList& RHICmdList)
+			{
+				RHICmdList.EndRenderQuery(InQuery);
+			});
+	}
 }
 
 // Begin FGrassInstancingSceneProxy implementations
@@ -206,25 +770,102 @@ FGrassInstancingSceneProxy::FGrassInstancingSceneProxy(UGrassFieldComponent* InC
 	
 	const uint16 NumSections = InComponent->GetMeshSections().Num();
 	MinMaxLodSteps = InComponent->GetLodStepsRange();
+	MinMaxLodSteps.Y = FMath::Clamp<uint32>(MinMaxLodSteps.Y, MinMaxLodSteps.X, MinMaxLodSteps.X + MAX_LOD_BUCKETS - 1);
 	CutoffDistance = InComponent->GetCutoffDistance();
 	bIsCPUCullingEnabled = InComponent->IsCPUCullingEnabled();
+	FarField = InComponent->GetFarField();
+
+	GrassUtils::FGrassLodPolicy::FSettings LodSettings;
+	LodSettings.MinMaxLod = MinMaxLodSteps;
+	LodSettings.BladeHeightRange = InComponent->GetHeightRange();
+	NumSpecies = InComponent->GetNumSpecies();
+	LodSettings.CutoffDistance = CutoffDistance;
+	LodSettings.MaxPixelError = InComponent->GetLodMaxPixelError();
+	LodSettings.HysteresisBand = InComponent->GetLodHysteresis();
+	LodSettings.DensityFalloff = InComponent->GetDensityFalloff();
+	LodPolicy = GrassUtils::FGrassLodPolicy(LodSettings);
 	
 	Sections.AddZeroed(NumSections);
 	for (uint16 SectionIdx = 0; SectionIdx < NumSections; SectionIdx++)
 	{
 		UGrassMeshSection* SrcSection = InComponent->GetMeshSections()[SectionIdx];
 		{
-			FGrassInstancingSectionProxy* NewSection = new FGrassInstancingSectionProxy(GetScene().GetFeatureLevel());
+			FGrassInstancingSectionProxy* NewSection = new FGrassInstancingSectionProxy();
 			NewSection->GrassData = SrcSection->GetGrassData();
+			NewSection->GrassDataNum = NewSection->GrassData.Num();
 			NewSection->Bounds = SrcSection->GetBounds();
 			NewSection->CutoffDistance = CutoffDistance;
+			NewSection->BladeCutoffDistance = CutoffDistance;
+			NewSection->FarFieldFadeDistance = FarField.IsEnabled() ? FarField.FadeDistance : 0.0f;
 			NewSection->bIsGPUCullingEnabled = InComponent->IsGPUCullingEnabled();
+			NewSection->LodPolicy = &LodPolicy;
+			NewSection->NumSpecies = NumSpecies;
+			NewSection->Revision = static_cast<uint32>(GrassSectionRevisionCounter.Increment());
+			NewSection->Scene = &GetScene();
 			
 			// Save ref to new section
 			Sections[SectionIdx] = NewSection;
 		}
 	}
 
+	// The compact instances quantize their origin in the box of all the blades, whichever sections share the buffers
+	InstanceBounds = FBox3f(ForceInit);
+	for (const FGrassInstancingSectionProxy* Section : Sections)
+	{
+		for (const GrassUtils::FPackedGrassData& Data : Section->GrassData)
+		{
+			InstanceBounds += Data.Position;
+		}
+	}
+	if (!InstanceBounds.IsValid)
+	{
+		InstanceBounds = FBox3f(FVector3f::ZeroVector, FVector3f::ZeroVector);
+	}
+	for (FGrassInstancingSectionProxy* Section : Sections)
+	{
+		Section->InstanceBounds = InstanceBounds;
+	}
+
+	// One card section per blade section, so that they share the occlusion queries
+	if (FarField.IsEnabled())
+	{
+		uint32 NumBlades = 0;
+		double WidthSum = 0.0;
+		TotalFarFieldCardNum = 0;
+		FarFieldSections.Reserve(Sections.Num());
+		for (const FGrassInstancingSectionProxy* Section : Sections)
+		{
+			FGrassInstancingSectionProxy* CardSection = new FGrassInstancingSectionProxy();
+			TArray<GrassUtils::FPackedGrassData> Cards;
+			GrassUtils::BuildFarFieldCards(Section->GrassData, FarField.CellSize, Cards);
+			CardSection->GrassData.Append(Cards);
+			CardSection->GrassDataNum = CardSection->GrassData.Num();
+			CardSection->Bounds = Section->Bounds;
+			CardSection->InstanceBounds = InstanceBounds;
+			CardSection->CutoffDistance = CutoffDistance * FarField.DistanceScale;
+			CardSection->BladeCutoffDistance = CutoffDistance;
+			CardSection->FarFieldFadeDistance = FarField.FadeDistance;
+			CardSection->bIsFarField = true;
+			CardSection->bIsGPUCullingEnabled = Section->bIsGPUCullingEnabled;
+			CardSection->LodPolicy = &LodPolicy;
+			CardSection->NumSpecies = NumSpecies;
+			CardSection->Revision = static_cast<uint32>(GrassSectionRevisionCounter.Increment());
+			CardSection->Scene = &GetScene();
+			FarFieldSections.Add(CardSection);
+
+			TotalFarFieldCardNum += CardSection->GrassDataNum;
+			NumBlades += Section->GrassDataNum;
+			for (GrassUtils::FPackedGrassData Data : Section->GrassData)
+			{
+				WidthSum += GrassUtils::FGrassData(Data).Width;
+			}
+		}
+
+		const float MeanBladeWidth = NumBlades > 0 ? static_cast<float>(WidthSum / NumBlades) : 0.0f;
+		FarFieldCardBladeWidth = GrassUtils::ComputeFarFieldCardBladeWidth(NumBlades, TotalFarFieldCardNum, MeanBladeWidth, FarField);
+	}
+	BuildOcclusionVolumes();
+
 	GrassRendererExtension.RegisterExtension();
 
 	// They have some LOD, but considered static as the LODs (are intended to) represent the same static surface.
@@ -238,6 +879,41 @@ FGrassInstancingSceneProxy::FGrassInstancingSceneProxy(UGrassFieldComponent* InC
 	Material = bValidMaterial ?
 		ComponentMaterial->GetRenderProxy() : UMaterial::GetDefaultMaterial(MD_Surface)->GetRenderProxy();
 	MaterialRelevance = Material->GetMaterialInterface()->GetRelevance_Concurrent(GetScene().GetFeatureLevel());
+
+	for (const FGrassLodMaterial& LodMaterial : InComponent->GetLodMaterials())
+	{
+		if (LodMaterial.Material == nullptr)
+			continue;
+
+		LodMaterials.Emplace(LodMaterial.MaxLodSteps, LodMaterial.Material->GetRenderProxy());
+		MaterialRelevance |= LodMaterial.Material->GetRelevance_Concurrent(GetScene().GetFeatureLevel());
+	}
+	LodMaterials.StableSort([](const TPair<uint32, FMaterialRenderProxy*>& A, const TPair<uint32, FMaterialRenderProxy*>& B)
+	{
+		return A.Key < B.Key;
+	});
+
+	for (uint32 Species = 0; Species < NumSpecies; Species++)
+	{
+		const UMaterialInterface* SpeciesMaterial = InComponent->GetSpeciesMaterial(Species);
+		SpeciesMaterials.Add(SpeciesMaterial != nullptr ? SpeciesMaterial->GetRenderProxy() : nullptr);
+		if (SpeciesMaterial != nullptr)
+		{
+			MaterialRelevance |= SpeciesMaterial->GetRelevance_Concurrent(GetScene().GetFeatureLevel());
+		}
+	}
+}
+
+FMaterialRenderProxy* FGrassInstancingSceneProxy::GetLodMaterial(const uint32 LodSteps, const uint32 Species) const
+{
+	for (const TPair<uint32, FMaterialRenderProxy*>& LodMaterial : LodMaterials)
+	{
+		if (LodSteps <= LodMaterial.Key)
+			return LodMaterial.Value;
+	}
+	if (SpeciesMaterials.IsValidIndex(Species) && SpeciesMaterials[Species] != nullptr)
+		return SpeciesMaterials[Species];
+	return Material;
 }
 
 
@@ -257,10 +933,7 @@ void FGrassInstancingSceneProxy::OnTransformChanged()
 	// TODO
 	// UVToLocal = UVToWorld * GetLocalToWorld().Inverse();
 
-	// Setup a default occlusion volume array containing just the primitive bounds.
-	// We use this if disabling the full set of occlusion volumes.
-	// DefaultOcclusionVolumes.Reset();
-	// DefaultOcclusionVolumes.Add(GetBounds());
+	BuildOcclusionVolumes();
 }
 
 void FGrassInstancingSceneProxy::CreateRenderThreadResources()
@@ -269,7 +942,7 @@ void FGrassInstancingSceneProxy::CreateRenderThreadResources()
 	bool bIsDataLoaded = true;
 	for (const auto& Section: Sections)
 	{
-		bIsDataLoaded = bIsDataLoaded && Section->GrassData.Num() > 0;
+		bIsDataLoaded = bIsDataLoaded && Section->GrassDataNum > 0;
 
 		if (!bIsDataLoaded)
 			return;
@@ -277,27 +950,77 @@ void FGrassInstancingSceneProxy::CreateRenderThreadResources()
 	
 	for (uint32 LodIndex = MinMaxLodSteps.X; LodIndex <= MinMaxLodSteps.Y; LodIndex++)
 	{
-		FGrassMeshLodData* Lod = new FGrassMeshLodData(LodIndex);
+		FGrassMeshLodData* Lod = new FGrassMeshLodData(LodIndex, GetScene().GetFeatureLevel());
 		Lod->InitResources();
 		Lods.Add(LodIndex, Lod);
+
+		if (Lod->VertexFactory->UsesVertexStreams())
+		{
+			Lod->VertexFactory->SetData(Lod->VertexBuffer);
+		}
+		GrassUtils::InitOrUpdateResource(Lod->VertexFactory.Get());
 		
 	}
 
+	if (FarFieldSections.Num() > 0)
+	{
+		FarFieldCardMesh = MakeUnique<FGrassMeshLodData>(FarField, FarFieldCardBladeWidth, GetScene().GetFeatureLevel());
+		FarFieldCardMesh->InitResources();
+		FarFieldCardMesh->VertexFactory->SetData(FarFieldCardMesh->VertexBuffer);
+		GrassUtils::InitOrUpdateResource(FarFieldCardMesh->VertexFactory.Get());
+	}
+
+	TotalGrassDataNum = 0;
 	for (const auto& Section: Sections)
 	{
-		FGrassInstancingVertexFactory* VertexFactory = &Section->VertexFactory;
-		VertexFactory->SetData(Lods[MinMaxLodSteps.X]->VertexBuffer);
-		
-		GrassUtils::InitOrUpdateResource(VertexFactory);
+		GrassUtils::InitializeGrassDataBuffer(Section);
+		TotalGrassDataNum += Section->GrassDataNum;
+
+		Section->MinMaxLodSteps = MinMaxLodSteps;
+		for (uint32 LodIndex = MinMaxLodSteps.X; LodIndex <= MinMaxLodSteps.Y; LodIndex++)
+		{
+			Section->LodNumIndices[LodIndex - MinMaxLodSteps.X] = Lods[LodIndex]->NumIndices;
+		}
+	}
+
+	// Cards have a single LOD, always in bucket 0
+	for (FGrassInstancingSectionProxy* CardSection : FarFieldSections)
+	{
+		if (CardSection->GrassDataNum == 0)
+			continue;
+
+		GrassUtils::InitializeGrassDataBuffer(CardSection);
+		CardSection->LodNumIndices[0] = FarFieldCardMesh->NumIndices;
 	}
 }
 
 void FGrassInstancingSceneProxy::DestroyRenderThreadResources()
 {
 	check(IsInRenderingThread());
-	
+
+	for (const auto& Lod : Lods)
+	{
+		delete Lod.Value;
+	}
 	Lods.Empty();
+	FarFieldCardMesh.Reset();
+
+	GrassRendererExtension.RemoveOwner(this);
+	GrassRendererExtension.RemoveOwner(&FarFieldSections);
+	for (FGrassInstancingSectionProxy* Section : Sections)
+	{
+		Section->GrassDataBufferSRV.SafeRelease();
+		Section->GrassDataBuffer.SafeRelease();
+		delete Section;
+	}
 	Sections.Empty();
+	for (FGrassInstancingSectionProxy* CardSection : FarFieldSections)
+	{
+		CardSection->GrassDataBufferSRV.SafeRelease();
+		CardSection->GrassDataBuffer.SafeRelease();
+		delete CardSection;
+	}
+	FarFieldSections.Empty();
 }
 
 FPrimitiveViewRelevance FGrassInstancingSceneProxy::GetViewRelevance(const FSceneView* View) const
@@ -323,15 +1046,15 @@ void FGrassInstancingSceneProxy::CreateBaseMeshBatch(
 	FMeshElementCollector& Collector,
 	const FSceneViewFamily& ViewFamily,
 	const int32 ViewIndex,
-	const FGrassMeshLodData* Lod,
-	FGrassInstancingSectionProxy* Section) const
+	const FSceneView* MainView,
+	const GrassUtils::FPersistentBuffers& Buffers,
+	const uint32 Species,
+	const uint32 LodBucket,
+	const FGrassMeshLodData* Lod) const
 {
-	const FSceneView* MainView = ViewFamily.Views[0];
-	const FSceneView* CullView = ViewFamily.Views[ViewIndex];
+	// Args and instance range the cull passes gathered the blades of the species in the bucket into
+	const uint32 Draw = GrassUtils::GetGrassDrawIndex(Species, LodBucket);
 
-	const GrassUtils::FPersistentBuffers Buffers =
-					GrassRendererExtension.AddWork(Section, MainView, CullView);
-	
 	FMeshBatch& Mesh = Collector.AllocateMesh();
 	Mesh.LODIndex = Lod->Steps;
 	Mesh.VisualizeLODIndex = Lod->Steps;
@@ -340,8 +1063,8 @@ void FGrassInstancingSceneProxy::CreateBaseMeshBatch(
 	FMeshBatchElement& BatchElement = Mesh.Elements[0];
 	
 	Mesh.ReverseCulling = IsLocalToWorldDeterminantNegative();
-	Mesh.VertexFactory = &Section->VertexFactory;
-	Mesh.MaterialRenderProxy = Material;
+	Mesh.VertexFactory = Lod->VertexFactory.Get();
+	Mesh.MaterialRenderProxy = GetLodMaterial(Lod->Steps, Species);
 	Mesh.Type = EPrimitiveType::PT_TriangleList;
 	Mesh.DepthPriorityGroup = ESceneDepthPriorityGroup::SDPG_World;
 	
@@ -349,7 +1072,7 @@ void FGrassInstancingSceneProxy::CreateBaseMeshBatch(
 	Mesh.bUseWireframeSelectionColoring = IsSelected();
 	Mesh.bCanApplyViewModeOverrides = false;
 	Mesh.CastRayTracedShadow = false;
-	Mesh.CastShadow = false;
+	Mesh.CastShadow = CastsDynamicShadow();
 	Mesh.bUseForMaterial = true;
 	Mesh.bUseForDepthPass = true;
 	
@@ -357,8 +1080,8 @@ void FGrassInstancingSceneProxy::CreateBaseMeshBatch(
 	// TODO allow for non indirect instanced rendering
 	BatchElement.PrimitiveIdMode = EPrimitiveIdMode::PrimID_ForceZero;
 	BatchElement.IndexBuffer = Lod->IndexBuffer;
-	BatchElement.IndirectArgsBuffer = Buffers.IndirectArgsBuffer;
-	BatchElement.IndirectArgsOffset = 0;
+	BatchElement.IndirectArgsBuffer = Buffers.IndirectArgsBuffer->GetRHI();
+	BatchElement.IndirectArgsOffset = Draw * GrassUtils::IndirectArgsNumElements * GrassUtils::IndirectArgsPerElementSize;
 	BatchElement.FirstIndex = 0;
 	BatchElement.NumPrimitives = 0;
 	BatchElement.MinVertexIndex = 0;
@@ -368,7 +1091,11 @@ void FGrassInstancingSceneProxy::CreateBaseMeshBatch(
 
 	FGrassInstancingUserData* UserData = &Collector.AllocateOneFrameResource<FGrassInstancingUserData>();
 	UserData->InstanceBufferSRV = Buffers.InstanceBufferSRV;
+	UserData->IndirectArgsBufferSRV = Buffers.IndirectArgsBufferSRV;
+	UserData->InstanceOffsetIndex = GrassUtils::InstanceOffsetsElementOffset + Draw;
 	UserData->NumVertices = Lod->NumVertices;
+	UserData->InstanceBoundsMin = InstanceBounds.Min;
+	UserData->InstanceBoundsSize = InstanceBounds.GetSize();
 
 	// TODO: LWC Precision Loss
 	UserData->LodViewOrigin = static_cast<FVector3f>(MainView->ViewMatrices.GetViewOrigin());
@@ -396,93 +1123,379 @@ void FGrassInstancingSceneProxy::GetDynamicMeshElements(
 {
 	check(IsInRenderingThread());
 
+	// Render thread resources haven't been created, the sections have no data
+	if (Lods.Num() == 0)
+		return;
+
+	const bool bBatchSections = CVarGrassBatchSections.GetValueOnRenderThread() != 0;
+
+	// The shadows take the LODs of the first view of the family, the groups of camera views the ones of their lead view
+	const GrassUtils::FGrassLodView ShadowLodView = GrassUtils::GetLodView(ViewFamily.Views[0]);
+	LodPolicy.PruneHistory(ViewFamily.FrameNumber);
+
+	uint32 CameraViewsMap = 0;
+	for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+	{
+		// Check if our mesh is visible from this view
+		if (!(VisibilityMap & (1 << ViewIndex)))
+			continue;
+
+		// Shadow depth views cull against the light frustum, their work is deferred to the next frame
+		if (const FConvexVolume* ShadowCullFrustum = Views[ViewIndex]->GetDynamicMeshElementsShadowCullFrustum())
+		{
+			GetShadowMeshElements(ViewFamily, ViewIndex, Views[ViewIndex], *ShadowCullFrustum, ShadowLodView, Collector);
+			continue;
+		}
+
+		CameraViewsMap |= 1 << ViewIndex;
+	}
+
+	if (CameraViewsMap == 0)
+		return;
+	
 	if (GrassRendererExtension.IsInFrame())
 	{
 		// Can't add new work while bInFrame.
 		// In UE5 we need to AddWork()/SubmitWork() in two phases: InitViews() and InitViewsAfterPrepass()
 		// The main renderer hooks for that don't exist in UE5.0 and are only added in UE5.1
-		// That means that for UE5.0 we always hit this for shadow drawing and shadows will not be rendered.
 		// Not earlying out here can lead to crashes from buffers being released too soon.
 		return;
 	}
 
-	const FSceneView* MainView = ViewFamily.Views[0];
-	for (FGrassInstancingSectionProxy* Section : Sections)
+	// Views close enough to each other (stereo, similar split screen views) share the culling over the union of their frusta
+	TArray<GrassUtils::FViewGroup, TInlineAllocator<4>> ViewGroups;
+	const float MaxCutoffDistance = FarFieldSections.Num() > 0 ? CutoffDistance * FarField.DistanceScale : CutoffDistance;
+	GrassUtils::GroupViews(Views, CameraViewsMap, MaxCutoffDistance, ViewGroups);
+
+	for (const GrassUtils::FViewGroup& ViewGroup : ViewGroups)
 	{
-		for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+		// The lead view of the group culls the union of the frusta and selects the LODs of all its views
+		const FSceneView* MainView = Views[ViewGroup.ViewIndices[0]];
+		const FSceneView* CullView = MainView;
+		const GrassUtils::FGrassLodView LodView = GrassUtils::GetLodView(MainView);
+		const FConvexVolume& ViewFrustum = ViewGroup.CullVolume;
+		const FVector CullOrigin = LodView.Origin;
+		// The HZB belongs to a single view, it can't occlude the union of the frusta of a group
+		const bool bAllowHZBOcclusion = ViewGroup.ViewIndices.Num() == 1;
+
+		TArray<GrassUtils::FSectionWork, TInlineAllocator<64>> VisibleSections;
+		FUintVector2 LodBucketRange(MAX_LOD_BUCKETS - 1, 0);
+		
+		for (int32 SectionIndex = 0; SectionIndex < Sections.Num(); SectionIndex++)
 		{
-			// Check if our mesh is visible from this view
-			if (VisibilityMap & (1 << ViewIndex))
+			FGrassInstancingSectionProxy* Section = Sections[SectionIndex];
+			if (Section->GrassDataNum == 0)
+				continue;
+
+			if (IsSectionOccluded(SectionIndex, Views, ViewGroup.ViewIndices))
+				continue;
+			
+			// Chunk distance e frustum culling
+			if (this->bIsCPUCullingEnabled)
 			{
-				if (Section->GrassData.Num() <= 0)
+				if (!ViewFrustum.IntersectBox(
+					Section->Bounds.GetCenter(),
+					Section->Bounds.GetExtent()))
 					continue;
 				
-				const FSceneView* View = Views[ViewIndex];
-				FConvexVolume ViewFrustum = View->ViewFrustum;
-				FVector CullOrigin = MainView->ViewMatrices.GetViewOrigin();
-				// Support the freeze-rendering mode. Use any frozen view state for culling.
-				const FViewMatrices* FrozenViewMatrices = MainView->State != nullptr ?
-					MainView->State->GetFrozenViewMatrices() : nullptr;
-				if (FrozenViewMatrices != nullptr)
-				{
-					CullOrigin = FrozenViewMatrices->GetViewOrigin();
-
-					FMatrix ViewMatrix = FrozenViewMatrices->GetViewProjectionMatrix();
-					GetViewFrustumBounds(ViewFrustum, ViewMatrix, true, true);
-				}
-				
-				// Chunk distance e frustum culling
-				if (this->bIsCPUCullingEnabled)
-				{
-					if (!ViewFrustum.IntersectBox(
-						Section->Bounds.GetCenter(),
-						Section->Bounds.GetExtent()))
-						continue;
-					
-					float Distance = FVector::Dist(CullOrigin, Section->Bounds.GetCenter());
-					Distance -= Section->Bounds.GetExtent().Length();
-				
-					if (Distance > CutoffDistance)
-						continue;
-				}
-				
-				const uint32 LodIndex = GrassUtils::ComputeLodIndex(
-					CullOrigin, Section->Bounds,
-					CutoffDistance, MinMaxLodSteps);
-
-				if (!Lods.Contains(LodIndex))
+				float Distance = FVector::Dist(CullOrigin, Section->Bounds.GetCenter());
+				Distance -= Section->Bounds.GetExtent().Length();
+			
+				if (Distance > CutoffDistance)
 					continue;
-				Section->NumIndices = Lods[LodIndex]->NumIndices;
-				Section->VertexFactory.SetData(Lods[LodIndex]->VertexBuffer);
+			}
+			
+			// The LOD is chosen per blade by the cull pass, only the buckets the section can fall into are drawn
+			GrassUtils::FSectionWork SectionWork;
+			SectionWork.Section = Section;
+			SectionWork.LodBucketRange = LodPolicy.SelectBucketRange(
+				Section->Revision, LodView,
+				Section->Bounds, ViewFamily.FrameNumber);
+
+			if (bBatchSections)
+			{
+				VisibleSections.Add(SectionWork);
+				LodBucketRange.X = FMath::Min(LodBucketRange.X, SectionWork.LodBucketRange.X);
+				LodBucketRange.Y = FMath::Max(LodBucketRange.Y, SectionWork.LodBucketRange.Y);
+				continue;
+			}
 
-				CreateBaseMeshBatch(Collector, ViewFamily, ViewIndex, Lods[LodIndex], Section);
-				
+			GrassUtils::CollapseLodBucketRanges(MakeArrayView(&SectionWork, 1), SectionWork.LodBucketRange);
+			const GrassUtils::FPersistentBuffers& Buffers = GrassRendererExtension.AddWork(
+				Section, Section->GrassDataNum,
+				MakeArrayView(&SectionWork, 1),
+				MainView, CullView, ViewFrustum,
+				bAllowHZBOcclusion);
+
+			for (const int32 ViewIndex : ViewGroup.ViewIndices)
+			{
+				CreateLodMeshBatches(Collector, ViewFamily, ViewIndex, MainView, Buffers, SectionWork.LodBucketRange);
+			}
+		}
+
+		// All the visible sections share the instance buffer and the per LOD indirect args
+		if (VisibleSections.Num() > 0)
+		{
+			GrassUtils::CollapseLodBucketRanges(VisibleSections, LodBucketRange);
+			const GrassUtils::FPersistentBuffers& Buffers = GrassRendererExtension.AddWork(
+				this, TotalGrassDataNum,
+				VisibleSections,
+				MainView, CullView, ViewFrustum,
+				bAllowHZBOcclusion);
+
+			for (const int32 ViewIndex : ViewGroup.ViewIndices)
+			{
+				CreateLodMeshBatches(Collector, ViewFamily, ViewIndex, MainView, Buffers, LodBucketRange);
 			}
 		}
+
+		if (FarFieldSections.Num() > 0)
+		{
+			GetFarFieldMeshElements(Views, ViewFamily, ViewGroup.ViewIndices, ViewFrustum, LodView, Collector);
+		}
+	}
+}
+
+void FGrassInstancingSceneProxy::GetFarFieldMeshElements(
+	const TArray<const FSceneView*>& Views,
+	const FSceneViewFamily& ViewFamily,
+	const TConstArrayView<int32> ViewIndices,
+	const FConvexVolume& CullVolume,
+	const GrassUtils::FGrassLodView& LodView,
+	FMeshElementCollector& Collector) const
+{
+	if (!FarFieldCardMesh.IsValid())
+		return;
+
+	const FSceneView* MainView = Views[ViewIndices[0]];
+	const FSceneView* CullView = MainView;
+
+	// The cards only start where the blades fade out
+	TArray<GrassUtils::FSectionWork, TInlineAllocator<64>> VisibleSections;
+	for (int32 SectionIndex = 0; SectionIndex < FarFieldSections.Num(); SectionIndex++)
+	{
+		FGrassInstancingSectionProxy* CardSection = FarFieldSections[SectionIndex];
+		if (CardSection->GrassDataNum == 0)
+			continue;
+
+		if (IsSectionOccluded(SectionIndex, Views, ViewIndices))
+			continue;
+
+		if (this->bIsCPUCullingEnabled)
+		{
+			if (!CullVolume.IntersectBox(CardSection->Bounds.GetCenter(), CardSection->Bounds.GetExtent()))
+				continue;
+
+			const float Distance = FVector::Dist(LodView.Origin, CardSection->Bounds.GetCenter());
+			const float Radius = CardSection->Bounds.GetExtent().Length();
+			if (Distance - Radius > CardSection->CutoffDistance
+				|| Distance + Radius < CardSection->BladeCutoffDistance - CardSection->FarFieldFadeDistance)
+				continue;
+		}
+
+		GrassUtils::FSectionWork SectionWork;
+		SectionWork.Section = CardSection;
+		SectionWork.LodBucketRange = FUintVector2(0, 0);
+		VisibleSections.Add(SectionWork);
+	}
+
+	if (VisibleSections.Num() == 0)
+		return;
+
+	// All the cards of the proxy share one set of buffers, owned by the card sections
+	const GrassUtils::FPersistentBuffers& Buffers = GrassRendererExtension.AddWork(
+		&FarFieldSections, TotalFarFieldCardNum,
+		VisibleSections,
+		MainView, CullView, CullVolume,
+		ViewIndices.Num() == 1);
+
+	// The cards of each species are culled into their own draw, with the material of their blades
+	for (const int32 ViewIndex : ViewIndices)
+	{
+		for (uint32 Species = 0; Species < NumSpecies; Species++)
+		{
+			CreateBaseMeshBatch(Collector, ViewFamily, ViewIndex, MainView, Buffers, Species, 0, FarFieldCardMesh.Get());
+		}
+	}
+}
+
+void FGrassInstancingSceneProxy::GetShadowMeshElements(
+	const FSceneViewFamily& ViewFamily,
+	const int32 ViewIndex,
+	const FSceneView* View,
+	const FConvexVolume& ShadowCullFrustum,
+	const GrassUtils::FGrassLodView& LodView,
+	FMeshElementCollector& Collector) const
+{
+	if (!CastsDynamicShadow())
+		return;
+
+	const FSceneView* MainView = ViewFamily.Views[0];
+	// The shadow cull frustum is in the translated space of the shadow
+	const FVector PreShadowTranslation = View->GetPreShadowTranslation();
+	const bool bForceLowestLod = CVarGrassShadowForceLowestLod.GetValueOnRenderThread() != 0;
+
+	TArray<GrassUtils::FSectionWork, TInlineAllocator<64>> ShadowSections;
+	FUintVector2 LodBucketRange(MAX_LOD_BUCKETS - 1, 0);
+
+	for (FGrassInstancingSectionProxy* Section : Sections)
+	{
+		if (Section->GrassDataNum == 0)
+			continue;
+
+		if (this->bIsCPUCullingEnabled)
+		{
+			if (!ShadowCullFrustum.IntersectBox(
+				Section->Bounds.GetCenter() + PreShadowTranslation,
+				Section->Bounds.GetExtent()))
+				continue;
+
+			// Blades past the cutoff distance of the camera aren't drawn, they don't cast shadows either
+			float Distance = FVector::Dist(LodView.Origin, Section->Bounds.GetCenter());
+			Distance -= Section->Bounds.GetExtent().Length();
+
+			if (Distance > CutoffDistance)
+				continue;
+		}
+
+		GrassUtils::FSectionWork SectionWork;
+		SectionWork.Section = Section;
+		SectionWork.LodBucketRange = bForceLowestLod ? FUintVector2(0, 0) :
+			LodPolicy.SelectBucketRange(
+				Section->Revision, LodView,
+				Section->Bounds, ViewFamily.FrameNumber);
+
+		ShadowSections.Add(SectionWork);
+		LodBucketRange.X = FMath::Min(LodBucketRange.X, SectionWork.LodBucketRange.X);
+		LodBucketRange.Y = FMath::Max(LodBucketRange.Y, SectionWork.LodBucketRange.Y);
+	}
+
+	if (ShadowSections.Num() == 0)
+		return;
+
+	GrassUtils::CollapseLodBucketRanges(ShadowSections, LodBucketRange);
+
+	GrassUtils::FMainViewDesc MainViewDesc;
+	GrassUtils::GetMainViewDesc(MainView, MainViewDesc);
+
+	GrassUtils::FChildViewDesc ShadowViewDesc;
+	ShadowViewDesc.IsValid = true;
+	ShadowViewDesc.ViewDebug = nullptr;
+	ShadowViewDesc.bIsMainView = false;
+	ShadowViewDesc.bIsShadowView = true;
+	ShadowViewDesc.DensityStride = FMath::Max(CVarGrassShadowDensityStride.GetValueOnRenderThread(), 1);
+	GrassUtils::GetCullPlanes(ShadowCullFrustum, PreShadowTranslation, ShadowViewDesc);
+
+	GrassUtils::FShadowViewIdentity Identity;
+	Identity.bPerspective = View->ViewMatrices.IsPerspectiveProjection();
+	Identity.Origin = -PreShadowTranslation;
+	Identity.Direction = FVector3f(View->GetViewDirection());
+	Identity.ProjectionScale = static_cast<float>(View->ViewMatrices.GetProjectionMatrix().M[0][0]);
+
+	// Shadows are always batched, the sections of the proxy share one set of buffers per shadow
+	FUintVector2 CulledLodBucketRange;
+	const GrassUtils::FPersistentBuffers* Buffers = GrassRendererExtension.AddShadowWork(
+		this, TotalGrassDataNum,
+		ShadowSections, LodBucketRange,
+		MainViewDesc, ShadowViewDesc, Identity,
+		CulledLodBucketRange);
+
+	if (Buffers != nullptr)
+	{
+		CreateLodMeshBatches(Collector, ViewFamily, ViewIndex, MainView, *Buffers, CulledLodBucketRange);
+	}
+}
+
+void FGrassInstancingSceneProxy::CreateLodMeshBatches(
+	FMeshElementCollector& Collector,
+	const FSceneViewFamily& ViewFamily,
+	const int32 ViewIndex,
+	const FSceneView* MainView,
+	const GrassUtils::FPersistentBuffers& Buffers,
+	const FUintVector2 LodBucketRange) const
+{
+	for (uint32 Species = 0; Species < NumSpecies; Species++)
+	{
+		for (uint32 LodBucket = LodBucketRange.X; LodBucket <= LodBucketRange.Y; LodBucket++)
+		{
+			const uint32 LodIndex = MinMaxLodSteps.X + LodBucket;
+			if (!Lods.Contains(LodIndex))
+				continue;
+
+			CreateBaseMeshBatch(Collector, ViewFamily, ViewIndex, MainView, Buffers, Species, LodBucket, Lods[LodIndex]);
+		}
 	}
 }
 
-// bool FGrassInstancingSceneProxy::HasSubprimitiveOcclusionQueries() const
-// {
-// 	return false;
-// }
+bool FGrassInstancingSceneProxy::HasSubprimitiveOcclusionQueries() const
+{
+	return CVarGrassOcclusionQueries.GetValueOnAnyThread() != 0 && OcclusionVolumes.Num() > 0;
+}
+
+const TArray<FBoxSphereBounds>* FGrassInstancingSceneProxy::GetOcclusionQueries(const FSceneView* View) const
+{
+	return &OcclusionVolumes;
+}
 
-// const TArray<FBoxSphereBounds>* FGrassInstancingSceneProxy::GetOcclusionQueries(const FSceneView* View) const
-// {
-// 	// return &DefaultOcclusionVolumes;
-// }
+void FGrassInstancingSceneProxy::BuildOcclusionVolumes()
+{
+	// Blades grow up from the surface the section bounds have been built around
+	const FVector BladeExtent(0.0f, 0.0f, LodPolicy.GetSettings().BladeHeightRange.Y);
+
+	OcclusionVolumes.Reset(Sections.Num());
+	for (const FGrassInstancingSectionProxy* Section : Sections)
+	{
+		FBox Bounds = Section->Bounds;
+		Bounds.Max += BladeExtent;
+		OcclusionVolumes.Add(FBoxSphereBounds(Bounds));
+	}
+}
+
+void FGrassInstancingSceneProxy::AcceptOcclusionResults(FSceneView const* View, TArray<bool>* Results, const int32 ResultsStart, const int32 NumResults)
+{
+	check(IsInRenderingThread());
+
+	// The queries are matched to the sections by index
+	if (View->State == nullptr || NumResults != OcclusionVolumes.Num())
+		return;
+
+	const uint32 FrameNumber = View->Family->FrameNumber;
+	for (auto It = SectionOcclusions.CreateIterator(); It; ++It)
+	{
+		if (FrameNumber - It.Value().FrameNumber > 60u)
+			It.RemoveCurrent();
+	}
+
+	FSectionOcclusion& Occlusion = SectionOcclusions.FindOrAdd(View->State->GetViewKey());
+	Occlusion.FrameNumber = FrameNumber;
+	Occlusion.Occluded.Init(false, NumResults);
+	for (int32 Index = 0; Index < NumResults; Index++)
+	{
+		Occlusion.Occluded[Index] = (*Results)[ResultsStart + Index];
+	}
+}
 
-// void FGrassInstancingSceneProxy::BuildOcclusionVolumes(TArrayView<FVector2D> const& InMinMaxData, FIntPoint const& InMinMaxSize, TArrayView<int32> const& InMinMaxMips, int32 InNumLods)
-// {
-// 	// TODO
-// }
+bool FGrassInstancingSceneProxy::IsSectionOccluded(
+	const int32 SectionIndex,
+	const TArray<const FSceneView*>& Views,
+	const TConstArrayView<int32> ViewIndices) const
+{
+	if (CVarGrassOcclusionQueries.GetValueOnRenderThread() == 0)
+		return false;
 
-// void FGrassInstancingSceneProxy::AcceptOcclusionResults(FSceneView const* View, TArray<bool>* Results, int32 ResultsStart, int32 NumResults)
-// {
-// 	check(IsInRenderingThread());
+	// Views sharing the culling only skip the sections none of them can see
+	for (const int32 ViewIndex : ViewIndices)
+	{
+		const FSceneView* View = Views[ViewIndex];
+		const FSectionOcclusion* Occlusion = View->State != nullptr ?
+			SectionOcclusions.Find(View->State->GetViewKey()) : nullptr;
 
-// 	// TODO
-// }
+		if (Occlusion == nullptr || Occlusion->FrameNumber != View->Family->FrameNumber
+			|| !Occlusion->Occluded.IsValidIndex(SectionIndex) || !Occlusion->Occluded[SectionIndex])
+			return false;
+	}
+	return true;
+}
 // End FGrassInstancingSceneProxy implementations
 
 
@@ -493,6 +1506,8 @@ void FGrassInstancingRendererExtension::RegisterExtension()
 	{
 		GEngine->GetPreRenderDelegateEx().AddRaw(this, &FGrassInstancingRendererExtension::BeginFrame);
 		GEngine->GetPostRenderDelegateEx().AddRaw(this, &FGrassInstancingRendererExtension::EndFrame);
+
+		GrassUtils::RegisterOcclusionViewExtension();
 		bInit = true;
 	}
 }
@@ -500,12 +1515,33 @@ void FGrassInstancingRendererExtension::RegisterExtension()
 void FGrassInstancingRendererExtension::ReleaseRHI()
 {
 	Buffers.Empty();
+	DiscardIds.Empty();
+	CachedCullings.Empty();
+	OcclusionHZBs.Empty();
+	InstanceBudgets.Empty();
+	GovernorTimestamps.Empty();
+	WindGustTexture.SafeRelease();
+	WindParameters = GrassUtils::FGrassWindParameters();
+	SceneForces.Empty();
+	BendStatePool.Reset(0);
+	BendStateBuffer.SafeRelease();
+	NoBendStateBuffer.SafeRelease();
+	BendStateSeenIds.Empty();
+	Benchmark.Reset();
+	ShadowBuffers.Empty();
+	PendingShadowWorks.Empty();
+	ShadowTracks.Empty();
+	FrameShadowTracks.Empty();
 }
 
 GrassUtils::FPersistentBuffers &FGrassInstancingRendererExtension::AddWork(
-	FGrassInstancingSectionProxy* InSection,
+	const void* InOwner,
+	const uint32 InCapacity,
+	const TConstArrayView<GrassUtils::FSectionWork> InSections,
 	const FSceneView* InMainView, 
-	const FSceneView* InCullView)
+	const FSceneView* InCullView,
+	const FConvexVolume& InCullVolume,
+	const bool bInAllowHZBOcclusion)
 {
 	// If we hit this then BeginFrame()/EndFrame() logic needs fixing in the Scene Renderer.
 	if (!ensure(!bInFrame))
@@ -513,43 +1549,100 @@ GrassUtils::FPersistentBuffers &FGrassInstancingRendererExtension::AddWork(
 		EndFrame();
 	}
 
+	// The passes take the LOD meshes and bounds of the work item from its first section
+	check(InSections.Num() > 0);
+
 	// Create workload
 	FWorkDesc WorkDesc;
-	WorkDesc.ProxyIndex = SceneProxies.AddUnique(InSection);
+	WorkDesc.OwnerIndex = Owners.AddUnique(InOwner);
 	WorkDesc.MainViewIndex = MainViews.AddUnique(InMainView);
 	WorkDesc.CullViewIndex = CullViews.AddUnique(InCullView);
 	WorkDesc.BufferIndex = -1;
+	if (WorkDesc.CullViewIndex == CullVolumes.Num())
+	{
+		CullVolumes.Add(InCullVolume);
+	}
 
 	// Check for an existing duplicate
 	for (const FWorkDesc &It : WorkDescs)
 	{
-		if (   It.ProxyIndex == WorkDesc.ProxyIndex 
+		if (   It.OwnerIndex == WorkDesc.OwnerIndex 
 			&& It.MainViewIndex == WorkDesc.MainViewIndex 
 			&& It.CullViewIndex == WorkDesc.CullViewIndex 
 			&& It.BufferIndex != -1)
 		{
-			WorkDesc.BufferIndex = It.BufferIndex;
-			break;
+			return Buffers[It.BufferIndex];
 		}
 	}
 
-
-	// Try to recycle a buffer
-	if (WorkDesc.BufferIndex == -1)
+	// The budget thins the sections out, the culling cache has to tell the grants apart
+	TArray<GrassUtils::FSectionWork, TInlineAllocator<64>> Sections(InSections.GetData(), InSections.Num());
+	ApplyInstanceBudget(InMainView, Sections);
+	if (Governor.IsEnabled())
 	{
-		for (int32 BufferIndex = 0; BufferIndex < Buffers.Num(); BufferIndex++)
+		for (GrassUtils::FSectionWork& SectionWork : Sections)
 		{
-			if (SceneProxies[WorkDesc.ProxyIndex] != Buffers[BufferIndex].SectionProxy)
-				continue;
-			
-			if (DiscardIds[BufferIndex] < DiscardId)
+			if (!SectionWork.Section->bIsFarField)
 			{
-				DiscardIds[BufferIndex] = DiscardId;
-	
-				WorkDesc.BufferIndex = BufferIndex;
-				WorkDescs.Add(WorkDesc);
-				break;
+				SectionWork.DensityScale *= Governor.GetState().DensityScale;
 			}
+			SectionWork.CutoffScale = Governor.GetState().CutoffScale;
+		}
+	}
+
+	// Culling the buffers are about to hold
+	FCachedCulling Culling;
+	Culling.SectionsKey = GrassUtils::GetSectionsCacheKey(Sections);
+	Culling.ViewKey = GrassUtils::GetViewCacheKey(InMainView, InCullVolume, CVarGrassCacheCullingTolerance.GetValueOnRenderThread());
+	Culling.CullVolume = InCullVolume;
+	Culling.Origin = GrassUtils::GetLodView(InMainView).Origin;
+
+	const int32 AmortizedRecullFrames = CVarGrassAmortizedRecullFrames.GetValueOnRenderThread();
+	if (AmortizedRecullFrames > 0)
+	{
+		Culling.Margin = FMath::Max(CVarGrassAmortizedRecullMargin.GetValueOnRenderThread(), 0.0f);
+	}
+
+	// The occluders can move while the views don't, an occlusion culled buffer is never reused
+	WorkDesc.bHZBOcclusion = bInAllowHZBOcclusion && FindOcclusionHZB(InCullView) != nullptr;
+	if (WorkDesc.bHZBOcclusion)
+	{
+		Culling.SectionsKey = 0;
+	}
+
+	// Reuse a buffer that already holds the culling, the animated ones are culled again by InvalidateAnimatedCullings()
+	if (CVarGrassCacheCulling.GetValueOnRenderThread() != 0 && !WorkDesc.bHZBOcclusion)
+	{
+		double CutoffDistance = 0.0;
+		for (const GrassUtils::FSectionWork& SectionWork : Sections)
+		{
+			CutoffDistance = FMath::Max(CutoffDistance, SectionWork.Section->CutoffDistance * SectionWork.CutoffScale);
+		}
+		const int32 BufferIndex = FindCachedBuffer(InOwner, InCapacity, Culling, CutoffDistance);
+
+		// Amortized cullings are refreshed once every AmortizedRecullFrames, at a different frame for every owner
+		const bool bRefresh = AmortizedRecullFrames > 0 && BufferIndex != INDEX_NONE
+			&& CachedCullings[BufferIndex].ViewKey != Culling.ViewKey
+			&& (DiscardId + PointerHash(InOwner)) % AmortizedRecullFrames == 0;
+
+		if (BufferIndex != INDEX_NONE && !bRefresh)
+		{
+			DiscardIds[BufferIndex] = DiscardId;
+			WorkDesc.BufferIndex = BufferIndex;
+			WorkDesc.bCached = true;
+		}
+	}
+
+	// Try to recycle a buffer
+	for (int32 BufferIndex = 0; BufferIndex < Buffers.Num() && WorkDesc.BufferIndex == -1; BufferIndex++)
+	{
+		if (InOwner != Buffers[BufferIndex].Owner || InCapacity > Buffers[BufferIndex].Capacity)
+			continue;
+		
+		if (DiscardIds[BufferIndex] < DiscardId)
+		{
+			DiscardIds[BufferIndex] = DiscardId;
+			WorkDesc.BufferIndex = BufferIndex;
 		}
 	}
 
@@ -557,15 +1650,183 @@ GrassUtils::FPersistentBuffers &FGrassInstancingRendererExtension::AddWork(
 	if (WorkDesc.BufferIndex == -1)
 	{
 		DiscardIds.Add(DiscardId);
+		CachedCullings.AddDefaulted();
 		WorkDesc.BufferIndex = Buffers.AddDefaulted();
-		WorkDescs.Add(WorkDesc);
 		
- 		GrassUtils::InitializeInstanceBuffers(InSection, Buffers[WorkDesc.BufferIndex]);
+ 		GrassUtils::InitializeInstanceBuffers(InOwner, InCapacity, Buffers[WorkDesc.BufferIndex]);
 	}
 
+	WorkDesc.CullMargin = Culling.Margin;
+	if (!WorkDesc.bCached)
+	{
+		CachedCullings[WorkDesc.BufferIndex] = Culling;
+	}
+
+	WorkDesc.FirstSection = SectionWorks.Num();
+	WorkDesc.NumSections = Sections.Num();
+	SectionWorks.Append(Sections);
+	WorkDescs.Add(WorkDesc);
+
 	return Buffers[WorkDesc.BufferIndex];
 }
 
+int32 FGrassInstancingRendererExtension::FindCachedBuffer(
+	const void* InOwner,
+	const uint32 InCapacity,
+	const FCachedCulling& InCulling,
+	const double InCutoffDistance) const
+{
+	for (int32 BufferIndex = 0; BufferIndex < Buffers.Num(); BufferIndex++)
+	{
+		const FCachedCulling& Cached = CachedCullings[BufferIndex];
+		if (InOwner != Buffers[BufferIndex].Owner || InCapacity > Buffers[BufferIndex].Capacity
+			|| DiscardIds[BufferIndex] >= DiscardId || Cached.SectionsKey == 0 || Cached.SectionsKey != InCulling.SectionsKey)
+			continue;
+
+		if (Cached.ViewKey == InCulling.ViewKey)
+			return BufferIndex;
+
+		// An amortized culling is valid as long as every blade the new culling would keep is in the pushed out volume
+		if (Cached.Margin <= 0.0f || InCulling.Margin <= 0.0f
+			|| Cached.CullVolume.Planes.Num() != InCulling.CullVolume.Planes.Num())
+			continue;
+
+		// Blades within the cutoff distance of the new origin are within the pushed out cutoff distance of the cached one
+		const double Slack = Cached.Margin - FVector::Dist(Cached.Origin, InCulling.Origin);
+		if (Slack < 0.0)
+			continue;
+
+		// Bound of the distance a plane moves by over the cutoff sphere of the new origin
+		bool bIsWithinMargin = true;
+		for (int32 PlaneIndex = 0; PlaneIndex < InCulling.CullVolume.Planes.Num() && bIsWithinMargin; PlaneIndex++)
+		{
+			const FPlane& CachedPlane = Cached.CullVolume.Planes[PlaneIndex];
+			const FPlane& Plane = InCulling.CullVolume.Planes[PlaneIndex];
+			const FVector NormalDelta = Plane.GetNormal() - CachedPlane.GetNormal();
+			const double Shift = NormalDelta.Size() * InCutoffDistance
+				+ FMath::Abs(FVector::DotProduct(NormalDelta, InCulling.Origin) - (Plane.W - CachedPlane.W));
+			bIsWithinMargin = Shift <= Cached.Margin;
+		}
+
+		if (bIsWithinMargin)
+			return BufferIndex;
+	}
+
+	return INDEX_NONE;
+}
+
+void FGrassInstancingRendererExtension::InvalidateAnimatedCullings()
+{
+	// The wind sways every blade, the force map of a scene and the bend states only the ones they cover
+	const bool bWind = WindParameters.WindDirectionStrength.Z > 0.0f;
+	TMap<const FSceneInterface*, FBox> ForceMapBoxes;
+	for (const TPair<const FSceneInterface*, FSceneForces>& Pair : SceneForces)
+	{
+		const FForceMapState& ForceMap = Pair.Value.ForceMap;
+		if (ForceMap.Texture.IsValid())
+		{
+			const double TexelSize = ForceMap.Settings.GetTexelSize();
+			const FVector2D Corner = FVector2D(ForceMap.OriginTexel) * TexelSize;
+			const FVector2D Size(ForceMap.Settings.Resolution * TexelSize);
+			ForceMapBoxes.Add(Pair.Key, FBox(FVector(Corner, -UE_BIG_NUMBER), FVector(Corner + Size, UE_BIG_NUMBER)));
+		}
+	}
+
+	for (FWorkDesc& WorkDesc : WorkDescs)
+	{
+		bool bAnimated = bWind;
+		for (int32 Index = 0; Index < WorkDesc.NumSections && !bAnimated; Index++)
+		{
+			const GrassUtils::FSectionWork& SectionWork = SectionWorks[WorkDesc.FirstSection + Index];
+			const FBox* ForceMapBox = ForceMapBoxes.Find(SectionWork.Section->Scene);
+			bAnimated = SectionWork.BendStateOffset != NO_BEND_STATE
+				|| (ForceMapBox != nullptr && ForceMapBox->Intersect(SectionWork.Section->Bounds));
+		}
+
+		if (bAnimated)
+		{
+			WorkDesc.bCached = false;
+			CachedCullings[WorkDesc.BufferIndex].SectionsKey = 0;
+		}
+	}
+}
+
+const GrassUtils::FPersistentBuffers* FGrassInstancingRendererExtension::AddShadowWork(
+	const void* InOwner,
+	const uint32 InCapacity,
+	const TConstArrayView<GrassUtils::FSectionWork> InSections,
+	const FUintVector2 InLodBucketRange,
+	const GrassUtils::FMainViewDesc& InMainViewDesc,
+	const GrassUtils::FChildViewDesc& InShadowViewDesc,
+	const GrassUtils::FShadowViewIdentity& InIdentity,
+	FUintVector2& OutLodBucketRange)
+{
+	if (InSections.Num() == 0)
+		return nullptr;
+
+	// The shadow keeps the id of the closest shadow of the owner during the last frame not matched yet,
+	// the lights and their cascades are gathered in no particular order
+	TArray<FShadowTrack>& FrameTracks = FrameShadowTracks.FindOrAdd(InOwner);
+	const FShadowTrack* Match = nullptr;
+	if (const TArray<FShadowTrack>* Tracks = ShadowTracks.Find(InOwner))
+	{
+		float BestCost = 1.0f;
+		for (const FShadowTrack& Track : *Tracks)
+		{
+			if (FrameTracks.ContainsByPredicate([&Track](const FShadowTrack& FrameTrack) { return FrameTrack.Id == Track.Id; }))
+				continue;
+
+			const float Cost = GrassUtils::ComputeShadowMatchCost(Track.Identity, InIdentity);
+			if (Cost < BestCost)
+			{
+				BestCost = Cost;
+				Match = &Track;
+			}
+		}
+	}
+	const uint32 ShadowId = Match != nullptr ? Match->Id : NextShadowId++;
+	FrameTracks.Add({ ShadowId, InIdentity });
+	const TPair<const void*, uint32> Key(InOwner, ShadowId);
+
+	FShadowWorkDesc& ShadowWork = PendingShadowWorks.AddDefaulted_GetRef();
+	ShadowWork.Key = Key;
+	ShadowWork.Capacity = InCapacity;
+	ShadowWork.Sections.Append(InSections.GetData(), InSections.Num());
+	ShadowWork.LodBucketRange = InLodBucketRange;
+	ShadowWork.MainViewDesc = InMainViewDesc;
+	ShadowWork.MainViewDesc.ViewDebug = nullptr;
+	ShadowWork.ShadowViewDesc = InShadowViewDesc;
+	// The shadow will be drawn a frame later, it is assumed to move as much as during the last frame
+	ShadowWork.CullMargin = Match != nullptr ? static_cast<float>(FVector::Dist(Match->Identity.Origin, InIdentity.Origin)) : 0.0f;
+
+	// Only the buffers culled at the start of this frame can be drawn
+	const FShadowBuffers* Found = ShadowBuffers.Find(Key);
+	if (Found == nullptr || Found->FilledId != DiscardId)
+		return nullptr;
+
+	OutLodBucketRange = Found->LodBucketRange;
+	return &Found->Buffers;
+}
+
+void FGrassInstancingRendererExtension::RemoveOwner(const void* InOwner)
+{
+	PendingShadowWorks.RemoveAll([InOwner](const FShadowWorkDesc& ShadowWork)
+	{
+		return ShadowWork.Key.Key == InOwner;
+	});
+	ShadowTracks.Remove(InOwner);
+	FrameShadowTracks.Remove(InOwner);
+
+	for (auto It = ShadowBuffers.CreateIterator(); It; ++It)
+	{
+		if (It.Key().Key == InOwner)
+		{
+			GrassUtils::ReleaseInstanceBuffers(It.Value().Buffers);
+			It.RemoveCurrent();
+		}
+	}
+}
+
 void FGrassInstancingRendererExtension::BeginFrame(FRDGBuilder &GraphBuilder)
 {
 	// If we hit this then BeginFrame()/EndFrame() logic needs fixing in the Scene Renderer.
@@ -575,10 +1836,28 @@ void FGrassInstancingRendererExtension::BeginFrame(FRDGBuilder &GraphBuilder)
 	}
 	bInFrame = true;
 
-	if (WorkDescs.Num() > 0)
+	// The views of the frame have all been gathered, the frames without any keep the time of the last one
+	if (MainViews.Num() > 0)
+	{
+		FrameTime = MainViews[0]->Family->Time;
+	}
+
+	UpdateInstanceBudgets();
+	UpdateGovernor();
+	UpdateWind();
+	UpdateForceMaps(GraphBuilder);
+	UpdateBendStates(GraphBuilder);
+	InvalidateAnimatedCullings();
+
+	if (WorkDescs.Num() > 0 || PendingShadowWorks.Num() > 0)
 	{
 		SubmitWork(GraphBuilder);
 	}
+
+	if (Benchmark.IsValid())
+	{
+		UpdateThreadGroupBenchmark(GraphBuilder);
+	}
 }
 
 void FGrassInstancingRendererExtension::EndFrame()
@@ -586,10 +1865,21 @@ void FGrassInstancingRendererExtension::EndFrame()
 	ensure(bInFrame);
 	bInFrame = false;
 
-	SceneProxies.Reset();
+	Owners.Reset();
+	SectionWorks.Reset();
+	// The shadows of the next frame are matched against the ones gathered during this one
+	ShadowTracks = MoveTemp(FrameShadowTracks);
+	FrameShadowTracks.Reset();
 	MainViews.Reset();
 	CullViews.Reset();
+	CullVolumes.Reset();
 	WorkDescs.Reset();
+	NoForceMapParameters = nullptr;
+	for (TPair<const FSceneInterface*, FSceneForces>& Pair : SceneForces)
+	{
+		Pair.Value.Parameters = nullptr;
+	}
+	BendStatesSRV = nullptr;
 
 	// Clean the buffer pool
 	DiscardId++;
@@ -603,12 +1893,28 @@ void FGrassInstancingRendererExtension::EndFrame()
 			
 			Buffers.RemoveAtSwap(Index);
 			DiscardIds.RemoveAtSwap(Index);
+			CachedCullings.RemoveAtSwap(Index);
 		}
 		else
 		{
 			++Index;
 		}
 	}
+
+	for (auto It = ShadowBuffers.CreateIterator(); It; ++It)
+	{
+		if (DiscardId - It.Value().FilledId > 4u)
+		{
+			GrassUtils::ReleaseInstanceBuffers(It.Value().Buffers);
+			It.RemoveCurrent();
+		}
+	}
+
+	for (auto It = OcclusionHZBs.CreateIterator(); It; ++It)
+	{
+		if (DiscardId - It.Value().CapturedId > 4u)
+			It.RemoveCurrent();
+	}
 }
 
 void FGrassInstancingRendererExtension::EndFrame(FRDGBuilder &GraphBuilder)
@@ -616,98 +1922,240 @@ void FGrassInstancingRendererExtension::EndFrame(FRDGBuilder &GraphBuilder)
 	EndFrame();
 }
 
-void FGrassInstancingRendererExtension::SubmitWork(FRDGBuilder& GraphBuilder)
+void FGrassInstancingRendererExtension::AddCullingPasses(
+	FRDGBuilder& GraphBuilder,
+	const TConstArrayView<GrassUtils::FSectionWork> WorkSections,
+	const TRDGUniformBufferRef<GrassUtils::FGrassViewParameters> ViewUniformBuffer,
+	const GrassUtils::FGrassHZBParameters* HZBParameters,
+	const GrassUtils::FGrassWindParameters& WindParameters,
+	const GrassUtils::FGrassForceMapParameters& ForceMapParameters,
+	FRDGBufferSRVRef BendStates,
+	const GrassUtils::FVolatileResources& VolatileResources,
+	const bool bFusedInstanceData,
+	const bool bDistanceBins,
+	const float CullMargin)
 {
-	// Sort work so that we can batch by proxy/view
-	WorkDescs.Sort(FWorkDescSort());
-
-	// // Add pass to transition all output buffers for writing
-	// TArray<int32, TInlineAllocator<8>> UsedBufferIndices;
-	// for (FWorkDesc WorkDesc : WorkDescs)
-	// {
-	// 	UsedBufferIndices.Add(WorkDesc.BufferIndex);
-	// }
+	check(WorkSections.Num() > 0);
+	const FGlobalShaderMap* GlobalShaderMap = GetGlobalShaderMap(GMaxRHIFeatureLevel);
+	// The cull passes size the dispatch of the instance pass, they have to agree on the group size
+	const uint32 ThreadGroupSize = GrassUtils::GetCullingThreadGroupSize();
 
-	// Add passes to initialize the output buffers
-	for (FWorkDesc WorkDesc : WorkDescs)
+	// Every section appends its visible blades to the shared culled buffer and LOD bucket counters
+	for (const GrassUtils::FSectionWork& SectionWork : WorkSections)
 	{
-		AddPass_InitIndirectArgs(GraphBuilder, GetGlobalShaderMap(GMaxRHIFeatureLevel), Buffers[WorkDesc.BufferIndex]);
+		// Dropped by the instance budget
+		if (SectionWork.DensityScale <= 0.0f)
+			continue;
+
+		const FGrassInstancingSectionProxy* SectionProxy = SectionWork.Section;
+		
+		GrassUtils::FProxyDesc ProxyDesc;
+		ProxyDesc.IsValid = true;
+		ProxyDesc.bIsCullingEnabled = SectionProxy->bIsGPUCullingEnabled;
+		ProxyDesc.GrassDataBufferSRV = SectionProxy->GrassDataBufferSRV;
+		ProxyDesc.GrassDataNum = SectionProxy->GrassDataNum;
+		ProxyDesc.CutoffDistance = SectionProxy->CutoffDistance * SectionWork.CutoffScale + CullMargin;
+		ProxyDesc.MinMaxLod = SectionProxy->MinMaxLodSteps;
+		ProxyDesc.LodPolicy = SectionProxy->LodPolicy;
+		ProxyDesc.InstanceBounds = SectionProxy->InstanceBounds;
+		ProxyDesc.DensityScale = SectionWork.DensityScale;
+		ProxyDesc.bIsFarField = SectionProxy->bIsFarField;
+		ProxyDesc.BendStateOffset = SectionWork.BendStateOffset;
+		ProxyDesc.NumSpecies = SectionProxy->NumSpecies;
+		if (SectionProxy->FarFieldFadeDistance > 0.0f)
+		{
+			ProxyDesc.FarFieldFade = GrassUtils::GetFarFieldFadeParameter(
+				SectionProxy->BladeCutoffDistance * SectionWork.CutoffScale, SectionProxy->FarFieldFadeDistance);
+		}
+
+		GrassUtils::AddPass_CullInstances(
+			GraphBuilder, GlobalShaderMap,
+			VolatileResources,
+			ProxyDesc, ViewUniformBuffer, HZBParameters, WindParameters, ForceMapParameters, BendStates,
+			SectionWork.LodBucketRange, bFusedInstanceData, bDistanceBins, ThreadGroupSize);
 	}
 
-	TMap<FGrassInstancingSectionProxy*, GrassUtils::FProxyDesc> Proxy2Desc;
+	if (bFusedInstanceData)
+		return;
+
+	// The prefix sum over the draws of every species places the instances of all the sections
+	GrassUtils::AddPass_ComputeSlotOffsets(GraphBuilder, GlobalShaderMap, VolatileResources, bDistanceBins);
+	GrassUtils::AddPass_ComputeInstanceData(
+		GraphBuilder, GlobalShaderMap,
+		VolatileResources, WorkSections[0].Section->InstanceBounds, WindParameters, ForceMapParameters,
+		bDistanceBins, ThreadGroupSize);
+}
+
+void FGrassInstancingRendererExtension::SubmitWork(FRDGBuilder& GraphBuilder)
+{
+	// Sort work so that we can batch by proxy/view
+	WorkDescs.Sort(FWorkDescSort());
+
 	TMap<const FSceneView*, GrassUtils::FMainViewDesc> MainView2Desc;
 	TMap<const FSceneView*, GrassUtils::FChildViewDesc> ChildViewView2Desc;
+
+	// The view constants are built once per pair of main and cull views and per cull margin, shadows have their own
+	TMap<TTuple<const FSceneView*, const FSceneView*, float>, TRDGUniformBufferRef<GrassUtils::FGrassViewParameters>> ViewUniformBuffers;
+	/** HZB parameters per pair of main and cull views, the projection is relative to the origin of the main view. */
+	TMap<TTuple<const FSceneView*, const FSceneView*>, const GrassUtils::FGrassHZBParameters*> HZBParameters;
+
+	/** Work item ready to be culled. */
+	struct FCullingWork
+	{
+		const GrassUtils::FPersistentBuffers* Buffers;
+		TConstArrayView<GrassUtils::FSectionWork> Sections;
+		TRDGUniformBufferRef<GrassUtils::FGrassViewParameters> ViewUniformBuffer;
+		const GrassUtils::FGrassHZBParameters* HZBParameters;
+		GrassUtils::FVolatileResources VolatileResources;
+		bool bFusedInstanceData;
+		bool bDistanceBins;
+		float CullMargin;
+	};
+	TArray<FCullingWork, TInlineAllocator<16>> CullingWorks;
 	
-	// Iterate workloads and submit work
-	const int32 NumWorkItems = WorkDescs.Num();
-	int32 WorkIndex = 0;
-	while (WorkIndex < NumWorkItems)
-	{
-		// Gather data per proxy
-		FGrassInstancingSectionProxy* SectionProxy = SceneProxies[WorkDescs[WorkIndex].ProxyIndex];
-		GrassUtils::FProxyDesc ProxyDesc = Proxy2Desc.FindOrAdd(SectionProxy);
-		bool bIsNewProxy = !ProxyDesc.IsValid;
-		if(bIsNewProxy)
-		{
-			ProxyDesc.IsValid = true;
-			ProxyDesc.bIsCullingEnabled = SectionProxy->bIsGPUCullingEnabled;
-			ProxyDesc.GrassData = &SectionProxy->GrassData;
-			ProxyDesc.CutoffDistance = SectionProxy->CutoffDistance;
-		}
-		
+	// Iterate workloads
+	for (const FWorkDesc& WorkDesc : WorkDescs)
+	{
+		// The buffers still hold the culling of the work item
+		if (WorkDesc.bCached || WorkDesc.NumSections == 0)
+			continue;
+
 		// Gather data per main view
-		const FSceneView* MainView = MainViews[WorkDescs[WorkIndex].MainViewIndex];
-		GrassUtils::FMainViewDesc MainViewDesc = MainView2Desc.FindOrAdd(MainView);
+		const FSceneView* MainView = MainViews[WorkDesc.MainViewIndex];
+		GrassUtils::FMainViewDesc& MainViewDesc = MainView2Desc.FindOrAdd(MainView);
 		if (!MainViewDesc.IsValid)
 		{
-			GrassUtils::FViewData MainViewData;
-			GrassUtils::GetViewData(MainView, MainViewData);
+			GrassUtils::GetMainViewDesc(MainView, MainViewDesc);
+		}
 
-			MainViewDesc.IsValid = true;
-			MainViewDesc.ViewDebug = MainView;
-			MainViewDesc.ViewOrigin = FVector3f(MainViewData.ViewOrigin);
-			MainViewDesc.ViewMatrix = FMatrix44f(MainViewData.ViewMatrix);
-			MainViewDesc.ViewProjectionMatrix = FMatrix44f(MainViewData.ViewProjectionMatrix);
+		// Gather data per child view
+		const FSceneView* CullView = CullViews[WorkDesc.CullViewIndex];
+		GrassUtils::FChildViewDesc& ChildViewDesc = ChildViewView2Desc.FindOrAdd(CullView);
+		if (!ChildViewDesc.IsValid)
+		{
+			GrassUtils::GetCullViewDesc(CullView, CullVolumes[WorkDesc.CullViewIndex], ChildViewDesc);
+			ChildViewDesc.bIsMainView = CullView == MainView;
 		}
 
-		// Build volatile graph resources
-		GrassUtils::FVolatileResources VolatileResources;
-		GrassUtils::InitializeResources(GraphBuilder,
-			SectionProxy,
-			ProxyDesc, MainViewDesc, VolatileResources);
+		TRDGUniformBufferRef<GrassUtils::FGrassViewParameters>& ViewUniformBuffer =
+			ViewUniformBuffers.FindOrAdd(MakeTuple(MainView, CullView, WorkDesc.CullMargin));
+		if (ViewUniformBuffer == nullptr)
+		{
+			ViewUniformBuffer = GrassUtils::CreateViewUniformBuffer(GraphBuilder, MainViewDesc, ChildViewDesc, WorkDesc.CullMargin);
+		}
 
-		// Build graph
-		GrassUtils::AddPass_CullInstances(
-			GraphBuilder, GetGlobalShaderMap(GMaxRHIFeatureLevel),
-			VolatileResources, Buffers[WorkDescs[WorkIndex].BufferIndex],
-			ProxyDesc, MainViewDesc);
-		
-		GrassUtils::AddPass_ComputeInstanceData(
-			GraphBuilder, GetGlobalShaderMap(GMaxRHIFeatureLevel),
-			VolatileResources, Buffers[WorkDescs[WorkIndex].BufferIndex],
-			ProxyDesc, MainViewDesc);
+		FCullingWork& CullingWork = CullingWorks.AddDefaulted_GetRef();
+		CullingWork.Buffers = &Buffers[WorkDesc.BufferIndex];
+		CullingWork.Sections = TConstArrayView<GrassUtils::FSectionWork>(&SectionWorks[WorkDesc.FirstSection], WorkDesc.NumSections);
+		CullingWork.ViewUniformBuffer = ViewUniformBuffer;
+		CullingWork.HZBParameters = nullptr;
+		CullingWork.CullMargin = WorkDesc.CullMargin;
 
-		// Gather data per child view
-		// const FSceneView* CullView = CullViews[WorkDescs[WorkIndex].CullViewIndex];
-		// GrassUtils::FChildViewDesc ChildViewDesc = ChildViewView2Desc.FindOrAdd(CullView);
-		// if (!ChildViewDesc.IsValid)
-		// {
-		// 	GrassUtils::FViewData CullViewData;
-		// 	GrassUtils::GetViewData(CullView, CullViewData);
-		//
-		//
-		// 	ChildViewDesc.IsValid = true;
-		// 	ChildViewDesc.bIsMainView = CullView == MainView;
-		// 	ChildViewDesc.ViewDebug = MainView;
-		// 	ChildViewDesc.ViewMatrix = FMatrix44f(CullViewData.ViewMatrix);
-		// 	ChildViewDesc.ViewProjectionMatrix = ChildViewDesc.bIsMainView ? MainViewDesc.ViewProjectionMatrix : FMatrix44f(CullViewData.ViewProjectionMatrix);
-		// 	ChildViewDesc.ViewOrigin = ChildViewDesc.bIsMainView ? MainViewDesc.ViewOrigin : FVector3f(CullViewData.ViewOrigin);
-		// }
-		
+		if (WorkDesc.bHZBOcclusion)
+		{
+			const GrassUtils::FGrassHZBParameters*& Parameters = HZBParameters.FindOrAdd(MakeTuple(MainView, CullView));
+			if (Parameters == nullptr)
+			{
+				const FOcclusionHZB& HZB = OcclusionHZBs.FindChecked(CullView->State->GetViewKey());
+				GrassUtils::FGrassHZBParameters* NewParameters = GraphBuilder.AllocParameters<GrassUtils::FGrassHZBParameters>();
+				NewParameters->HZBTexture = GraphBuilder.RegisterExternalTexture(HZB.Texture);
+				NewParameters->HZBViewProjection = FMatrix44f(FTranslationMatrix(MainViewDesc.LodView.Origin) * HZB.ViewProjection);
+				NewParameters->HZBViewSize = HZB.ViewSize;
+				NewParameters->HZBMaxMip = HZB.NumMips - 1;
+				Parameters = NewParameters;
+			}
+			CullingWork.HZBParameters = Parameters;
+		}
+	}
+
+	// Cull the shadows gathered during the last frame, they are drawn by this frame's shadow depth passes
+	for (const FShadowWorkDesc& ShadowWork : PendingShadowWorks)
+	{
+		FShadowBuffers& Shadow = ShadowBuffers.FindOrAdd(ShadowWork.Key);
+		if (Shadow.Buffers.Capacity < ShadowWork.Capacity)
+		{
+			GrassUtils::ReleaseInstanceBuffers(Shadow.Buffers);
+			GrassUtils::InitializeInstanceBuffers(ShadowWork.Key.Key, ShadowWork.Capacity, Shadow.Buffers);
+		}
+		Shadow.LodBucketRange = ShadowWork.LodBucketRange;
+		Shadow.FilledId = DiscardId;
+	}
+	for (const FShadowWorkDesc& ShadowWork : PendingShadowWorks)
+	{
+		if (ShadowWork.Sections.Num() == 0)
+			continue;
+
+		FCullingWork& CullingWork = CullingWorks.AddDefaulted_GetRef();
+		CullingWork.Buffers = &ShadowBuffers.FindChecked(ShadowWork.Key).Buffers;
+		CullingWork.Sections = ShadowWork.Sections;
+		CullingWork.ViewUniformBuffer = GrassUtils::CreateViewUniformBuffer(GraphBuilder, ShadowWork.MainViewDesc, ShadowWork.ShadowViewDesc, ShadowWork.CullMargin);
+		CullingWork.HZBParameters = nullptr;
+		CullingWork.CullMargin = ShadowWork.CullMargin;
+	}
+
+	// The governor times the culling and instance passes of the frame on the graphics pipe only: on the async compute pipe
+	// the timestamps would bracket the graphics work they overlap with, the quality is held until they run on it again
+	TPair<FRenderQueryRHIRef, FRenderQueryRHIRef> Timestamps;
+	if (Governor.IsEnabled() && CullingWorks.Num() > 0 && GrassUtils::GetCullingPassFlags() != ERDGPassFlags::AsyncCompute)
+	{
+		Timestamps.Key = RHICreateRenderQuery(RQT_AbsoluteTime);
+		Timestamps.Value = RHICreateRenderQuery(RQT_AbsoluteTime);
+		GrassUtils::AddPass_Timestamp(GraphBuilder, Timestamps.Key);
+	}
+
+	// Reset the indirect args of all the work items before any culling. Each work item owns its args buffer,
+	// which its draws keep across frames, so this is still one clear dispatch per work item
+	{
+		RDG_EVENT_SCOPE(GraphBuilder, "InitGrassIndirectArgs");
+		const FGlobalShaderMap* GlobalShaderMap = GetGlobalShaderMap(GMaxRHIFeatureLevel);
+		const bool bDistanceBins = CVarGrassDistanceBins.GetValueOnRenderThread() != 0;
 
-		WorkIndex++;
+		for (FCullingWork& CullingWork : CullingWorks)
+		{
+			// The fused pass can't order the blades, it writes them before the bucket offsets are known
+			CullingWork.bDistanceBins = bDistanceBins;
+			CullingWork.bFusedInstanceData = !bDistanceBins && GrassUtils::IsSingleLodBucket(CullingWork.Sections);
+
+			// Build volatile graph resources, shared by all the sections of the work item
+			GrassUtils::InitializeResources(GraphBuilder, *CullingWork.Buffers, CullingWork.bFusedInstanceData, CullingWork.VolatileResources);
+
+			// The sections of a work item belong to the same scene proxy and share its LOD meshes
+			GrassUtils::AddPass_InitIndirectArgs(
+				GraphBuilder, GlobalShaderMap,
+				CullingWork.VolatileResources,
+				CullingWork.Sections[0].Section->LodNumIndices);
+		}
 	}
+
+	for (const FCullingWork& CullingWork : CullingWorks)
+	{
+		AddCullingPasses(
+			GraphBuilder,
+			CullingWork.Sections, CullingWork.ViewUniformBuffer, CullingWork.HZBParameters, WindParameters,
+			GetForceMapParameters(CullingWork.Sections[0].Section->Scene), BendStatesSRV,
+			CullingWork.VolatileResources, CullingWork.bFusedInstanceData, CullingWork.bDistanceBins, CullingWork.CullMargin);
+	}
+
+	if (Timestamps.Value.IsValid())
+	{
+		GrassUtils::AddPass_Timestamp(GraphBuilder, Timestamps.Value);
+
+		// Timings that never resolve are dropped rather than piling up
+		if (GovernorTimestamps.Num() >= 4)
+		{
+			GovernorTimestamps.RemoveAt(0);
+		}
+		GovernorTimestamps.Add(Timestamps);
+	}
+
+	// The draws bind the buffers outside of the graph, the culling passes are synced with them
+	// when the buffers are made readable, wherever the passes have been scheduled
+	for (const FCullingWork& CullingWork : CullingWorks)
+	{
+		GraphBuilder.UseExternalAccessMode(CullingWork.VolatileResources.InstanceBuffer, ERHIAccess::SRVMask);
+		GraphBuilder.UseExternalAccessMode(CullingWork.VolatileResources.IndirectArgsBuffer, ERHIAccess::IndirectArgs | ERHIAccess::SRVMask);
+	}
+	PendingShadowWorks.Reset();
 }
 // End FGrassInstancingRendererExtension implementations
 
-
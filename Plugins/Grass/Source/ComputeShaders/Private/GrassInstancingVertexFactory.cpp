@@ -18,6 +18,56 @@
 IMPLEMENT_GLOBAL_SHADER_PARAMETER_STRUCT(FGrassInstancingParameters, "GrassInstancingParams");
 IMPLEMENT_TYPE_LAYOUT(FGrassInstancingShaderParameters);
 
+static TAutoConsoleVariable<int32> CVarGrassCompactInstances(
+	TEXT("r.Grass.CompactInstances"),
+	0,
+	TEXT("Write the culled instances in a 16 bytes layout instead of 48: quantized origin and axes, half float scale.\n")
+	TEXT("Selects the permutations of the instance passes and of the vertex factory at runtime, both layouts are compiled."),
+	ECVF_ReadOnly | ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarGrassProceduralBlades(
+	TEXT("r.Grass.ProceduralBlades"),
+	0,
+	TEXT("Generate the blade vertices from the vertex id and the LOD in the vertex shader instead of fetching them from a vertex buffer.\n")
+	TEXT("Selects the permutation of the vertex factory at runtime, both are compiled."),
+	ECVF_ReadOnly | ECVF_RenderThreadSafe);
+
+bool GrassUtils::UseCompactInstances()
+{
+	return CVarGrassCompactInstances.GetValueOnAnyThread() != 0;
+}
+
+bool GrassUtils::UseProceduralBlades()
+{
+	return CVarGrassProceduralBlades.GetValueOnAnyThread() != 0;
+}
+
+uint32 GetGrassVertexFactoryFlags()
+{
+	return (GrassUtils::UseCompactInstances() ? EGrassVertexFactoryFlags::CompactInstances : EGrassVertexFactoryFlags::None)
+		| (GrassUtils::UseProceduralBlades() ? EGrassVertexFactoryFlags::ProceduralBlade : EGrassVertexFactoryFlags::None);
+}
+
+uint32 GetGrassCardVertexFactoryFlags()
+{
+	return GetGrassVertexFactoryFlags() & ~EGrassVertexFactoryFlags::ProceduralBlade;
+}
+
+TUniquePtr<FGrassInstancingVertexFactory> CreateGrassInstancingVertexFactory(const ERHIFeatureLevel::Type InFeatureLevel, const uint32 InFlags)
+{
+	switch (InFlags)
+	{
+	case EGrassVertexFactoryFlags::CompactInstances:
+		return MakeUnique<TGrassInstancingVertexFactory<EGrassVertexFactoryFlags::CompactInstances>>(InFeatureLevel);
+	case EGrassVertexFactoryFlags::ProceduralBlade:
+		return MakeUnique<TGrassInstancingVertexFactory<EGrassVertexFactoryFlags::ProceduralBlade>>(InFeatureLevel);
+	case EGrassVertexFactoryFlags::CompactInstances | EGrassVertexFactoryFlags::ProceduralBlade:
+		return MakeUnique<TGrassInstancingVertexFactory<EGrassVertexFactoryFlags::CompactInstances | EGrassVertexFactoryFlags::ProceduralBlade>>(InFeatureLevel);
+	default:
+		return MakeUnique<FGrassInstancingVertexFactory>(InFeatureLevel);
+	}
+}
+
 
 void FGrassInstancingVertexBuffer::InitRHI()
 {
@@ -40,7 +90,7 @@ void FGrassInstancingIndexBuffer::InitRHI()
 		return;
 	
 	FRHIResourceCreateInfo CreateInfo(TEXT("FGrass.IndexBuffer"), &Indices);
-	IndexBufferRHI = RHICreateVertexBuffer(Indices.GetResourceDataSize(), BUF_UnorderedAccess | BUF_DrawIndirect, CreateInfo);
+	IndexBufferRHI = RHICreateIndexBuffer(sizeof(uint16), Indices.GetResourceDataSize(), BUF_Static, CreateInfo);
 
 }
 
@@ -102,8 +152,9 @@ void FGrassInstancingVertexFactory::InitRHI()
 	if (Data.TangentBasisComponents[1].VertexBuffer != nullptr)
 		Elements.Add(AccessStreamComponent(Data.TangentBasisComponents[1], 3));
 	
+	// The procedural permutation draws without any vertex stream
 	InitDeclaration(Elements, EVertexInputStreamType::Default);
-	check(Streams.Num() > 0);
+	check(Streams.Num() > 0 || !UsesVertexStreams());
 }
 
 void FGrassInstancingVertexFactory::ReleaseRHI()
@@ -113,6 +164,11 @@ void FGrassInstancingVertexFactory::ReleaseRHI()
 }
 
 bool FGrassInstancingVertexFactory::ShouldCompilePermutation(const FVertexFactoryShaderPermutationParameters &Parameters)
+{
+	return SupportsPermutation(Parameters);
+}
+
+bool FGrassInstancingVertexFactory::SupportsPermutation(const FVertexFactoryShaderPermutationParameters &Parameters)
 {
 	if (!IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM6))
 	{
@@ -141,8 +197,12 @@ void FGrassInstancingShaderParameters::Bind(const FShaderParameterMap& Parameter
 {
 	// TODO
 	InstanceBufferParameter.Bind(ParameterMap, TEXT("InstanceBuffer"));
+	LodIndirectArgsParameter.Bind(ParameterMap, TEXT("LodIndirectArgs"));
+	InstanceOffsetIndexParameter.Bind(ParameterMap, TEXT("InstanceOffsetIndex"));
 	NumVerticesParameter.Bind(ParameterMap, TEXT("InstanceNumVertices"));
 	LodViewOriginParameter.Bind(ParameterMap, TEXT("LodViewOrigin"));
+	InstanceBoundsMinParameter.Bind(ParameterMap, TEXT("InstanceBoundsMin"));
+	InstanceBoundsSizeParameter.Bind(ParameterMap, TEXT("InstanceBoundsSize"));
 	// LodDistancesParameter.Bind(ParameterMap, TEXT("LodDistances"));
 }
 
@@ -164,8 +224,12 @@ void FGrassInstancingShaderParameters::GetElementShaderBindings(
 
 	// TODO
 	ShaderBindings.Add(InstanceBufferParameter, UserData->InstanceBufferSRV);
+	ShaderBindings.Add(LodIndirectArgsParameter, UserData->IndirectArgsBufferSRV);
+	ShaderBindings.Add(InstanceOffsetIndexParameter, UserData->InstanceOffsetIndex);
 	ShaderBindings.Add(NumVerticesParameter, UserData->NumVertices);
 	ShaderBindings.Add(LodViewOriginParameter, UserData->LodViewOrigin);
+	ShaderBindings.Add(InstanceBoundsMinParameter, UserData->InstanceBoundsMin);
+	ShaderBindings.Add(InstanceBoundsSizeParameter, UserData->InstanceBoundsSize);
 	// ShaderBindings.Add(LodDistancesParameter, UserData->LodDistances);
 }
 
@@ -181,3 +245,13 @@ IMPLEMENT_VERTEX_FACTORY_TYPE(FGrassInstancingVertexFactory, "/Shaders/GrassVert
 IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FGrassInstancingVertexFactory, SF_Vertex, FGrassInstancingShaderParameters);
 IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FGrassInstancingVertexFactory, SF_Pixel, FGrassInstancingShaderParameters);
 IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FGrassInstancingVertexFactory, SF_Compute, FGrassInstancingShaderParameters);
+
+#define IMPLEMENT_GRASS_VERTEX_FACTORY_PERMUTATION(Flags) \
+	IMPLEMENT_TEMPLATE_VERTEX_FACTORY_TYPE(template<>, TGrassInstancingVertexFactory<Flags>, "/Shaders/GrassVertexFactory.ush", GRASS_FLAGS); \
+	IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(TGrassInstancingVertexFactory<Flags>, SF_Vertex, FGrassInstancingShaderParameters); \
+	IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(TGrassInstancingVertexFactory<Flags>, SF_Pixel, FGrassInstancingShaderParameters); \
+	IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(TGrassInstancingVertexFactory<Flags>, SF_Compute, FGrassInstancingShaderParameters);
+
+IMPLEMENT_GRASS_VERTEX_FACTORY_PERMUTATION(EGrassVertexFactoryFlags::CompactInstances);
+IMPLEMENT_GRASS_VERTEX_FACTORY_PERMUTATION(EGrassVertexFactoryFlags::ProceduralBlade);
+IMPLEMENT_GRASS_VERTEX_FACTORY_PERMUTATION(EGrassVertexFactoryFlags::CompactInstances | EGrassVertexFactoryFlags::ProceduralBlade);
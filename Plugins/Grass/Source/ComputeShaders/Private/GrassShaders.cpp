@@ -4,7 +4,12 @@
 #include "GrassShaders.h"
 
 // Begin implementations
+IMPLEMENT_GLOBAL_SHADER_PARAMETER_STRUCT(GrassUtils::FGrassViewParameters, "GrassView");
 IMPLEMENT_GLOBAL_SHADER(GrassUtils::FInitInstanceBuffer_CS, "/Shaders/GrassCompute.usf", "InitIndirectArgsCS", SF_Compute);
 IMPLEMENT_GLOBAL_SHADER(GrassUtils::FCullInstances_CS, "/Shaders/GrassCompute.usf", "CullInstancesCS", SF_Compute);
+IMPLEMENT_GLOBAL_SHADER(GrassUtils::FComputeSlotOffsets_CS, "/Shaders/GrassCompute.usf", "ComputeSlotOffsetsCS", SF_Compute);
 IMPLEMENT_GLOBAL_SHADER(GrassUtils::FComputeInstanceData_CS, "/Shaders/GrassCompute.usf", "ComputeInstanceGrassDataCS", SF_Compute);
+IMPLEMENT_GLOBAL_SHADER(GrassUtils::FBuildHZB_CS, "/Shaders/GrassCompute.usf", "BuildHZBCS", SF_Compute);
+IMPLEMENT_GLOBAL_SHADER(GrassUtils::FSplatForceMap_CS, "/Shaders/GrassCompute.usf", "SplatForceMapCS", SF_Compute);
+IMPLEMENT_GLOBAL_SHADER(GrassUtils::FIntegrateBendState_CS, "/Shaders/GrassCompute.usf", "IntegrateBendStateCS", SF_Compute);
 
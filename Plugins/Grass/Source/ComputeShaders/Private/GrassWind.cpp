@@ -0,0 +1,69 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+// Adapted from the VirtualHeightfieldMesh plugin
+
+#include "GrassWind.h"
+
+#include "GrassInstancingRenderer.h"
+
+static TAutoConsoleVariable<float> CVarGrassWindStrength(
+	TEXT("r.Grass.WindStrength"),
+	0.0f,
+	TEXT("Push of the wind on the blades, 0 disables the wind.\n")
+	TEXT("The wind is evaluated once per visible blade by the instance passes, the blades are bent as a whole."),
+	ECVF_RenderThreadSafe | ECVF_Scalability);
+
+static TAutoConsoleVariable<float> CVarGrassWindDirection(
+	TEXT("r.Grass.WindDirection"),
+	0.0f,
+	TEXT("Yaw in degrees of the direction the wind blows to."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarGrassWindSpeed(
+	TEXT("r.Grass.WindSpeed"),
+	300.0f,
+	TEXT("Speed the gusts of the wind travel at, in world units per second."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarGrassWindGustSize(
+	TEXT("r.Grass.WindGustSize"),
+	2000.0f,
+	TEXT("World size of a tile of the gust texture, the larger the broader the gusts."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarGrassWindMaxBend(
+	TEXT("r.Grass.WindMaxBend"),
+	1.2f,
+	TEXT("Largest angle in radians the wind bends the blades by."),
+	ECVF_RenderThreadSafe);
+
+void FGrassInstancingRendererExtension::UpdateWind()
+{
+	GrassUtils::FGrassWind Wind;
+	Wind.Strength = FMath::Max(CVarGrassWindStrength.GetValueOnRenderThread(), 0.0f);
+	const float Yaw = FMath::DegreesToRadians(CVarGrassWindDirection.GetValueOnRenderThread());
+	Wind.Direction = FVector2f(FMath::Cos(Yaw), FMath::Sin(Yaw));
+	Wind.Speed = CVarGrassWindSpeed.GetValueOnRenderThread();
+	Wind.GustSize = CVarGrassWindGustSize.GetValueOnRenderThread();
+	Wind.MaxBendAngle = FMath::Clamp(CVarGrassWindMaxBend.GetValueOnRenderThread(), 0.0f, UE_HALF_PI);
+
+	if (Wind.IsEnabled() && !WindGustTexture.IsValid())
+	{
+		TArray<FFloat16> Texels;
+		GrassUtils::BuildWindGustTexture(Texels);
+
+		const FRHITextureCreateDesc Desc =
+			FRHITextureCreateDesc::Create2D(TEXT("GrassWindGustTexture"), WIND_GUST_TEXTURE_SIZE, WIND_GUST_TEXTURE_SIZE, PF_G16R16F)
+			.SetFlags(ETextureCreateFlags::ShaderResource);
+		WindGustTexture = RHICreateTexture(Desc);
+
+		const uint32 Pitch = WIND_GUST_TEXTURE_SIZE * 2 * sizeof(FFloat16);
+		RHIUpdateTexture2D(WindGustTexture, 0, FUpdateTextureRegion2D(0, 0, 0, 0, WIND_GUST_TEXTURE_SIZE, WIND_GUST_TEXTURE_SIZE), Pitch,
+			reinterpret_cast<const uint8*>(Texels.GetData()));
+	}
+
+	// The shaders read the texture whether the wind blows or not
+	WindParameters.WindDirectionStrength = Wind.IsEnabled() ? Wind.GetDirectionStrengthParameter() : FVector4f::Zero();
+	WindParameters.WindGustTransform = Wind.GetGustTransformParameter(FrameTime.GetWorldTimeSeconds());
+	WindParameters.WindGustTexture = Wind.IsEnabled() ? WindGustTexture.GetReference() : GBlackTexture->TextureRHI.GetReference();
+	WindParameters.WindGustSampler = TStaticSamplerState<SF_Bilinear, AM_Wrap, AM_Wrap, AM_Clamp>::GetRHI();
+}
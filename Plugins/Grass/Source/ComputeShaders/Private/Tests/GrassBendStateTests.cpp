@@ -0,0 +1,212 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "GrassBendState.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassBendStatePushTiltTest, "Grass.BendState.PushTilt",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassBendStatePushTiltTest::RunTest(const FString& Parameters)
+{
+	const float MaxBendAngle = 1.4f;
+	TestEqual(TEXT("No push doesn't tilt"), GrassUtils::ComputePushTilt(FVector2f::ZeroVector, 0.5f, MaxBendAngle), FVector2f::ZeroVector);
+
+	// The tilt leans along the push, growing with it up to the largest bend
+	const FVector2f Direction = FVector2f(3.0f, -4.0f).GetSafeNormal();
+	float LastAngle = 0.0f;
+	for (const float Push : { 0.1f, 0.5f, 1.0f, 2.0f, 5.0f, 50.0f })
+	{
+		const FVector2f Tilt = GrassUtils::ComputePushTilt(Direction * Push, 0.5f, MaxBendAngle);
+		TestTrue(TEXT("The tilt leans along the push"), Tilt.GetSafeNormal().Equals(Direction, 1.0e-5f));
+		TestTrue(TEXT("The tilt grows with the push"), Tilt.Size() > LastAngle);
+		TestTrue(TEXT("The tilt stays under the largest bend"), Tilt.Size() <= MaxBendAngle + 1.0e-5f);
+		LastAngle = Tilt.Size();
+	}
+	TestTrue(TEXT("A strong push saturates at the largest bend"), FMath::IsNearlyEqual(LastAngle, MaxBendAngle, 1.0e-3f));
+
+	// The stiffer blades bend less under the same push, the stiffness is clamped to [0, 1]
+	const FVector2f Push = Direction * 0.5f;
+	TestTrue(TEXT("The stiffer blades bend less"),
+		GrassUtils::ComputePushTilt(Push, 1.0f, MaxBendAngle).Size() < GrassUtils::ComputePushTilt(Push, 0.0f, MaxBendAngle).Size());
+	TestEqual(TEXT("The stiffness is clamped"),
+		GrassUtils::ComputePushTilt(Push, 3.0f, MaxBendAngle), GrassUtils::ComputePushTilt(Push, 1.0f, MaxBendAngle));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassBendStateIntegrateTest, "Grass.BendState.Integrate",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassBendStateIntegrateTest::RunTest(const FString& Parameters)
+{
+	const float MaxBendAngle = 1.4f;
+	const FVector2f Target(0.6f, -0.4f);
+
+	// Seconds the bend takes to settle within 1% of the target at 60 fps
+	const auto GetSettleTime = [&Target, MaxBendAngle](const float Stiffness)
+	{
+		GrassUtils::FGrassBendState State;
+		int32 LastOutside = 0;
+		for (int32 Frame = 0; Frame < 600; Frame++)
+		{
+			State = GrassUtils::IntegrateBendState(State, Target, Stiffness, 1.0f / 60.0f, MaxBendAngle);
+			if (!State.Tilt.Equals(Target, 0.01f * Target.Size()))
+			{
+				LastOutside = Frame;
+			}
+		}
+		return (LastOutside + 1) / 60.0f;
+	};
+
+	for (const float Stiffness : { 0.0f, 0.5f, 1.0f })
+	{
+		TestTrue(FString::Printf(TEXT("A blade of stiffness %.1f settles within 5 seconds"), Stiffness), GetSettleTime(Stiffness) < 5.0f);
+	}
+	TestTrue(TEXT("The stiffer blades spring back faster"), GetSettleTime(1.0f) < GetSettleTime(0.0f));
+
+	// The spring is underdamped, it sways past the target before settling
+	GrassUtils::FGrassBendState State;
+	float LargestAngle = 0.0f;
+	for (int32 Frame = 0; Frame < 120; Frame++)
+	{
+		State = GrassUtils::IntegrateBendState(State, Target, 0.5f, 1.0f / 60.0f, MaxBendAngle);
+		LargestAngle = FMath::Max(LargestAngle, State.Tilt.Size());
+	}
+	TestTrue(TEXT("The blade sways past the target"), LargestAngle > Target.Size());
+
+	// Hitches are stepped as a single frame of 30 fps, the integration stays stable and bounded
+	const float NarrowBendAngle = 0.5f;
+	for (const float DeltaTime : { 1.0f / 30.0f, 0.25f, 1.0f, 10.0f })
+	{
+		GrassUtils::FGrassBendState Hitched;
+		bool bBounded = true;
+		for (int32 Frame = 0; Frame < 300; Frame++)
+		{
+			Hitched = GrassUtils::IntegrateBendState(Hitched, Target, 0.0f, DeltaTime, NarrowBendAngle);
+			bBounded &= Hitched.Tilt.Size() <= NarrowBendAngle + 1.0e-5f && !Hitched.Velocity.ContainsNaN();
+		}
+		TestTrue(FString::Printf(TEXT("A step of %.3f s keeps the tilt under the largest bend"), DeltaTime), bBounded);
+		TestTrue(FString::Printf(TEXT("A step of %.3f s settles against the largest bend"), DeltaTime),
+			Hitched.Tilt.Equals(Target.GetSafeNormal() * NarrowBendAngle, 0.01f));
+	}
+
+	// A step of no time leaves the state as it is
+	const GrassUtils::FGrassBendState Paused = GrassUtils::IntegrateBendState(State, Target, 0.5f, 0.0f, MaxBendAngle);
+	TestEqual(TEXT("A paused frame keeps the tilt"), Paused.Tilt, State.Tilt);
+	TestEqual(TEXT("A paused frame keeps the velocity"), Paused.Velocity, State.Velocity);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassBendStateTiltedUpTest, "Grass.BendState.TiltedUp",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassBendStateTiltedUpTest::RunTest(const FString& Parameters)
+{
+	const FVector3f Up = FVector3f::UpVector;
+	TestEqual(TEXT("No tilt keeps the blade up"), GrassUtils::ComputeTiltedUp(Up, FVector2f::ZeroVector), Up);
+
+	// A blade standing straight up leans by the angle of the tilt, towards it
+	FRandomStream RandomStream(0x62656e64);
+	for (int32 Iteration = 0; Iteration < 256; Iteration++)
+	{
+		const FVector2f Tilt = FVector2f(RandomStream.FRandRange(-1.0f, 1.0f), RandomStream.FRandRange(-1.0f, 1.0f)).GetClampedToMaxSize(1.4f);
+		const FVector3f Tilted = GrassUtils::ComputeTiltedUp(Up, Tilt);
+		TestTrue(TEXT("The length of the blade is kept"), FMath::IsNearlyEqual(Tilted.Size(), 1.0f, 1.0e-5f));
+
+		const float Angle = FMath::Acos(FMath::Clamp(FVector3f::DotProduct(Up, Tilted), -1.0f, 1.0f));
+		TestTrue(TEXT("The blade leans by the angle of the tilt"), FMath::IsNearlyEqual(Angle, Tilt.Size(), 1.0e-3f));
+		if (Tilt.Size() > 0.01f)
+		{
+			TestTrue(TEXT("The blade leans towards the tilt"),
+				FVector2f(Tilted.X, Tilted.Y).GetSafeNormal().Equals(Tilt.GetSafeNormal(), 1.0e-3f));
+		}
+	}
+
+	// A leaning blade stays normalized, and a tilt along its own axis can't bend it
+	const FVector3f Leaning = FVector3f(1.0f, 0.0f, 1.0f).GetSafeNormal();
+	TestTrue(TEXT("A leaning blade keeps its length"),
+		FMath::IsNearlyEqual(GrassUtils::ComputeTiltedUp(Leaning, FVector2f(0.0f, 0.8f)).Size(), 1.0f, 1.0e-5f));
+	TestEqual(TEXT("A tilt along a lying blade leaves it"),
+		GrassUtils::ComputeTiltedUp(FVector3f::ForwardVector, FVector2f(0.8f, 0.0f)), FVector3f::ForwardVector);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassBendStatePoolTest, "Grass.BendState.Pool",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassBendStatePoolTest::RunTest(const FString& Parameters)
+{
+	GrassUtils::FGrassBendStatePool Pool(100);
+	TestEqual(TEXT("An empty section gets no state"), Pool.Allocate(1, 0), NO_BEND_STATE);
+	TestEqual(TEXT("A section without a range has no state"), Pool.Find(1), NO_BEND_STATE);
+
+	// First fit from the start of the pool
+	TestEqual(TEXT("The first range starts the pool"), Pool.Allocate(1, 30), 0u);
+	TestEqual(TEXT("The second range follows it"), Pool.Allocate(2, 30), 30u);
+	TestEqual(TEXT("The third range follows it"), Pool.Allocate(3, 40), 60u);
+	TestEqual(TEXT("The pool is full"), Pool.GetNumAllocated(), 100u);
+	TestEqual(TEXT("A full pool has no room left"), Pool.Allocate(4, 1), NO_BEND_STATE);
+	TestEqual(TEXT("A range is found by its key"), Pool.Find(2), 30u);
+
+	// The freed ranges are merged with their free neighbours, in whichever order they are freed
+	Pool.Free(2);
+	TestEqual(TEXT("A freed range is no longer found"), Pool.Find(2), NO_BEND_STATE);
+	TestEqual(TEXT("A larger section doesn't fit in the hole"), Pool.Allocate(4, 31), NO_BEND_STATE);
+	Pool.Free(1);
+	TestEqual(TEXT("The hole grows with its freed neighbour"), Pool.Allocate(4, 60), 0u);
+	Pool.Free(4);
+	Pool.Free(3);
+	TestEqual(TEXT("Freeing everything leaves the pool empty"), Pool.GetNumAllocated(), 0u);
+	TestEqual(TEXT("The whole pool is a single range again"), Pool.Allocate(5, 100), 0u);
+	Pool.Free(42);
+	TestEqual(TEXT("Freeing an unknown key is ignored"), Pool.GetNumAllocated(), 100u);
+
+	// Random churn, the ranges never overlap, stay within the pool and account for every state
+	Pool.Reset(4096);
+	FRandomStream RandomStream(0x706f6f6c);
+	TArray<uint32> Keys;
+	uint32 NextKey = 1;
+	for (int32 Iteration = 0; Iteration < 2000; Iteration++)
+	{
+		if (Keys.Num() > 0 && RandomStream.FRand() < 0.45f)
+		{
+			const int32 Index = RandomStream.RandRange(0, Keys.Num() - 1);
+			Pool.Free(Keys[Index]);
+			Keys.RemoveAtSwap(Index);
+		}
+		else if (Pool.Allocate(NextKey, RandomStream.RandRange(1, 300)) != NO_BEND_STATE)
+		{
+			Keys.Add(NextKey);
+		}
+		NextKey++;
+
+		TArray<TPair<uint32, uint32>> Ranges;
+		Pool.GetAllocations().GenerateValueArray(Ranges);
+		Ranges.Sort([](const TPair<uint32, uint32>& A, const TPair<uint32, uint32>& B) { return A.Key < B.Key; });
+		uint32 NumAllocated = 0;
+		bool bValid = Ranges.Num() == Keys.Num();
+		for (int32 Index = 0; Index < Ranges.Num(); Index++)
+		{
+			NumAllocated += Ranges[Index].Value;
+			bValid &= Ranges[Index].Key + Ranges[Index].Value <= Pool.GetCapacity();
+			bValid &= Index == 0 || Ranges[Index - 1].Key + Ranges[Index - 1].Value <= Ranges[Index].Key;
+		}
+		bValid &= NumAllocated == Pool.GetNumAllocated();
+		if (!bValid)
+		{
+			AddError(FString::Printf(TEXT("The pool is inconsistent after %d operations"), Iteration + 1));
+			break;
+		}
+	}
+
+	// Once all the keys are freed the ranges have all coalesced back
+	for (const uint32 Key : Keys)
+	{
+		Pool.Free(Key);
+	}
+	TestEqual(TEXT("The churned pool is a single range again"), Pool.Allocate(NextKey, Pool.GetCapacity()), 0u);
+	return true;
+}
+
+#endif
@@ -0,0 +1,49 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "GrassBudget.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassBudgetBoundTest, "Grass.Budget.Bound",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassBudgetBoundTest::RunTest(const FString& Parameters)
+{
+	const TArray<GrassUtils::FGrassBudgetRequest> Fitting = { { 1000, 1.0f }, { 500, 0.1f } };
+	TestEqual(TEXT("Requests within the budget are served in full"), GrassUtils::SolveBudgetScale(Fitting, 1500), MAX_flt);
+	TestEqual(TEXT("A full grant keeps every blade"), GrassUtils::GetBudgetKeepFraction(0.1f, MAX_flt), 1.0f);
+	TestEqual(TEXT("A grant under a step drops the section"), GrassUtils::GetBudgetKeepFraction(0.001f, 1.0f), 0.0f);
+
+	// Many small and distant sections around a few close ones, the budget holds however many of them there are
+	FRandomStream RandomStream(0x62756467);
+	for (int32 Iteration = 0; Iteration < 256; Iteration++)
+	{
+		TArray<GrassUtils::FGrassBudgetRequest> Requests;
+		const int32 NumRequests = RandomStream.RandRange(1, 200);
+		for (int32 Index = 0; Index < NumRequests; Index++)
+		{
+			GrassUtils::FGrassBudgetRequest& Request = Requests.AddDefaulted_GetRef();
+			Request.Instances = RandomStream.RandRange(0, 200000);
+			Request.Priority = FMath::Square(RandomStream.FRandRange(0.001f, 1.0f));
+		}
+		const uint32 Budget = RandomStream.RandRange(1000, 2000000);
+
+		const float Scale = GrassUtils::SolveBudgetScale(Requests, Budget);
+		TestTrue(TEXT("The granted instances are within the budget"), GrassUtils::GetGrantedInstances(Requests, Scale) <= Budget);
+
+		// The higher priorities keep at least as large a share
+		for (int32 Index = 1; Index < Requests.Num(); Index++)
+		{
+			const GrassUtils::FGrassBudgetRequest& A = Requests[Index - 1];
+			const GrassUtils::FGrassBudgetRequest& B = Requests[Index];
+			const bool bOrdered = A.Priority >= B.Priority ?
+				GrassUtils::GetBudgetKeepFraction(A.Priority, Scale) >= GrassUtils::GetBudgetKeepFraction(B.Priority, Scale) :
+				GrassUtils::GetBudgetKeepFraction(A.Priority, Scale) <= GrassUtils::GetBudgetKeepFraction(B.Priority, Scale);
+			TestTrue(TEXT("The grants follow the priorities"), bOrdered);
+		}
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,79 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "GrassCompaction.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassCompactionModesTest, "Grass.Compaction.Modes",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassCompactionModesTest::RunTest(const FString& Parameters)
+{
+	// About a third of the blades culled, the others spread over the buckets, with a partial last batch
+	FRandomStream RandomStream(0x636f6d70);
+	TArray<int32> Buckets;
+	Buckets.SetNumUninitialized(4096 + 77);
+	for (int32& Bucket : Buckets)
+	{
+		Bucket = RandomStream.FRand() < 0.35f ? INDEX_NONE : RandomStream.RandRange(0, MAX_LOD_BUCKETS - 1);
+	}
+
+	struct FModeRun
+	{
+		const TCHAR* Name;
+		GrassUtils::EGrassCullCompaction Mode;
+		int32 BatchSize;
+		GrassUtils::FCompactionSimulationResult Result;
+	};
+	FModeRun Runs[] = {
+		{ TEXT("PerBlade"), GrassUtils::EGrassCullCompaction::PerBlade, 1 },
+		{ TEXT("GroupShared"), GrassUtils::EGrassCullCompaction::GroupShared, 256 },
+		{ TEXT("Wave"), GrassUtils::EGrassCullCompaction::Wave, 32 },
+	};
+	for (FModeRun& Run : Runs)
+	{
+		GrassUtils::SimulateCullCompaction(Buckets, Run.Mode, Run.BatchSize, Run.Result);
+		TestTrue(FString::Printf(TEXT("%s compaction is valid"), Run.Name), GrassUtils::IsValidCullCompaction(Buckets, Run.Result));
+	}
+
+	// The blades written to the culled buffer, in slot order
+	const auto GetCulledBlades = [](const GrassUtils::FCompactionSimulationResult& Result)
+	{
+		TArray<int32> Blades;
+		Blades.Init(INDEX_NONE, Result.CulledCount);
+		for (int32 Index = 0; Index < Result.WriteIndices.Num(); Index++)
+		{
+			if (Result.WriteIndices[Index] != INDEX_NONE)
+			{
+				Blades[Result.WriteIndices[Index]] = Index;
+			}
+		}
+		return Blades;
+	};
+
+	const FModeRun& Reference = Runs[0];
+	TArray<int32> ReferenceBlades = GetCulledBlades(Reference.Result);
+	ReferenceBlades.Sort();
+	for (const FModeRun& Run : Runs)
+	{
+		TestEqual(FString::Printf(TEXT("%s keeps as many blades"), Run.Name), Run.Result.CulledCount, Reference.Result.CulledCount);
+		for (uint32 Bucket = 0; Bucket < MAX_LOD_BUCKETS; Bucket++)
+		{
+			TestEqual(FString::Printf(TEXT("%s fills bucket %u as much"), Run.Name, Bucket), Run.Result.BucketCounts[Bucket], Reference.Result.BucketCounts[Bucket]);
+		}
+
+		// The slots are a permutation of the same blades, only the order of the batches may differ
+		TArray<int32> Blades = GetCulledBlades(Run.Result);
+		Blades.Sort();
+		TestEqual(FString::Printf(TEXT("%s writes the same blades"), Run.Name), Blades, ReferenceBlades);
+	}
+
+	TestTrue(TEXT("The groupshared compaction issues fewer atomics than the wave one"),
+		Runs[1].Result.NumGlobalAtomics < Runs[2].Result.NumGlobalAtomics);
+	TestTrue(TEXT("The wave compaction issues fewer atomics than one per blade"),
+		Runs[2].Result.NumGlobalAtomics < Runs[0].Result.NumGlobalAtomics);
+	return true;
+}
+
+#endif
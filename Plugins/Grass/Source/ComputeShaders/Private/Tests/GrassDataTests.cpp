@@ -0,0 +1,97 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "GrassData.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassDataOctahedralTest, "Grass.Data.Octahedral",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassDataOctahedralTest::RunTest(const FString& Parameters)
+{
+	// The poles and the axes fall on the grid, straight blades stay straight
+	for (const FVector3f Axis : { FVector3f::UpVector, FVector3f::DownVector, FVector3f::ForwardVector, FVector3f::BackwardVector, FVector3f::RightVector, FVector3f::LeftVector })
+	{
+		TestTrue(TEXT("An axis is encoded exactly"), GrassUtils::UnpackOctahedral16(GrassUtils::PackOctahedral16(Axis)).Equals(Axis, 1.0e-6f));
+	}
+
+	// Half a step of the 8 bit grid, stretched by the normalization on the faces of the octahedron
+	FRandomStream RandomStream(0x6f637461);
+	for (int32 Iteration = 0; Iteration < 4096; Iteration++)
+	{
+		const FVector3f Direction(RandomStream.GetUnitVector());
+		const FVector3f Decoded = GrassUtils::UnpackOctahedral16(GrassUtils::PackOctahedral16(Direction));
+		TestTrue(TEXT("The direction is decoded normalized"), FMath::IsNearlyEqual(Decoded.Size(), 1.0f, 1.0e-5f));
+
+		const float Angle = FMath::Acos(FMath::Clamp(FVector3f::DotProduct(Direction, Decoded), -1.0f, 1.0f));
+		TestTrue(TEXT("The direction is within 0.02 radians"), Angle <= 0.02f);
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassDataCompactInstanceTest, "Grass.Data.CompactInstance",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassDataCompactInstanceTest::RunTest(const FString& Parameters)
+{
+	// Instance bounds of a large landscape proxy, off the world origin
+	const FBox3f Bounds(FVector3f(-12000.0f, 4000.0f, -300.0f), FVector3f(20000.0f, 30000.0f, 1500.0f));
+	const FVector3f Size = Bounds.GetSize();
+	const float OriginStep = FMath::Max3(
+		Size.X / GrassUtils::CompactInstanceOriginSteps.X,
+		Size.Y / GrassUtils::CompactInstanceOriginSteps.Y,
+		Size.Z / GrassUtils::CompactInstanceOriginSteps.Z);
+
+	const auto MakeBlade = [](FRandomStream& RandomStream, const FVector3f& Position)
+	{
+		const FVector3f Up = FVector3f(RandomStream.VRand() * 0.4f + FVector::UpVector).GetSafeNormal();
+		const FVector3f Facing = (Up ^ FVector3f(RandomStream.VRand())).GetSafeNormal();
+		return GrassUtils::FGrassData(0, Position, Up, Facing, RandomStream.FRandRange(10.0f, 200.0f), RandomStream.FRandRange(0.5f, 12.0f), 0.5f);
+	};
+
+	const auto TestRoundTrip = [this, &Bounds, OriginStep](const GrassUtils::FGrassData& Data, const TCHAR* What)
+	{
+		float RotScaleError, OriginError;
+		GrassUtils::ComputeCompactInstanceError(Data, Bounds, RotScaleError, OriginError);
+		// The rows built from the cross product of both axes add up their errors
+		TestTrue(FString::Printf(TEXT("%s: the transform is within 2%% of the blade size"), What), RotScaleError <= 0.02f);
+		TestTrue(FString::Printf(TEXT("%s: the origin is within a step of the grid"), What), OriginError <= OriginStep);
+
+		// Half floats keep 11 bits of mantissa
+		const GrassUtils::FGrassCompactInstance Instance = GrassUtils::PackCompactInstance(Data, Bounds);
+		FFloat16 Height, Width;
+		Height.Encoded = static_cast<uint16>(Instance.Scale >> 16);
+		Width.Encoded = static_cast<uint16>(Instance.Scale & 0xffff);
+		TestTrue(FString::Printf(TEXT("%s: the height is within a half float step"), What), FMath::Abs(Height.GetFloat() - Data.Height) <= Data.Height / 2048.0f);
+		TestTrue(FString::Printf(TEXT("%s: the width is within a half float step"), What), FMath::Abs(Width.GetFloat() - Data.Width) <= Data.Width / 2048.0f);
+	};
+
+	FRandomStream RandomStream(0x636d7074);
+	for (int32 Iteration = 0; Iteration < 2048; Iteration++)
+	{
+		const FVector3f Position(
+			RandomStream.FRandRange(Bounds.Min.X, Bounds.Max.X),
+			RandomStream.FRandRange(Bounds.Min.Y, Bounds.Max.Y),
+			RandomStream.FRandRange(Bounds.Min.Z, Bounds.Max.Z));
+		TestRoundTrip(MakeBlade(RandomStream, Position), TEXT("Random blade"));
+	}
+
+	// The corners set every bit of the origin, Y straddles both words
+	for (int32 Corner = 0; Corner < 8; Corner++)
+	{
+		const FVector3f Position(
+			(Corner & 1) ? Bounds.Max.X : Bounds.Min.X,
+			(Corner & 2) ? Bounds.Max.Y : Bounds.Min.Y,
+			(Corner & 4) ? Bounds.Max.Z : Bounds.Min.Z);
+		TestRoundTrip(MakeBlade(RandomStream, Position), *FString::Printf(TEXT("Corner %d"), Corner));
+	}
+
+	// A blade at the top of the bounds decodes to the top, not wrapped around to the bottom
+	const GrassUtils::FGrassData Top = MakeBlade(RandomStream, Bounds.Max);
+	const GrassUtils::FGrassInstance Decoded = GrassUtils::UnpackCompactInstance(GrassUtils::PackCompactInstance(Top, Bounds), Bounds);
+	TestTrue(TEXT("The maximum corner decodes to itself"), Decoded.InstanceOrigin.Equals(Bounds.Max, OriginStep));
+	return true;
+}
+
+#endif
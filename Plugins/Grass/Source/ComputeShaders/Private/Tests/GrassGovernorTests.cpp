@@ -0,0 +1,139 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "GrassGovernor.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace GrassGovernorTests
+{
+	/** Governor holding the passes to 1 ms. */
+	GrassUtils::FGrassGovernor MakeGovernor()
+	{
+		GrassUtils::FGrassGovernor::FSettings Settings;
+		Settings.TargetMs = 1.0f;
+		return GrassUtils::FGrassGovernor(Settings);
+	}
+
+	/** Synthetic timing of the passes, proportional to the blades culled: the density and the area within the cutoff. */
+	float GetPassesMs(const GrassUtils::FGrassGovernor& Governor, const float FullQualityMs)
+	{
+		const GrassUtils::FGrassGovernor::FState& State = Governor.GetState();
+		return FullQualityMs * State.DensityScale * FMath::Square(State.CutoffScale);
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassGovernorConvergenceTest, "Grass.Governor.Convergence",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassGovernorConvergenceTest::RunTest(const FString& Parameters)
+{
+	for (const float FullQualityMs : { 1.5f, 3.0f, 6.0f, 10.0f })
+	{
+		GrassUtils::FGrassGovernor Governor = GrassGovernorTests::MakeGovernor();
+		const float Band = Governor.GetSettings().HysteresisBand;
+		for (int32 Frame = 0; Frame < 500; Frame++)
+		{
+			Governor.AddSample(GrassGovernorTests::GetPassesMs(Governor, FullQualityMs));
+		}
+
+		// Once within the band the quality stays where it is
+		const GrassUtils::FGrassGovernor::FState Settled = Governor.GetState();
+		for (int32 Frame = 0; Frame < 100; Frame++)
+		{
+			Governor.AddSample(GrassGovernorTests::GetPassesMs(Governor, FullQualityMs));
+		}
+		TestTrue(FString::Printf(TEXT("%.1f ms at full quality settles within the band"), FullQualityMs),
+			FMath::Abs(Governor.GetState().SmoothedMs - 1.0f) <= Band);
+		TestEqual(FString::Printf(TEXT("%.1f ms at full quality settles"), FullQualityMs), Governor.GetState().Quality, Settled.Quality);
+
+		// The quality comes back once the load goes away
+		for (int32 Frame = 0; Frame < 500; Frame++)
+		{
+			Governor.AddSample(GrassGovernorTests::GetPassesMs(Governor, 0.5f));
+		}
+		TestEqual(TEXT("The quality is recovered"), Governor.GetState().Quality, 1.0f);
+		TestEqual(TEXT("The density is recovered"), Governor.GetState().DensityScale, 1.0f);
+		TestEqual(TEXT("The cutoff is recovered"), Governor.GetState().CutoffScale, 1.0f);
+		TestEqual(TEXT("The LOD bias is recovered"), Governor.GetState().LodBias, 0.0f);
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassGovernorDeadBandTest, "Grass.Governor.DeadBand",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassGovernorDeadBandTest::RunTest(const FString& Parameters)
+{
+	GrassUtils::FGrassGovernor Governor = GrassGovernorTests::MakeGovernor();
+	const float Band = Governor.GetSettings().HysteresisBand;
+
+	// Timings wandering around the target inside the band leave the grass untouched
+	FRandomStream RandomStream(0x676f7665);
+	for (int32 Frame = 0; Frame < 300; Frame++)
+	{
+		Governor.AddSample(1.0f + RandomStream.FRandRange(-0.9f, 0.9f) * Band);
+	}
+	TestEqual(TEXT("The quality doesn't move inside the band"), Governor.GetState().Quality, 1.0f);
+
+	// A single spike is smoothed out
+	for (int32 Frame = 0; Frame < 50; Frame++)
+	{
+		Governor.AddSample(1.0f);
+	}
+	Governor.AddSample(1.0f + 5.0f * Band);
+	TestEqual(TEXT("A spike within the smoothing doesn't move the quality"), Governor.GetState().Quality, 1.0f);
+
+	// Disabled, the samples are ignored
+	GrassUtils::FGrassGovernor Disabled;
+	Disabled.AddSample(100.0f);
+	TestEqual(TEXT("A disabled governor keeps the full quality"), Disabled.GetState().Quality, 1.0f);
+	TestEqual(TEXT("A disabled governor takes no sample"), Disabled.GetState().NumSamples, 0u);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassGovernorKnobOrderTest, "Grass.Governor.KnobOrder",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassGovernorKnobOrderTest::RunTest(const FString& Parameters)
+{
+	GrassUtils::FGrassGovernor Governor = GrassGovernorTests::MakeGovernor();
+	GrassUtils::FGrassGovernor::FSettings Settings = Governor.GetSettings();
+	Settings.Gain = 0.01f;
+	Governor.SetSettings(Settings);
+
+	// A load the governor can't meet walks the quality all the way down
+	bool bDensityGave = false;
+	bool bCutoffGave = false;
+	float LastQuality = 1.0f;
+	for (int32 Frame = 0; Frame < 2000 && Governor.GetState().Quality > 0.0f; Frame++)
+	{
+		Governor.AddSample(1.2f);
+		const GrassUtils::FGrassGovernor::FState& State = Governor.GetState();
+		TestTrue(TEXT("The quality only goes down under a steady overload"), State.Quality <= LastQuality);
+		LastQuality = State.Quality;
+
+		bDensityGave |= State.DensityScale < 1.0f;
+		bCutoffGave |= State.CutoffScale < 1.0f;
+		if (State.CutoffScale < 1.0f)
+		{
+			TestEqual(TEXT("The cutoff only gives once the density is at its lowest"), State.DensityScale, Settings.MinDensityScale);
+			TestEqual(TEXT("The LOD bias is at its lowest with the density"), State.LodBias, Settings.MinLodBias);
+		}
+		if (State.DensityScale == 1.0f)
+		{
+			TestTrue(TEXT("The LOD bias follows the density"), FMath::Abs(State.LodBias) <= 0.125f);
+		}
+		else if (State.LodBias == 0.0f)
+		{
+			TestTrue(TEXT("The density follows the LOD bias"), State.DensityScale >= 1.0f - 2.0f / 64.0f);
+		}
+	}
+	TestTrue(TEXT("The density gave"), bDensityGave);
+	TestTrue(TEXT("The cutoff gave"), bCutoffGave);
+	TestEqual(TEXT("The quality bottoms out"), Governor.GetState().Quality, 0.0f);
+	TestEqual(TEXT("The cutoff bottoms out"), Governor.GetState().CutoffScale, Settings.MinCutoffScale);
+	return true;
+}
+
+#endif
@@ -0,0 +1,403 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "GrassLod.h"
+#include "Algo/Reverse.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace GrassLodTests
+{
+	constexpr float BladeHeight = 100.0f;
+
+	/** Policy and view for which a blade of BladeHeight at distance D has BladeHeight / D as its squared LOD step. */
+	GrassUtils::FGrassLodPolicy MakeUnitPolicy(GrassUtils::FGrassLodView& OutView)
+	{
+		GrassUtils::FGrassLodPolicy::FSettings Settings;
+		Settings.MinMaxLod = FUintVector2(0, MAX_LOD_BUCKETS - 1);
+		Settings.BladeHeightRange = FVector2f(BladeHeight, BladeHeight);
+		Settings.CutoffDistance = 1000.0f;
+		Settings.MaxPixelError = 1.0f;
+
+		OutView = GrassUtils::FGrassLodView();
+		OutView.ScreenScale = 1.0f / LOD_CURVATURE_ERROR_SCALE;
+		return GrassUtils::FGrassLodPolicy(Settings);
+	}
+
+	/** Distance along X at which a blade of BladeHeight is in the middle of the given LOD step. */
+	FVector3f GetBladePosition(const float Step)
+	{
+		return FVector3f(BladeHeight / FMath::Square(Step + 0.5f), 0.0f, 0.0f);
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassLodBucketBladesReferenceTest, "Grass.Lod.BucketBladesReference",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassLodBucketBladesReferenceTest::RunTest(const FString& Parameters)
+{
+	GrassUtils::FGrassLodView View;
+	const GrassUtils::FGrassLodPolicy Policy = GrassLodTests::MakeUnitPolicy(View);
+
+	// Buckets 2, 0, 5, 2, culled past the cutoff, 0, 7 (clamped from the closest blade), 2
+	const TArray<FVector3f> Positions = {
+		GrassLodTests::GetBladePosition(2.0f),
+		GrassLodTests::GetBladePosition(0.0f),
+		GrassLodTests::GetBladePosition(5.0f),
+		GrassLodTests::GetBladePosition(2.0f),
+		FVector3f(2000.0f, 0.0f, 0.0f),
+		GrassLodTests::GetBladePosition(0.0f),
+		FVector3f(0.5f, 0.0f, 0.0f),
+		GrassLodTests::GetBladePosition(2.0f),
+	};
+	TArray<float> Heights;
+	Heights.Init(GrassLodTests::BladeHeight, Positions.Num());
+
+	GrassUtils::FLodBucketingResult Result;
+	GrassUtils::BucketBladesReference(Positions, Heights, Policy, View, Result);
+
+	const uint32 ExpectedCounts[MAX_LOD_BUCKETS] = { 2, 0, 3, 0, 0, 1, 0, 1 };
+	const uint32 ExpectedOffsets[MAX_LOD_BUCKETS] = { 0, 2, 2, 5, 5, 5, 6, 6 };
+	for (uint32 Bucket = 0; Bucket < MAX_LOD_BUCKETS; Bucket++)
+	{
+		TestEqual(FString::Printf(TEXT("Count of bucket %u"), Bucket), Result.BucketCounts[Bucket], ExpectedCounts[Bucket]);
+		TestEqual(FString::Printf(TEXT("Offset of bucket %u"), Bucket), Result.BucketOffsets[Bucket], ExpectedOffsets[Bucket]);
+	}
+
+	// The buckets are contiguous and keep the input order inside each bucket
+	const TArray<int32> ExpectedSlots = { 2, 0, 5, 3, INDEX_NONE, 1, 6, 4 };
+	TestEqual(TEXT("Slot of every blade"), Result.InstanceSlots, ExpectedSlots);
+
+	for (const uint32 Bin : Result.DistanceBins)
+	{
+		TestEqual(TEXT("Every blade is in bin 0 without the distance bins"), Bin, 0u);
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassLodBucketBladesReferenceBinsTest, "Grass.Lod.BucketBladesReferenceDistanceBins",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassLodBucketBladesReferenceBinsTest::RunTest(const FString& Parameters)
+{
+	GrassUtils::FGrassLodView View;
+	const GrassUtils::FGrassLodPolicy Policy = GrassLodTests::MakeUnitPolicy(View);
+
+	// Bucket 0 in bins 3, 0 and 1 of the cutoff distance, then a blade of bucket 2 in bin 0
+	const TArray<FVector3f> Positions = {
+		FVector3f(900.0f, 0.0f, 0.0f),
+		FVector3f(150.0f, 0.0f, 0.0f),
+		FVector3f(600.0f, 0.0f, 0.0f),
+		GrassLodTests::GetBladePosition(2.0f),
+	};
+	TArray<float> Heights;
+	Heights.Init(GrassLodTests::BladeHeight, Positions.Num());
+
+	GrassUtils::FLodBucketingResult Result;
+	GrassUtils::BucketBladesReference(Positions, Heights, Policy, View, Result, true);
+
+	TestEqual(TEXT("Count of bucket 0"), Result.BucketCounts[0], 3u);
+	TestEqual(TEXT("Count of bucket 2"), Result.BucketCounts[2], 1u);
+	TestEqual(TEXT("Offset of bucket 2"), Result.BucketOffsets[2], 3u);
+	TestEqual(TEXT("Offset of the last bucket"), Result.BucketOffsets[MAX_LOD_BUCKETS - 1], 4u);
+
+	const TArray<uint32> ExpectedBins = { 3, 0, 1, 0 };
+	TestEqual(TEXT("Distance bin of every blade"), Result.DistanceBins, ExpectedBins);
+
+	// The blades of bucket 0 are laid out near to far
+	const TArray<int32> ExpectedSlots = { 2, 0, 1, 3 };
+	TestEqual(TEXT("Slot of every blade"), Result.InstanceSlots, ExpectedSlots);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassLodDistanceBinOrderTest, "Grass.Lod.DistanceBinOrder",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassLodDistanceBinOrderTest::RunTest(const FString& Parameters)
+{
+	GrassUtils::FGrassLodView View;
+	const GrassUtils::FGrassLodPolicy Policy = GrassLodTests::MakeUnitPolicy(View);
+
+	// Blades all over the cutoff distance, some past it
+	FRandomStream RandomStream(0x62696e73);
+	TArray<FVector3f> Positions;
+	for (int32 Index = 0; Index < 512; Index++)
+	{
+		Positions.Add(FVector3f(RandomStream.FRandRange(-1100.0f, 1100.0f), RandomStream.FRandRange(-1100.0f, 1100.0f), 0.0f));
+	}
+	TArray<float> Heights;
+	Heights.Init(GrassLodTests::BladeHeight, Positions.Num());
+
+	GrassUtils::FLodBucketingResult Reference;
+	GrassUtils::BucketBladesReference(Positions, Heights, Policy, View, Reference, true);
+
+	// The layout read back from the GPU, built from the reference slots
+	const auto GetBucket = [&Reference](const uint32 Slot)
+	{
+		uint32 Bucket = 0;
+		while (Slot >= Reference.BucketOffsets[Bucket] + Reference.BucketCounts[Bucket])
+		{
+			Bucket++;
+		}
+		return Bucket;
+	};
+	TArray<int32> InstanceBlades;
+	TArray<uint32> InstanceBuckets;
+	for (int32 Blade = 0; Blade < Reference.InstanceSlots.Num(); Blade++)
+	{
+		const int32 Slot = Reference.InstanceSlots[Blade];
+		if (Slot != INDEX_NONE)
+		{
+			InstanceBlades.SetNum(FMath::Max(InstanceBlades.Num(), Slot + 1));
+			InstanceBuckets.SetNum(FMath::Max(InstanceBuckets.Num(), Slot + 1));
+			InstanceBlades[Slot] = Blade;
+			InstanceBuckets[Slot] = GetBucket(Slot);
+		}
+	}
+	TestTrue(TEXT("Some blades are culled"), InstanceBlades.Num() < Positions.Num());
+	TestTrue(TEXT("The reference layout is valid"), GrassUtils::ValidateDistanceBinOrder(Reference, InstanceBlades, InstanceBuckets));
+
+	// Two instances of a bucket in different bins, the first one nearer
+	int32 Near = INDEX_NONE;
+	int32 Far = INDEX_NONE;
+	for (int32 Instance = 1; Instance < InstanceBlades.Num() && Far == INDEX_NONE; Instance++)
+	{
+		if (InstanceBuckets[Instance] == InstanceBuckets[Instance - 1]
+			&& Reference.DistanceBins[InstanceBlades[Instance]] > Reference.DistanceBins[InstanceBlades[Instance - 1]])
+		{
+			Near = Instance - 1;
+			Far = Instance;
+		}
+	}
+	if (!TestTrue(TEXT("A bucket spans several bins"), Far != INDEX_NONE))
+		return false;
+
+	// The atomics of the GPU order the blades of a bin at random
+	{
+		TArray<int32> Blades = InstanceBlades;
+		int32 First = Far;
+		while (First + 1 < Blades.Num() && InstanceBuckets[First + 1] == InstanceBuckets[Far]
+			&& Reference.DistanceBins[Blades[First + 1]] == Reference.DistanceBins[Blades[Far]])
+		{
+			First++;
+		}
+		TArrayView<int32> Bin = MakeArrayView(Blades).Slice(Far, First - Far + 1);
+		Algo::Reverse(Bin);
+		TestTrue(TEXT("The order inside a bin doesn't matter"), GrassUtils::ValidateDistanceBinOrder(Reference, Blades, InstanceBuckets));
+	}
+	{
+		TArray<int32> Blades = InstanceBlades;
+		Swap(Blades[Near], Blades[Far]);
+		TestFalse(TEXT("A far blade before a near one is rejected"), GrassUtils::ValidateDistanceBinOrder(Reference, Blades, InstanceBuckets));
+	}
+	{
+		TArray<uint32> Buckets = InstanceBuckets;
+		Buckets[Far] = (Buckets[Far] + 1) % MAX_LOD_BUCKETS;
+		TestFalse(TEXT("A blade in another bucket is rejected"), GrassUtils::ValidateDistanceBinOrder(Reference, InstanceBlades, Buckets));
+	}
+	{
+		TArray<int32> Blades = InstanceBlades;
+		Blades[Far] = Blades[Near];
+		TestFalse(TEXT("A blade written twice is rejected"), GrassUtils::ValidateDistanceBinOrder(Reference, Blades, InstanceBuckets));
+	}
+	{
+		TArray<int32> Blades = InstanceBlades;
+		Blades[Far] = Reference.InstanceSlots.IndexOfByKey(INDEX_NONE);
+		TestFalse(TEXT("A culled blade is rejected"), GrassUtils::ValidateDistanceBinOrder(Reference, Blades, InstanceBuckets));
+	}
+	{
+		TArray<int32> Blades = InstanceBlades;
+		TArray<uint32> Buckets = InstanceBuckets;
+		Blades.Pop();
+		Buckets.Pop();
+		TestFalse(TEXT("A missing blade is rejected"), GrassUtils::ValidateDistanceBinOrder(Reference, Blades, Buckets));
+		TestFalse(TEXT("Mismatched arrays are rejected"), GrassUtils::ValidateDistanceBinOrder(Reference, Blades, InstanceBuckets));
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassLodPolicyHysteresisTest, "Grass.Lod.PolicyHysteresis",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassLodPolicyHysteresisTest::RunTest(const FString& Parameters)
+{
+	TestEqual(TEXT("A step inside the band below keeps the previous one"), GrassUtils::FGrassLodPolicy::ApplyHysteresis(1.8f, 2, 0.25f), 2u);
+	TestEqual(TEXT("A step past the band below moves down"), GrassUtils::FGrassLodPolicy::ApplyHysteresis(1.7f, 2, 0.25f), 1u);
+	TestEqual(TEXT("A step inside the band above keeps the previous one"), GrassUtils::FGrassLodPolicy::ApplyHysteresis(3.2f, 2, 0.25f), 2u);
+	TestEqual(TEXT("A step past the band above moves up"), GrassUtils::FGrassLodPolicy::ApplyHysteresis(3.3f, 2, 0.25f), 3u);
+
+	GrassUtils::FGrassLodView View;
+	GrassUtils::FGrassLodPolicy Policy = GrassLodTests::MakeUnitPolicy(View);
+
+	// A section reduced to a point at the distance of the given step, its range widened by half the band on both sides
+	uint32 FrameNumber = 0;
+	const auto SelectAtStep = [&Policy, &View, &FrameNumber](const uint64 SectionKey, const float Step)
+	{
+		const FVector Position(GrassLodTests::BladeHeight / FMath::Square(Step), 0.0, 0.0);
+		return Policy.SelectBucketRange(SectionKey, View, FBox(Position, Position), FrameNumber++);
+	};
+
+	TestEqual(TEXT("The first selection quantizes the step"), SelectAtStep(1, 2.5f), FUintVector2(2, 2));
+	TestEqual(TEXT("Moving up within the band keeps the range"), SelectAtStep(1, 3.05f), FUintVector2(2, 2));
+	TestEqual(TEXT("Moving up past the band changes the range"), SelectAtStep(1, 3.5f), FUintVector2(3, 3));
+	TestEqual(TEXT("Moving back down within the band keeps the range"), SelectAtStep(1, 2.9f), FUintVector2(3, 3));
+	TestEqual(TEXT("Moving down past the band changes the range"), SelectAtStep(1, 2.5f), FUintVector2(2, 2));
+
+	// Without history the same step across the boundary selects the finer bucket right away
+	TestEqual(TEXT("The history is kept per section"), SelectAtStep(2, 3.05f), FUintVector2(2, 3));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassLodPolicyClampTest, "Grass.Lod.PolicyClamp",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassLodPolicyClampTest::RunTest(const FString& Parameters)
+{
+	GrassUtils::FGrassLodView View;
+	View.ScreenScale = 1.0f / LOD_CURVATURE_ERROR_SCALE;
+
+	GrassUtils::FGrassLodPolicy::FSettings Settings;
+	Settings.MinMaxLod = FUintVector2(1, 5);
+	Settings.BladeHeightRange = FVector2f(GrassLodTests::BladeHeight, GrassLodTests::BladeHeight);
+	Settings.CutoffDistance = 10000.0f;
+	Settings.MaxPixelError = 1.0f;
+	GrassUtils::FGrassLodPolicy Policy(Settings);
+
+	// Steps of 10 and 0.1, both first selections and selections with a history
+	const FVector Near(1.0, 0.0, 0.0);
+	const FVector Far(10000.0, 0.0, 0.0);
+	for (uint32 FrameNumber = 0; FrameNumber < 2; FrameNumber++)
+	{
+		TestEqual(TEXT("The finest range is clamped to the maximum LOD"),
+			Policy.SelectBucketRange(1, View, FBox(Near, Near), FrameNumber), FUintVector2(4, 4));
+		TestEqual(TEXT("The coarsest range is clamped to the minimum LOD"),
+			Policy.SelectBucketRange(2, View, FBox(Far, Far), FrameNumber), FUintVector2(0, 0));
+		TestEqual(TEXT("A section spanning every LOD is drawn with all the buckets"),
+			Policy.SelectBucketRange(3, View, FBox(Near, Far), FrameNumber), FUintVector2(0, 4));
+	}
+
+	// The blades are dithered by up to half the band and clamped to the same range
+	for (uint32 BladeIndex = 0; BladeIndex < 1024; BladeIndex++)
+	{
+		const float Dither = GrassUtils::ComputeLodDither(BladeIndex, Settings.HysteresisBand);
+		TestTrue(TEXT("The dither stays in the band"), Dither >= -0.5f * Settings.HysteresisBand && Dither < 0.5f * Settings.HysteresisBand);
+
+		const float LodScreenScale = Policy.GetLodScreenScale(View);
+		TestEqual(TEXT("A dithered blade is clamped to the maximum LOD"),
+			GrassUtils::ComputeLodBucket(1.0f, GrassLodTests::BladeHeight, LodScreenScale, 0.0f, Settings.MinMaxLod, Dither), 4u);
+		TestEqual(TEXT("A dithered blade is clamped to the minimum LOD"),
+			GrassUtils::ComputeLodBucket(10000.0f, GrassLodTests::BladeHeight, LodScreenScale, 0.0f, Settings.MinMaxLod, Dither), 0u);
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassLodDitherTest, "Grass.Lod.Dither",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassLodDitherTest::RunTest(const FString& Parameters)
+{
+	GrassUtils::FGrassLodView View;
+	const GrassUtils::FGrassLodPolicy Policy = GrassLodTests::MakeUnitPolicy(View);
+	const float HysteresisBand = Policy.GetSettings().HysteresisBand;
+	const float LodScreenScale = Policy.GetLodScreenScale(View);
+
+	// Blades at a step of 2.95 cross into bucket 3 once their dither is past 0.05, 30% of them with a band of 0.25
+	constexpr int32 NumBlades = 4096;
+	const float Distance = GrassLodTests::BladeHeight / FMath::Square(2.95f);
+	int32 NumFiner = 0;
+	for (int32 BladeIndex = 0; BladeIndex < NumBlades; BladeIndex++)
+	{
+		const uint32 Bucket = GrassUtils::ComputeLodBucket(Distance, GrassLodTests::BladeHeight, LodScreenScale, 0.0f,
+			Policy.GetSettings().MinMaxLod, GrassUtils::ComputeLodDither(BladeIndex, HysteresisBand));
+		TestTrue(TEXT("The blades stay in the buckets next to the boundary"), Bucket == 2 || Bucket == 3);
+		NumFiner += Bucket == 3 ? 1 : 0;
+	}
+	const float FinerFraction = static_cast<float>(NumFiner) / NumBlades;
+	TestTrue(FString::Printf(TEXT("The blades cross the boundary spread over the band (%.3f)"), FinerFraction),
+		FMath::IsNearlyEqual(FinerFraction, (0.5f * HysteresisBand - 0.05f) / HysteresisBand, 0.05f));
+
+	// Without a band every blade switches at the same distance
+	for (int32 BladeIndex = 0; BladeIndex < 64; BladeIndex++)
+	{
+		TestEqual(TEXT("No band, no dither"), GrassUtils::ComputeLodDither(BladeIndex, 0.0f), 0.0f);
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassLodDensityFalloffTest, "Grass.Lod.DensityFalloff",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassLodDensityFalloffTest::RunTest(const FString& Parameters)
+{
+	GrassUtils::FGrassDensityFalloff Falloff;
+	Falloff.StartDistance = 200.0f;
+	Falloff.EndDistance = 600.0f;
+	Falloff.MinKeepFraction = 0.25f;
+	const FVector3f DensityFalloff = Falloff.GetShaderParameter();
+
+	TestEqual(TEXT("Every blade is kept before the start"), GrassUtils::ComputeDensityKeepFraction(100.0f, DensityFalloff), 1.0f);
+	TestTrue(TEXT("The fraction goes down linearly"), FMath::IsNearlyEqual(GrassUtils::ComputeDensityKeepFraction(400.0f, DensityFalloff), 0.625f, 1.0e-5f));
+	TestTrue(TEXT("The minimum is kept past the end"), FMath::IsNearlyEqual(GrassUtils::ComputeDensityKeepFraction(5000.0f, DensityFalloff), 0.25f, 1.0e-5f));
+
+	// The kept blades are a stable, nested subset of the expected size
+	constexpr uint32 NumBlades = 16384;
+	for (const float KeepFraction : { 0.0f, 0.1f, 0.25f, 0.5f, 0.9f, 1.0f })
+	{
+		uint32 NumKept = 0;
+		for (uint32 Index = 0; Index < NumBlades; Index++)
+		{
+			const bool bKept = GrassUtils::IsBladeKept(Index, KeepFraction);
+			NumKept += bKept ? 1 : 0;
+			if (bKept && !GrassUtils::IsBladeKept(Index, FMath::Min(KeepFraction + 0.05f, 1.0f)))
+			{
+				AddError(FString::Printf(TEXT("Blade %u kept at %f isn't kept at a larger fraction"), Index, KeepFraction));
+			}
+		}
+		TestTrue(FString::Printf(TEXT("About %f of the blades are kept"), KeepFraction),
+			FMath::IsNearlyEqual(static_cast<float>(NumKept) / NumBlades, KeepFraction, 0.02f));
+	}
+	TestFalse(TEXT("No blade is kept at 0"), GrassUtils::IsBladeKept(12345, 0.0f));
+	TestTrue(TEXT("Every blade is kept at 1"), GrassUtils::IsBladeKept(0xffffff, 1.0f));
+
+	TestEqual(TEXT("The kept blades are widened by the inverse fraction"), GrassUtils::ComputeDensityWidthScale(0.25f), 4.0f);
+	TestTrue(TEXT("The width scale stays finite"), FMath::IsFinite(GrassUtils::ComputeDensityWidthScale(0.0f)));
+
+	// The reference culls and widens the blades as the cull pass does
+	GrassUtils::FGrassLodView View;
+	GrassUtils::FGrassLodPolicy::FSettings Settings = GrassLodTests::MakeUnitPolicy(View).GetSettings();
+	Settings.DensityFalloff = Falloff;
+	const GrassUtils::FGrassLodPolicy Policy(Settings);
+
+	TArray<FVector3f> Positions;
+	for (uint32 Index = 0; Index < NumBlades; Index++)
+	{
+		Positions.Add(FVector3f(Index % 2 == 0 ? 150.0f : 800.0f, 0.0f, 0.0f));
+	}
+	TArray<float> Heights;
+	Heights.Init(GrassLodTests::BladeHeight, Positions.Num());
+
+	GrassUtils::FLodBucketingResult Result;
+	GrassUtils::BucketBladesReference(Positions, Heights, Policy, View, Result);
+
+	uint32 NumFarKept = 0;
+	for (uint32 Index = 0; Index < NumBlades; Index++)
+	{
+		const bool bKept = Result.InstanceSlots[Index] != INDEX_NONE;
+		if (Index % 2 == 0)
+		{
+			TestTrue(TEXT("The blades before the start are all kept"), bKept);
+			TestEqual(TEXT("The blades before the start keep their width"), Result.WidthScales[Index], 1.0f);
+			continue;
+		}
+
+		TestEqual(TEXT("The reference keeps the blades the hash keeps"), bKept, GrassUtils::IsBladeKept(Index, 0.25f));
+		TestTrue(TEXT("The kept blades past the end are widened"),
+			FMath::IsNearlyEqual(Result.WidthScales[Index], bKept ? 4.0f : 1.0f, 1.0e-3f));
+		NumFarKept += bKept ? 1 : 0;
+	}
+	TestTrue(TEXT("The far field covers the same area"),
+		FMath::IsNearlyEqual(static_cast<float>(NumFarKept) * 4.0f / (NumBlades / 2), 1.0f, 0.1f));
+	return true;
+}
+
+#endif
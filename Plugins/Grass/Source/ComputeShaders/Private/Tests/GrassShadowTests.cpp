@@ -0,0 +1,50 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "GrassInstancingSceneProxy.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassShadowMatchTest, "Grass.Shadow.Match",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassShadowMatchTest::RunTest(const FString& Parameters)
+{
+	// Two cascades of a directional light, the second twice as wide
+	GrassUtils::FShadowViewIdentity Cascade0;
+	Cascade0.Direction = FVector3f(0.0f, 0.6f, -0.8f);
+	Cascade0.ProjectionScale = 1.0f / 2000.0f;
+	GrassUtils::FShadowViewIdentity Cascade1 = Cascade0;
+	Cascade1.ProjectionScale = 1.0f / 4000.0f;
+
+	TestTrue(TEXT("A shadow matches itself"), GrassUtils::ComputeShadowMatchCost(Cascade0, Cascade0) < 1.0e-4f);
+	TestTrue(TEXT("The cascades of a light don't match each other"), GrassUtils::ComputeShadowMatchCost(Cascade0, Cascade1) >= 1.0f);
+
+	// A cascade follows the camera and its extent breathes a little with it
+	GrassUtils::FShadowViewIdentity MovedCascade0 = Cascade0;
+	MovedCascade0.Origin = FVector(3000.0, 0.0, 0.0);
+	MovedCascade0.ProjectionScale *= 1.1f;
+	TestTrue(TEXT("A cascade matches itself as the camera moves"), GrassUtils::ComputeShadowMatchCost(Cascade0, MovedCascade0) < 1.0f);
+	TestTrue(TEXT("It is closer to itself than to the next cascade"),
+		GrassUtils::ComputeShadowMatchCost(Cascade0, MovedCascade0) < GrassUtils::ComputeShadowMatchCost(Cascade1, MovedCascade0));
+
+	// The faces of a point light only differ by their direction
+	GrassUtils::FShadowViewIdentity FaceX;
+	FaceX.bPerspective = true;
+	FaceX.Origin = FVector(100.0, 200.0, 300.0);
+	FaceX.Direction = FVector3f(1.0f, 0.0f, 0.0f);
+	GrassUtils::FShadowViewIdentity FaceY = FaceX;
+	FaceY.Direction = FVector3f(0.0f, 1.0f, 0.0f);
+	TestTrue(TEXT("The faces of a point light don't match each other"), GrassUtils::ComputeShadowMatchCost(FaceX, FaceY) >= 1.0f);
+	TestTrue(TEXT("A perspective shadow doesn't match a cascade"), GrassUtils::ComputeShadowMatchCost(FaceX, Cascade0) >= 1.0f);
+
+	// A perspective shadow stays at its light
+	GrassUtils::FShadowViewIdentity MovedFaceX = FaceX;
+	MovedFaceX.Origin += FVector(20.0, 0.0, 0.0);
+	TestTrue(TEXT("A slowly moving light matches itself"), GrassUtils::ComputeShadowMatchCost(FaceX, MovedFaceX) < 1.0f);
+	MovedFaceX.Origin += FVector(1000.0, 0.0, 0.0);
+	TestTrue(TEXT("Two lights far apart don't match"), GrassUtils::ComputeShadowMatchCost(FaceX, MovedFaceX) >= 1.0f);
+	return true;
+}
+
+#endif
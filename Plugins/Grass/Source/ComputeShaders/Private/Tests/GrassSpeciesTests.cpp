@@ -0,0 +1,116 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "GrassSpecies.h"
+#include "GrassFarField.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassSpeciesPackingTest, "Grass.Species.Packing",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassSpeciesPackingTest::RunTest(const FString& Parameters)
+{
+	// The species bits sit between the blade index and BLADE_BENT_BY_STATE
+	TestEqual(TEXT("The blade index keeps every bit below the species"), GRASS_BLADE_INDEX_MASK, 0x1FFFFFFFu);
+	TestEqual(TEXT("The species and the blade index leave only the bend flag"),
+		GRASS_BLADE_INDEX_MASK | ((MAX_GRASS_SPECIES - 1u) << GRASS_SPECIES_SHIFT), ~BLADE_BENT_BY_STATE);
+
+	FRandomStream RandomStream(0x73706563);
+	TArray<uint32> BladeIndices = { 0u, 1u, GRASS_BLADE_INDEX_MASK - 1, GRASS_BLADE_INDEX_MASK };
+	for (int32 Iteration = 0; Iteration < 64; Iteration++)
+	{
+		BladeIndices.Add(static_cast<uint32>(RandomStream.GetUnsignedInt()) & GRASS_BLADE_INDEX_MASK);
+	}
+
+	for (uint32 Species = 0; Species < MAX_GRASS_SPECIES; Species++)
+	{
+		for (const uint32 BladeIndex : BladeIndices)
+		{
+			const uint32 Packed = GrassUtils::PackGrassBladeIndex(BladeIndex, Species);
+			TestEqual(TEXT("The blade index is kept"), GrassUtils::GetGrassBladeIndex(Packed), BladeIndex);
+			TestEqual(TEXT("The species is kept"), GrassUtils::GetGrassSpecies(Packed, MAX_GRASS_SPECIES), Species);
+			TestEqual(TEXT("The bend flag is left clear"), Packed & BLADE_BENT_BY_STATE, 0u);
+
+			// The cull pass flags the blades bent by their state on the packed index, the flag hides neither field
+			const uint32 Bent = Packed | BLADE_BENT_BY_STATE;
+			TestEqual(TEXT("The bend flag doesn't change the blade index"), GrassUtils::GetGrassBladeIndex(Bent), BladeIndex);
+			TestEqual(TEXT("The bend flag doesn't change the species"), GrassUtils::GetGrassSpecies(Bent, MAX_GRASS_SPECIES), Species);
+		}
+	}
+
+	// An index past the mask is wrapped rather than spilling into the species
+	TestEqual(TEXT("A blade index past the mask doesn't change the species"),
+		GrassUtils::GetGrassSpecies(GrassUtils::PackGrassBladeIndex(GRASS_BLADE_INDEX_MASK + 1, 1), MAX_GRASS_SPECIES), 1u);
+
+	// The species are clamped to those of the field
+	const uint32 LastSpecies = GrassUtils::PackGrassBladeIndex(7, MAX_GRASS_SPECIES - 1);
+	TestEqual(TEXT("A species past the field falls on its last one"), GrassUtils::GetGrassSpecies(LastSpecies, 2), 1u);
+	TestEqual(TEXT("A field of a single species draws everything as it"), GrassUtils::GetGrassSpecies(LastSpecies, 1), 0u);
+	TestEqual(TEXT("A field without species draws everything as the first one"), GrassUtils::GetGrassSpecies(LastSpecies, 0), 0u);
+
+	TestEqual(TEXT("The draws of a species follow each other"), GrassUtils::GetGrassDrawIndex(1, 0), GrassUtils::GetGrassDrawIndex(0, MAX_LOD_BUCKETS - 1) + 1);
+	TestEqual(TEXT("The last draw fills the draws"), GrassUtils::GetGrassDrawIndex(MAX_GRASS_SPECIES - 1, MAX_LOD_BUCKETS - 1), MAX_GRASS_DRAWS - 1u);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassSpeciesPickTest, "Grass.Species.Pick",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassSpeciesPickTest::RunTest(const FString& Parameters)
+{
+	const TArray<float> Weights = { 1.0f, 0.0f, 3.0f, -2.0f };
+	TestEqual(TEXT("The start of the range falls on the first weighted species"), GrassUtils::PickGrassSpecies(Weights, 0.0f), 0u);
+	TestEqual(TEXT("The end of the range falls on the last weighted species"), GrassUtils::PickGrassSpecies(Weights, 0.99999994f), 2u);
+	const TArray<float> NoWeights = { 0.0f, -1.0f };
+	TestEqual(TEXT("Without any positive weight the first species is picked"), GrassUtils::PickGrassSpecies(NoWeights, 0.5f), 0u);
+
+	// Each species gets a share of the blades proportional to its weight, none without one
+	uint32 Counts[MAX_GRASS_SPECIES] = {};
+	FRandomStream RandomStream(0x7069636b);
+	const int32 NumBlades = 40000;
+	for (int32 Blade = 0; Blade < NumBlades; Blade++)
+	{
+		Counts[GrassUtils::PickGrassSpecies(Weights, RandomStream.FRand())]++;
+	}
+	TestTrue(TEXT("The first species gets a quarter of the blades"), FMath::IsNearlyEqual(Counts[0] / static_cast<float>(NumBlades), 0.25f, 0.02f));
+	TestEqual(TEXT("A species without weight gets no blade"), Counts[1], 0u);
+	TestTrue(TEXT("The third species gets three quarters of the blades"), FMath::IsNearlyEqual(Counts[2] / static_cast<float>(NumBlades), 0.75f, 0.02f));
+	TestEqual(TEXT("A species of negative weight gets no blade"), Counts[3], 0u);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassSpeciesFarFieldCardsTest, "Grass.Species.FarFieldCards",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassSpeciesFarFieldCardsTest::RunTest(const FString& Parameters)
+{
+	// Two species mixed in the first cell, a single one in the second
+	const float CellSize = 100.0f;
+	TArray<GrassUtils::FPackedGrassData> Blades;
+	FRandomStream RandomStream(0x63617264);
+	for (uint32 Blade = 0; Blade < 64; Blade++)
+	{
+		const uint32 Species = Blade % 2 == 0 || Blade >= 32 ? 0 : 2;
+		const float CellX = Blade < 32 ? 0.0f : CellSize;
+		const FVector3f Position(CellX + RandomStream.FRandRange(0.0f, CellSize), RandomStream.FRandRange(0.0f, CellSize), 0.0f);
+		Blades.Emplace(GrassUtils::PackGrassBladeIndex(Blade, Species) | (Blade % 3 == 0 ? BLADE_BENT_BY_STATE : 0u),
+			Position, FVector3f::UpVector, FVector3f::ForwardVector, 10.0f, 0.4f, 0.5f);
+	}
+
+	TArray<GrassUtils::FPackedGrassData> Cards;
+	GrassUtils::BuildFarFieldCards(Blades, CellSize, Cards);
+	TestEqual(TEXT("A card per cell and species"), Cards.Num(), 3);
+
+	uint32 NumCardsBySpecies[MAX_GRASS_SPECIES] = {};
+	for (const GrassUtils::FPackedGrassData& Card : Cards)
+	{
+		NumCardsBySpecies[GrassUtils::GetGrassSpecies(Card.Index, MAX_GRASS_SPECIES)]++;
+		TestEqual(TEXT("The cards aren't bent by a state"), Card.Index & BLADE_BENT_BY_STATE, 0u);
+	}
+	TestEqual(TEXT("Both cells have a card of the first species"), NumCardsBySpecies[0], 2u);
+	TestEqual(TEXT("The cell of the second species has a card of it"), NumCardsBySpecies[2], 1u);
+	return true;
+}
+
+#endif
@@ -0,0 +1,109 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "GrassWind.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassWindVectorTest, "Grass.Wind.WindVector",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassWindVectorTest::RunTest(const FString& Parameters)
+{
+	GrassUtils::FGrassWind Wind;
+	Wind.Direction = FVector2f(0.0f, 1.0f);
+	Wind.Strength = 2.0f;
+	const FVector4f DirectionStrength = Wind.GetDirectionStrengthParameter();
+
+	// A gust without sway pushes along the wind, horizontally, scaled by the strength
+	const FVector3f Along = GrassUtils::ComputeWindVector(FVector2f(1.0f, 0.0f), DirectionStrength);
+	TestTrue(TEXT("A gust without sway pushes along the wind"), Along.Equals(FVector3f(0.0f, 2.0f, 0.0f), 1.0e-5f));
+
+	// The sway pushes across the wind at half the weight
+	const FVector3f Across = GrassUtils::ComputeWindVector(FVector2f(0.0f, 1.0f), DirectionStrength);
+	TestTrue(TEXT("The sway pushes across the wind"), Across.Equals(FVector3f(-1.0f, 0.0f, 0.0f), 1.0e-5f));
+
+	Wind.Strength = 0.0f;
+	TestFalse(TEXT("The wind is disabled at zero strength"), Wind.IsEnabled());
+	TestTrue(TEXT("A disabled wind doesn't push"),
+		GrassUtils::ComputeWindVector(FVector2f(1.0f, 1.0f), Wind.GetDirectionStrengthParameter()).IsNearlyZero());
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassWindBentUpTest, "Grass.Wind.BentUp",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassWindBentUpTest::RunTest(const FString& Parameters)
+{
+	constexpr float MaxBendAngle = 1.2f;
+	const FVector3f Up = FVector3f::UpVector;
+
+	TestEqual(TEXT("No push leaves the blade up"), GrassUtils::ComputeWindBentUp(Up, FVector3f::ZeroVector, 0.5f, MaxBendAngle), Up);
+	TestEqual(TEXT("A push along the blade leaves it up"), GrassUtils::ComputeWindBentUp(Up, FVector3f(0.0f, 0.0f, 5.0f), 0.5f, MaxBendAngle), Up);
+
+	FRandomStream RandomStream(0x77696e64);
+	for (int32 Iteration = 0; Iteration < 256; Iteration++)
+	{
+		const FVector3f BladeUp = FVector3f(RandomStream.VRand() * 0.3f + FVector::UpVector).GetSafeNormal();
+		const FVector3f Push(RandomStream.FRandRange(-4.0f, 4.0f), RandomStream.FRandRange(-4.0f, 4.0f), 0.0f);
+		const float Stiffness = RandomStream.FRand();
+
+		const FVector3f BentUp = GrassUtils::ComputeWindBentUp(BladeUp, Push, Stiffness, MaxBendAngle);
+		const float Angle = FMath::Acos(FMath::Clamp(FVector3f::DotProduct(BladeUp, BentUp), -1.0f, 1.0f));
+		TestTrue(TEXT("The length of the blade is kept"), FMath::IsNearlyEqual(BentUp.Size(), 1.0f, 1.0e-4f));
+		TestTrue(TEXT("The bend saturates at the maximum angle"), Angle <= MaxBendAngle + 1.0e-4f);
+
+		// The tip leans towards the part of the push across the blade
+		const FVector3f Across = Push - BladeUp * FVector3f::DotProduct(Push, BladeUp);
+		TestTrue(TEXT("The tip leans with the push"), FVector3f::DotProduct(BentUp - BladeUp, Across) >= -1.0e-5f);
+
+		// The stiffer blades bend less under the same push
+		const FVector3f StifferUp = GrassUtils::ComputeWindBentUp(BladeUp, Push, FMath::Min(Stiffness + 0.25f, 1.0f), MaxBendAngle);
+		TestTrue(TEXT("The stiffer blades bend less"), FVector3f::DotProduct(BladeUp, StifferUp) >= FVector3f::DotProduct(BladeUp, BentUp) - 1.0e-5f);
+
+		const FVector3f Facing = FVector3f::CrossProduct(BladeUp, FVector3f::ForwardVector).GetSafeNormal();
+		const FVector3f BentFacing = GrassUtils::ComputeWindBentFacing(Facing, BentUp);
+		TestTrue(TEXT("The facing stays orthogonal to the bent blade"), FMath::Abs(FVector3f::DotProduct(BentFacing, BentUp)) < 1.0e-4f);
+		TestTrue(TEXT("The facing stays normalized"), FMath::IsNearlyEqual(BentFacing.Size(), 1.0f, 1.0e-4f));
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrassWindGustTextureTest, "Grass.Wind.GustTexture",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FGrassWindGustTextureTest::RunTest(const FString& Parameters)
+{
+	TArray<FFloat16> Texels;
+	GrassUtils::BuildWindGustTexture(Texels);
+	TestEqual(TEXT("Two channels per texel"), Texels.Num(), WIND_GUST_TEXTURE_SIZE * WIND_GUST_TEXTURE_SIZE * 2);
+
+	for (int32 Texel = 0; Texel < Texels.Num(); Texel += 2)
+	{
+		const float Strength = Texels[Texel];
+		const float Sway = Texels[Texel + 1];
+		TestTrue(TEXT("The gust strength is in [0.25, 1]"), Strength >= 0.25f - 1.0e-3f && Strength <= 1.0f + 1.0e-3f);
+		TestTrue(TEXT("The sway is in [-1, 1]"), Sway >= -1.0f - 1.0e-3f && Sway <= 1.0f + 1.0e-3f);
+	}
+
+	// The lattice wraps, so that the texture tiles without a seam
+	for (int32 Cell = 0; Cell < WIND_GUST_NOISE_CELLS; Cell++)
+	{
+		TestEqual(TEXT("The lattice wraps along X"),
+			GrassUtils::GetWindGustLatticeValue(Cell + WIND_GUST_NOISE_CELLS, 1, 0), GrassUtils::GetWindGustLatticeValue(Cell, 1, 0));
+		TestEqual(TEXT("The lattice wraps along Y"),
+			GrassUtils::GetWindGustLatticeValue(1, Cell - WIND_GUST_NOISE_CELLS, 1), GrassUtils::GetWindGustLatticeValue(1, Cell, 1));
+	}
+
+	GrassUtils::FGrassWind Wind;
+	Wind.Direction = FVector2f(0.6f, 0.8f);
+	for (const double Time : { 0.0, 1.5, 1.0e5, 1.0e7 })
+	{
+		const FVector3f Transform = Wind.GetGustTransformParameter(Time);
+		TestTrue(TEXT("The gust offset wraps in [0, 1)"), Transform.X >= 0.0f && Transform.X < 1.0f && Transform.Y >= 0.0f && Transform.Y < 1.0f);
+		TestTrue(TEXT("The gusts are sampled per tile"), FMath::IsNearlyEqual(Transform.Z, 1.0f / Wind.GustSize));
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,175 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Algo/BinarySearch.h"
+
+namespace GrassUtils
+{
+	/** Flag set on the index of the culled blades already bent by their state, see CullInstancesCS. */
+	#define BLADE_BENT_BY_STATE 0x80000000u
+	/** Bend state offset of the sections without a state. */
+	#define NO_BEND_STATE 0xFFFFFFFFu
+
+	/**
+	 * Persistent bend of a blade, a float4 in the bend state buffer: tilt in XY, the horizontal direction the tip leans
+	 * to scaled by the bend angle in radians, and its velocity in ZW.
+	 */
+	struct FGrassBendState
+	{
+		FVector2f Tilt = FVector2f::ZeroVector;
+		FVector2f Velocity = FVector2f::ZeroVector;
+	};
+	static_assert(sizeof(FGrassBendState) == 16, "FGrassBendState must match its layout in GrassCompute.usf");
+
+	// Integrated on the GPU by IntegrateBendState in GrassUtils.ush.
+
+	/**
+	 * Tilt a push bends a blade to at rest, saturating at MaxBendAngle, the stiffer blades (Stiffness in [0, 1]) bending less.
+	 * Same response as ComputeWindBentUp, for a blade standing straight up.
+	 */
+	inline FVector2f ComputePushTilt(const FVector2f& Push, const float Stiffness, const float MaxBendAngle)
+	{
+		const float PushLength = Push.Size();
+		if (PushLength < UE_KINDA_SMALL_NUMBER)
+			return FVector2f::ZeroVector;
+
+		return Push / PushLength * (MaxBendAngle * (1.0f - FMath::Exp(-PushLength / (0.25f + FMath::Clamp(Stiffness, 0.0f, 1.0f)))));
+	}
+
+	/**
+	 * Step the bend of a blade towards Target as an underdamped spring, the stiffer blades springing back faster.
+	 * The step is clamped so that the integration stays stable through frame hitches.
+	 */
+	inline FGrassBendState IntegrateBendState(
+		const FGrassBendState& State, const FVector2f& Target, const float Stiffness, const float DeltaTime, const float MaxBendAngle)
+	{
+		const float SpringRate = 20.0f + 180.0f * FMath::Clamp(Stiffness, 0.0f, 1.0f);
+		const float Damping = 0.7f * FMath::Sqrt(SpringRate);
+		const float Step = FMath::Clamp(DeltaTime, 0.0f, 1.0f / 30.0f);
+
+		// Semi-implicit Euler: the velocity first, then the tilt with the new velocity
+		FGrassBendState Result;
+		Result.Velocity = State.Velocity + ((Target - State.Tilt) * SpringRate - State.Velocity * Damping) * Step;
+		Result.Tilt = (State.Tilt + Result.Velocity * Step).GetClampedToMaxSize(MaxBendAngle);
+		return Result;
+	}
+
+	/**
+	 * Up vector of a blade leaning by Tilt, the length of the blade is kept.
+	 */
+	inline FVector3f ComputeTiltedUp(const FVector3f& Up, const FVector2f& Tilt)
+	{
+		const float Angle = Tilt.Size();
+		const FVector3f Direction = FVector3f::VectorPlaneProject(FVector3f(Tilt.X, Tilt.Y, 0.0f), Up);
+		const float DirectionLength = Direction.Size();
+		if (Angle < UE_KINDA_SMALL_NUMBER || DirectionLength < UE_KINDA_SMALL_NUMBER)
+			return Up;
+
+		return Up * FMath::Cos(Angle) + Direction / DirectionLength * FMath::Sin(Angle);
+	}
+
+	/**
+	 * Fixed size pool of bend states, a contiguous range of the state buffer per section, keyed by section revision.
+	 * First fit on a list of free ranges kept sorted and coalesced, so that the memory stays bounded however large
+	 * the field is: a section that doesn't fit goes without a state.
+	 */
+	class FGrassBendStatePool
+	{
+	public:
+		FGrassBendStatePool() = default;
+		explicit FGrassBendStatePool(const uint32 InCapacity)
+		{
+			Reset(InCapacity);
+		}
+
+		/** Free every range and resize the pool. */
+		void Reset(const uint32 InCapacity)
+		{
+			Capacity = InCapacity;
+			NumAllocated = 0;
+			Allocations.Reset();
+			FreeRanges.Reset();
+			if (Capacity > 0)
+			{
+				FreeRanges.Add(FRange{ 0, Capacity });
+			}
+		}
+
+		uint32 GetCapacity() const { return Capacity; }
+		uint32 GetNumAllocated() const { return NumAllocated; }
+		const TMap<uint32, TPair<uint32, uint32>>& GetAllocations() const { return Allocations; }
+
+		/** First state of the range of Key, NO_BEND_STATE if it has none. */
+		uint32 Find(const uint32 Key) const
+		{
+			const TPair<uint32, uint32>* Range = Allocations.Find(Key);
+			return Range != nullptr ? Range->Key : NO_BEND_STATE;
+		}
+
+		/** Allocate Num contiguous states for Key, NO_BEND_STATE when no free range is large enough. */
+		uint32 Allocate(const uint32 Key, const uint32 Num)
+		{
+			check(!Allocations.Contains(Key));
+			if (Num == 0)
+				return NO_BEND_STATE;
+
+			for (int32 Index = 0; Index < FreeRanges.Num(); Index++)
+			{
+				FRange& Free = FreeRanges[Index];
+				if (Free.Num < Num)
+					continue;
+
+				const uint32 Offset = Free.Offset;
+				Free.Offset += Num;
+				Free.Num -= Num;
+				if (Free.Num == 0)
+				{
+					FreeRanges.RemoveAt(Index);
+				}
+
+				Allocations.Add(Key, TPair<uint32, uint32>(Offset, Num));
+				NumAllocated += Num;
+				return Offset;
+			}
+			return NO_BEND_STATE;
+		}
+
+		/** Give the range of Key back to the pool, merged with its free neighbours. */
+		void Free(const uint32 Key)
+		{
+			TPair<uint32, uint32> Range;
+			if (!Allocations.RemoveAndCopyValue(Key, Range))
+				return;
+			NumAllocated -= Range.Value;
+
+			const int32 Index = Algo::LowerBoundBy(FreeRanges, Range.Key, &FRange::Offset);
+			FreeRanges.Insert(FRange{ Range.Key, Range.Value }, Index);
+			if (Index + 1 < FreeRanges.Num() && FreeRanges[Index].Offset + FreeRanges[Index].Num == FreeRanges[Index + 1].Offset)
+			{
+				FreeRanges[Index].Num += FreeRanges[Index + 1].Num;
+				FreeRanges.RemoveAt(Index + 1);
+			}
+			if (Index > 0 && FreeRanges[Index - 1].Offset + FreeRanges[Index - 1].Num == FreeRanges[Index].Offset)
+			{
+				FreeRanges[Index - 1].Num += FreeRanges[Index].Num;
+				FreeRanges.RemoveAt(Index);
+			}
+		}
+
+	private:
+		struct FRange
+		{
+			uint32 Offset;
+			uint32 Num;
+		};
+
+		uint32 Capacity = 0;
+		uint32 NumAllocated = 0;
+		/** Offset and size of the range of each key. */
+		TMap<uint32, TPair<uint32, uint32>> Allocations;
+		/** Sorted by offset, never adjacent. */
+		TArray<FRange> FreeRanges;
+	};
+}
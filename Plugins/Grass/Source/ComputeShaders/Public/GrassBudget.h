@@ -0,0 +1,96 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GrassLod.h"
+
+namespace GrassUtils
+{
+	/** Steps the fraction of the blades granted to a section is quantized to, so that the culling cache survives small changes. */
+	#define BUDGET_KEEP_FRACTION_STEPS 64
+
+	/** Instances a section asks for in a view, and how much it matters to the view. */
+	struct FGrassBudgetRequest
+	{
+		/** Upper bound of the instances the section can draw. */
+		uint32 Instances = 0;
+		/** Screen coverage of the section, in (0, 1]: the closest and largest sections keep their blades the longest. */
+		float Priority = 1.0f;
+	};
+
+	/**
+	 * Coverage of a box seen from a point: the squared ratio of its radius to its distance, 1 when the point is inside it.
+	 * Grows with the projected area of the box without depending on the projection of the view.
+	 */
+	inline float ComputeBudgetPriority(const FBox& Bounds, const FVector& Origin)
+	{
+		const double RadiusSquared = FMath::Max(Bounds.GetExtent().SizeSquared(), UE_SMALL_NUMBER);
+		const double DistanceSquared = FVector::DistSquared(Bounds.GetCenter(), Origin);
+		return static_cast<float>(RadiusSquared / FMath::Max(DistanceSquared, RadiusSquared));
+	}
+
+	/** Fraction of the blades of a request granted with the scale solved by SolveBudgetScale, quantized down, 0 drops the section. */
+	inline float GetBudgetKeepFraction(const float Priority, const float Scale)
+	{
+		const float Fraction = FMath::Min(Priority * Scale, 1.0f);
+		return FMath::FloorToFloat(Fraction * BUDGET_KEEP_FRACTION_STEPS) / BUDGET_KEEP_FRACTION_STEPS;
+	}
+
+	/**
+	 * Scale of the priorities granting the requests at most Budget instances in total: each request keeps
+	 * min(1, Priority * Scale) of its blades, so the highest priorities are served in full first and the others
+	 * are thinned out in proportion to their priority. MAX_flt when all the requests fit in the budget.
+	 * The grants are quantized down by GetBudgetKeepFraction, which can only lower the total: the requests granted
+	 * less than a step are dropped, so that the budget is a hard bound.
+	 */
+	inline float SolveBudgetScale(const TConstArrayView<FGrassBudgetRequest> Requests, const uint32 Budget)
+	{
+		uint64 TotalInstances = 0;
+		for (const FGrassBudgetRequest& Request : Requests)
+		{
+			TotalInstances += Request.Instances;
+		}
+		if (TotalInstances <= Budget)
+			return MAX_flt;
+
+		TArray<FGrassBudgetRequest, TInlineAllocator<64>> Sorted(Requests.GetData(), Requests.Num());
+		Sorted.Sort([](const FGrassBudgetRequest& A, const FGrassBudgetRequest& B)
+		{
+			return A.Priority > B.Priority;
+		});
+
+		// Weighted demand of the requests that aren't served in full
+		double WeightedInstances = 0.0;
+		for (const FGrassBudgetRequest& Request : Sorted)
+		{
+			WeightedInstances += static_cast<double>(Request.Instances) * FMath::Max(Request.Priority, UE_SMALL_NUMBER);
+		}
+
+		// Serve the highest priorities in full while the scale left for the others still saturates them
+		double Remaining = Budget;
+		for (const FGrassBudgetRequest& Request : Sorted)
+		{
+			const double Priority = FMath::Max(Request.Priority, UE_SMALL_NUMBER);
+			const double Scale = Remaining / FMath::Max(WeightedInstances, UE_SMALL_NUMBER);
+			if (Scale * Priority < 1.0 || Remaining < Request.Instances)
+				return static_cast<float>(FMath::Max(Scale, 0.0));
+
+			Remaining -= Request.Instances;
+			WeightedInstances -= static_cast<double>(Request.Instances) * Priority;
+		}
+
+		return MAX_flt;
+	}
+
+	/** Total instances granted to the requests with the given scale. */
+	inline uint64 GetGrantedInstances(const TConstArrayView<FGrassBudgetRequest> Requests, const float Scale)
+	{
+		uint64 Granted = 0;
+		for (const FGrassBudgetRequest& Request : Requests)
+		{
+			Granted += static_cast<uint64>(Request.Instances * GetBudgetKeepFraction(Request.Priority, Scale));
+		}
+		return Granted;
+	}
+}
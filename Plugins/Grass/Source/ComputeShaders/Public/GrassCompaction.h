@@ -0,0 +1,150 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GrassLod.h"
+
+namespace GrassUtils
+{
+	/**
+	 * How CullInstancesCS reserves the slots of the blades that survive the culling.
+	 * Must be kept in sync with the COMPACTION_MODE values of GrassCompute.usf.
+	 */
+	enum class EGrassCullCompaction : int32
+	{
+		/** Two global atomics per surviving blade. */
+		PerBlade = 0,
+		/** Blades are counted in groupshared memory, one global atomic per group and per bucket. */
+		GroupShared = 1,
+		/** Blades are counted with wave intrinsics, one global atomic per wave and per bucket. */
+		Wave = 2,
+		Num
+	};
+
+	/** Output of SimulateCullCompaction. */
+	struct FCompactionSimulationResult
+	{
+		/** Slot of each input blade in the culled buffer, INDEX_NONE if the blade has been culled. */
+		TArray<int32> WriteIndices;
+		/** Rank of each input blade in its bucket, INDEX_NONE if the blade has been culled. */
+		TArray<int32> BucketRanks;
+		uint32 CulledCount = 0;
+		uint32 BucketCounts[MAX_LOD_BUCKETS] = {};
+		/** Number of atomics issued on the indirect args buffer. */
+		uint32 NumGlobalAtomics = 0;
+	};
+
+	/**
+	 * CPU simulation of the slot reservation done by CullInstancesCS.
+	 * Buckets holds the bucket of every blade, INDEX_NONE for the culled ones. BatchSize is the
+	 * number of lanes sharing the atomics: the wave size or the group size, ignored in per blade mode.
+	 * Batches are processed in order, so the slots match the GPU only up to the order in which
+	 * the batches win their atomics.
+	 */
+	inline void SimulateCullCompaction(
+		const TConstArrayView<int32> Buckets,
+		const EGrassCullCompaction Mode,
+		const int32 BatchSize,
+		FCompactionSimulationResult& OutResult)
+	{
+		OutResult = FCompactionSimulationResult();
+		OutResult.WriteIndices.Init(INDEX_NONE, Buckets.Num());
+		OutResult.BucketRanks.Init(INDEX_NONE, Buckets.Num());
+
+		const int32 LanesPerBatch = Mode == EGrassCullCompaction::PerBlade ? 1 : FMath::Max(BatchSize, 1);
+		for (int32 BatchStart = 0; BatchStart < Buckets.Num(); BatchStart += LanesPerBatch)
+		{
+			const int32 BatchEnd = FMath::Min(BatchStart + LanesPerBatch, Buckets.Num());
+
+			// Local counts, the prefix of each lane is its rank among the lanes of the batch
+			uint32 LocalCulledCount = 0;
+			uint32 LocalBucketCounts[MAX_LOD_BUCKETS] = {};
+			for (int32 Index = BatchStart; Index < BatchEnd; Index++)
+			{
+				if (Buckets[Index] == INDEX_NONE)
+					continue;
+
+				check(Buckets[Index] >= 0 && Buckets[Index] < MAX_LOD_BUCKETS);
+				OutResult.WriteIndices[Index] = LocalCulledCount++;
+				OutResult.BucketRanks[Index] = LocalBucketCounts[Buckets[Index]]++;
+			}
+
+			// One atomic per non empty counter, the returned value is the base of the batch
+			uint32 BucketBases[MAX_LOD_BUCKETS] = {};
+			if (LocalCulledCount > 0)
+			{
+				const uint32 CulledBase = OutResult.CulledCount;
+				OutResult.CulledCount += LocalCulledCount;
+				OutResult.NumGlobalAtomics++;
+
+				for (int32 Index = BatchStart; Index < BatchEnd; Index++)
+				{
+					if (OutResult.WriteIndices[Index] != INDEX_NONE)
+						OutResult.WriteIndices[Index] += CulledBase;
+				}
+			}
+			for (uint32 Bucket = 0; Bucket < MAX_LOD_BUCKETS; Bucket++)
+			{
+				if (LocalBucketCounts[Bucket] == 0)
+					continue;
+
+				BucketBases[Bucket] = OutResult.BucketCounts[Bucket];
+				OutResult.BucketCounts[Bucket] += LocalBucketCounts[Bucket];
+				OutResult.NumGlobalAtomics++;
+			}
+			for (int32 Index = BatchStart; Index < BatchEnd; Index++)
+			{
+				if (Buckets[Index] != INDEX_NONE)
+					OutResult.BucketRanks[Index] += BucketBases[Buckets[Index]];
+			}
+		}
+	}
+
+	/**
+	 * Check that a compaction result is valid for the given buckets: the write indices are a permutation
+	 * of [0, CulledCount) and the ranks of each bucket a permutation of [0, BucketCount).
+	 * Any compaction mode has to pass it, whatever order the atomics completed in.
+	 */
+	inline bool IsValidCullCompaction(const TConstArrayView<int32> Buckets, const FCompactionSimulationResult& Result)
+	{
+		if (Result.WriteIndices.Num() != Buckets.Num() || Result.BucketRanks.Num() != Buckets.Num())
+			return false;
+
+		TBitArray<> UsedSlots(false, Result.CulledCount);
+		TArray<TBitArray<>, TInlineAllocator<MAX_LOD_BUCKETS>> UsedRanks;
+		for (uint32 Bucket = 0; Bucket < MAX_LOD_BUCKETS; Bucket++)
+		{
+			UsedRanks.Emplace(false, Result.BucketCounts[Bucket]);
+		}
+
+		uint32 NumSurvivors = 0;
+		for (int32 Index = 0; Index < Buckets.Num(); Index++)
+		{
+			const int32 WriteIndex = Result.WriteIndices[Index];
+			const int32 Rank = Result.BucketRanks[Index];
+			if (Buckets[Index] == INDEX_NONE)
+			{
+				if (WriteIndex != INDEX_NONE || Rank != INDEX_NONE)
+					return false;
+				continue;
+			}
+
+			TBitArray<>& BucketRanks = UsedRanks[Buckets[Index]];
+			if (WriteIndex < 0 || WriteIndex >= UsedSlots.Num() || UsedSlots[WriteIndex]
+				|| Rank < 0 || Rank >= BucketRanks.Num() || BucketRanks[Rank])
+				return false;
+
+			UsedSlots[WriteIndex] = true;
+			BucketRanks[Rank] = true;
+			NumSurvivors++;
+		}
+
+		uint32 BucketTotal = 0;
+		for (uint32 Bucket = 0; Bucket < MAX_LOD_BUCKETS; Bucket++)
+		{
+			BucketTotal += Result.BucketCounts[Bucket];
+		}
+		return NumSurvivors == Result.CulledCount && BucketTotal == Result.CulledCount;
+	}
+}
@@ -4,6 +4,7 @@
 
 #include "HLSLTypeAliases.h"
 #include "VectorTypes.h"
+#include "Math/Float16.h"
 
 #ifndef My_USE_INSTANCING
 	#define My_USE_INSTANCING 0
@@ -83,6 +84,27 @@ namespace GrassUtils
 		FVector3f InstanceOrigin;
 	};
 
+	// See FGrassCompactInstance in GrassCommon.ush, and GetProceduralBladeVertex in GrassVertexFactoryCommon.ush for CreateGrassModels.
+
+	/**
+	 * Compact layout of FGrassInstance, 16 bytes instead of 48, selected by r.Grass.CompactInstances.
+	 */
+	struct COMPUTESHADERS_API FGrassCompactInstance
+	{
+		/** Origin quantized to 21, 21 and 22 bits inside the instance bounds of the scene proxy. */
+		uint32 Origin[2];
+		/** Up in the high 16 bits and Facing in the low 16 bits, octahedral encoded. */
+		uint32 Axes;
+		/** Height in the high 16 bits and Width in the low 16 bits, as half floats. */
+		uint32 Scale;
+	};
+
+	/** Whether the instances are written and drawn in the FGrassCompactInstance layout, set by r.Grass.CompactInstances. */
+	COMPUTESHADERS_API bool UseCompactInstances();
+
+	/** Whether the blade vertices are generated from the vertex id instead of being fetched, set by r.Grass.ProceduralBlades. */
+	COMPUTESHADERS_API bool UseProceduralBlades();
+
 
 	struct COMPUTESHADERS_API FGrassVertex
 	{
@@ -156,36 +178,171 @@ namespace GrassUtils
 		return Out;
 	}
 	
-	// TODO: Move this to a more appropriate place
-	// TODO: Add a proper lod index computation
-	inline float ComputeLodIndex(
-		const FVector& CullOrigin,
-		const FBox& Bounds,
-		const float CutoffDistance,
-		const FUintVector2 MinMaxLod)
+	/**
+	 * Octahedral encoding of a direction with 8 bits per coordinate, 0 is exact so that straight blades stay straight.
+	 */
+	inline uint32 PackOctahedral16(const FVector3f Vector)
 	{
-		float Distance = FVector::Dist(CullOrigin, Bounds.GetCenter());
-		Distance -= Bounds.GetExtent().Size();
-		
-		const float LodPercentage = 1 - Distance / CutoffDistance;
-		const FVector2f MinMaxLodF = FVector2f(MinMaxLod.X, MinMaxLod.Y);
-		
-		const uint32 Lod = FMath::Clamp(
-			CUB_BEZ(MinMaxLodF.X, MinMaxLodF.X, MinMaxLodF.X, MinMaxLodF.Y, LodPercentage),
-			MinMaxLod.X, MinMaxLod.Y);
-		
-		return Lod;
+		const FVector3f N = Vector / FMath::Max(FMath::Abs(Vector.X) + FMath::Abs(Vector.Y) + FMath::Abs(Vector.Z), UE_SMALL_NUMBER);
+		FVector2f Oct(N.X, N.Y);
+		if (N.Z < 0.0f)
+		{
+			Oct.X = (1.0f - FMath::Abs(N.Y)) * (N.X >= 0.0f ? 1.0f : -1.0f);
+			Oct.Y = (1.0f - FMath::Abs(N.X)) * (N.Y >= 0.0f ? 1.0f : -1.0f);
+		}
+
+		const uint32 X = static_cast<uint32>(FMath::RoundToInt(FMath::Clamp(Oct.X, -1.0f, 1.0f) * 127.0f) + 128);
+		const uint32 Y = static_cast<uint32>(FMath::RoundToInt(FMath::Clamp(Oct.Y, -1.0f, 1.0f) * 127.0f) + 128);
+		return (X << 8) | Y;
+	}
+
+	inline FVector3f UnpackOctahedral16(const uint32 Packed)
+	{
+		const FVector2f Oct(
+			(static_cast<float>((Packed >> 8) & 0xff) - 128.0f) / 127.0f,
+			(static_cast<float>(Packed & 0xff) - 128.0f) / 127.0f);
+		FVector3f N(Oct.X, Oct.Y, 1.0f - FMath::Abs(Oct.X) - FMath::Abs(Oct.Y));
+		const float T = FMath::Max(-N.Z, 0.0f);
+		N.X += N.X >= 0.0f ? -T : T;
+		N.Y += N.Y >= 0.0f ? -T : T;
+
+		return N.GetSafeNormal();
+	}
+
+	/** Largest quantized value of each coordinate of the origin of a compact instance. */
+	static const FVector3f CompactInstanceOriginSteps = FVector3f(0x1fffff, 0x1fffff, 0x3fffff);
+
+	/**
+	 * Encode the instance of a blade in the compact layout, its origin must be inside Bounds.
+	 */
+	inline FGrassCompactInstance PackCompactInstance(const FGrassData& Data, const FBox3f& Bounds)
+	{
+		const FVector3f Size = Bounds.GetSize().ComponentMax(FVector3f(UE_SMALL_NUMBER));
+		const FVector3f Unit = ((Data.Position - Bounds.Min) / Size).BoundToBox(FVector3f::ZeroVector, FVector3f::OneVector);
+		const uint32 X = static_cast<uint32>(FMath::RoundToInt(Unit.X * CompactInstanceOriginSteps.X));
+		const uint32 Y = static_cast<uint32>(FMath::RoundToInt(Unit.Y * CompactInstanceOriginSteps.Y));
+		const uint32 Z = static_cast<uint32>(FMath::RoundToInt(Unit.Z * CompactInstanceOriginSteps.Z));
+
+		FGrassCompactInstance Instance;
+		Instance.Origin[0] = X | (Y << 21);
+		Instance.Origin[1] = (Y >> 11) | (Z << 10);
+		Instance.Axes = (PackOctahedral16(Data.Up) << 16) | PackOctahedral16(Data.Facing);
+		Instance.Scale = (static_cast<uint32>(FFloat16(Data.Height).Encoded) << 16) | FFloat16(Data.Width).Encoded;
+
+		return Instance;
+	}
+
+	/**
+	 * Instance of a blade in the default layout, as written by WriteInstance in GrassCompute.usf:
+	 * the rows of RotScaleMatrix are the axes of the blade scaled by its width and height.
+	 */
+	inline FGrassInstance MakeGrassInstance(const FVector3f Position, const FVector3f Up, const FVector3f Facing, const float Width, const float Height)
+	{
+		const FVector3f Rows[3] = { (Facing ^ Up) * Width, Facing * Width, Up * Height };
+
+		FGrassInstance Instance;
+		for (int32 Row = 0; Row < 3; Row++)
+		{
+			Instance.RotScaleMatrix[Row][0] = Rows[Row].X;
+			Instance.RotScaleMatrix[Row][1] = Rows[Row].Y;
+			Instance.RotScaleMatrix[Row][2] = Rows[Row].Z;
+		}
+		Instance.InstanceOrigin = Position;
+
+		return Instance;
+	}
+
+	/**
+	 * Decode a compact instance into the default layout.
+	 */
+	inline FGrassInstance UnpackCompactInstance(const FGrassCompactInstance& Instance, const FBox3f& Bounds)
+	{
+		const FVector3f Origin(
+			static_cast<float>(Instance.Origin[0] & 0x1fffff),
+			static_cast<float>((Instance.Origin[0] >> 21) | ((Instance.Origin[1] & 0x3ff) << 11)),
+			static_cast<float>(Instance.Origin[1] >> 10));
+
+		FFloat16 Height, Width;
+		Height.Encoded = static_cast<uint16>(Instance.Scale >> 16);
+		Width.Encoded = static_cast<uint16>(Instance.Scale & 0xffff);
+
+		return MakeGrassInstance(
+			Bounds.Min + Bounds.GetSize() * (Origin / CompactInstanceOriginSteps),
+			UnpackOctahedral16(Instance.Axes >> 16),
+			UnpackOctahedral16(Instance.Axes & 0xffff),
+			Width.GetFloat(), Height.GetFloat());
 	}
 
+	/**
+	 * CPU round trip of the compact layout: largest difference between the default instance of the blade and the
+	 * one decoded from its compact instance, over the rows of the transform relative to the blade size and the origin.
+	 * The rotation is within ~1% of the blade size, the origin within 1 / 2^21 of the bounds size.
+	 */
+	inline void ComputeCompactInstanceError(const FGrassData& Data, const FBox3f& Bounds, float& OutRelativeRotScaleError, float& OutOriginError)
+	{
+		const FGrassInstance Reference = MakeGrassInstance(Data.Position, Data.Up, Data.Facing, Data.Width, Data.Height);
+		const FGrassInstance RoundTrip = UnpackCompactInstance(PackCompactInstance(Data, Bounds), Bounds);
+
+		const float BladeSize = FMath::Max3(Data.Width, Data.Height, UE_SMALL_NUMBER);
+		OutRelativeRotScaleError = 0.0f;
+		for (int32 Row = 0; Row < 3; Row++)
+		{
+			for (int32 Column = 0; Column < 3; Column++)
+			{
+				const float Error = FMath::Abs(Reference.RotScaleMatrix[Row][Column] - RoundTrip.RotScaleMatrix[Row][Column]);
+				OutRelativeRotScaleError = FMath::Max(OutRelativeRotScaleError, Error / BladeSize);
+			}
+		}
+		OutOriginError = (Reference.InstanceOrigin - RoundTrip.InstanceOrigin).GetAbsMax();
+	}
+
+	/** Vertices of the blade mesh of a LOD: a pair per step, the pair at the base and the tip. */
+	inline uint32 GetGrassBladeNumVertices(const uint32 LodStep)
+	{
+		return LodStep * 2 + 3;
+	}
+
+	/** Triangle list of the blade mesh of a LOD, shared by the fetched and the procedural blade vertices. */
+	inline void CreateGrassBladeIndices(TResourceArray<uint16>& IndexBuffer, const uint32 LodStep)
+	{
+		IndexBuffer.AddZeroed((LodStep * 2 + 1) * 3);
+
+		uint16 VertexIndex = 0;
+		uint32 PrimitiveIndex = 0;
+		for (uint32 i = 0; i <= LodStep; i++, VertexIndex += 2, PrimitiveIndex += 6)
+		{
+			if (i < LodStep)
+			{
+				// t1
+				IndexBuffer[PrimitiveIndex + 0] = VertexIndex + 0;
+				IndexBuffer[PrimitiveIndex + 1] = VertexIndex + 3;
+				IndexBuffer[PrimitiveIndex + 2] = VertexIndex + 1;
+
+				// t2
+				IndexBuffer[PrimitiveIndex + 3] = VertexIndex + 0;
+				IndexBuffer[PrimitiveIndex + 4] = VertexIndex + 2;
+				IndexBuffer[PrimitiveIndex + 5] = VertexIndex + 3;
+			}
+			else
+			{
+				// last triangle
+				IndexBuffer[PrimitiveIndex + 0] = VertexIndex + 0;
+				IndexBuffer[PrimitiveIndex + 1] = VertexIndex + 2;
+				IndexBuffer[PrimitiveIndex + 2] = VertexIndex + 1;
+			}
+		}
+	}
+
+	/**
+	 * Blade mesh of a LOD, with the vertices fetched by the default vertex factory.
+	 */
 	inline void CreateGrassModels(
 	    TResourceArray<FPackedGrassVertex>& VertexBuffer,
-	    TResourceArray<uint32>& IndexBuffer,
+	    TResourceArray<uint16>& IndexBuffer,
 	    uint32 LodStep)
 	{
 	    constexpr float MaxHeight = 1.0f;
-	    constexpr float MaxWidth = 1.0f;
 		
-		const FVector3f InitialPosition = FVector3f(0, 0, 0);
 	    const FVector3f FinalPosition = FVector3f(0, 0, 1) * MaxHeight;
 		
 	    constexpr float Angle = UE_PI * 0.01;
@@ -198,8 +355,8 @@ namespace GrassUtils
 		const FVector3f Tangent1 = Tangent.RotateAngleAxis(Angle, FVector3f(0, 0, 1));
 		const FVector3f Tangent2 = Tangent.RotateAngleAxis(-Angle, FVector3f(0, 0, 1));
 	    
-		VertexBuffer.AddZeroed(LodStep * 2 + 3);
-		IndexBuffer.AddZeroed((LodStep * 2 + 1) * 3);
+		VertexBuffer.AddZeroed(GetGrassBladeNumVertices(LodStep));
+		CreateGrassBladeIndices(IndexBuffer, LodStep);
 
 		FVector3f RP0 {0.5f, 0, 0};
 		FVector3f RP1 {0.4f, 0, 1};
@@ -209,47 +366,25 @@ namespace GrassUtils
 		FVector3f LP1 {-0.4f, 0, 1};
 		FVector3f LP2 { 0.0f, 0, 1};
 		
-	    uint32 VertexIndex = 0, PrimitiveIndex = 0;
-	    for (uint32 i = 0; i <= LodStep; i++, VertexIndex += 2, PrimitiveIndex += 6)
+	    uint32 VertexIndex = 0;
+	    for (uint32 i = 0; i <= LodStep; i++, VertexIndex += 2)
 	    {
-	    
 	        const float Percentage = i / static_cast<float>(LodStep + 1);
-	        const float CurrentFactor = QUAD_BEZ(1.0f, 0.85f, 0.0f, Percentage);
 	        
 	        FPackedGrassVertex P1, P2;
 
+			// U spans the width of the blade, from 0 on the left edge of the base to 1 on the right one
 	    	P1.Position = QUAD_BEZ(LP0, LP1, LP2, Percentage);
-	        P1.UV = PackUV(FVector2f(0.5 - CurrentFactor, Percentage));
+	        P1.UV = PackUV(FVector2f(0.5f + P1.Position.X, Percentage));
 	        P1.TangentX = PackNormal(Tangent1);
 	        P1.TangentZ = PackNormal(FVector4f(Normal1, 1));
 	        VertexBuffer[VertexIndex + 0] = P1;
 	    	
 	        P2.Position = QUAD_BEZ(RP0, RP1, RP2, Percentage);
-	        P2.UV = PackUV(FVector2f(0.5 + CurrentFactor, Percentage));
+	        P2.UV = PackUV(FVector2f(0.5f + P2.Position.X, Percentage));
 	        P2.TangentX = PackNormal(Tangent2);
 	        P2.TangentZ = PackNormal(FVector4f(Normal2, 1));
 	        VertexBuffer[VertexIndex + 1] = P2;
-	        
-	        if (i < LodStep)
-	        {
-	            // t1
-	            IndexBuffer[PrimitiveIndex + 0] = VertexIndex + 0;
-	        	IndexBuffer[PrimitiveIndex + 1] = VertexIndex + 3;
-	        	IndexBuffer[PrimitiveIndex + 2] = VertexIndex + 1;
-	        	
-	        	// t2
-	        	IndexBuffer[PrimitiveIndex + 3] = VertexIndex + 0;
-	        	IndexBuffer[PrimitiveIndex + 4] = VertexIndex + 2;
-	        	IndexBuffer[PrimitiveIndex + 5] = VertexIndex + 3;
-	        }
-	        else
-	        {
-	        	// last triangle
-	        	IndexBuffer[PrimitiveIndex + 0] = VertexIndex + 0;
-	        	IndexBuffer[PrimitiveIndex + 1] = VertexIndex + 2;
-	        	IndexBuffer[PrimitiveIndex + 2] = VertexIndex + 1;
-	        	
-	        }
 	    }
 	    
 	    // last point
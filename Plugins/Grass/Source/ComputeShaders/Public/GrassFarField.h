@@ -0,0 +1,174 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GrassData.h"
+#include "GrassLod.h"
+#include "GrassSpecies.h"
+
+namespace GrassUtils
+{
+	/**
+	 * Far field of a grass field: past the cutoff distance of the blades, each cell of a section is drawn as a single card,
+	 * a clump of a few wide blades baked into one mesh. The blades thin out and the cards grow out of the ground over
+	 * the same band before the cutoff distance, so that the field has no visible edge.
+	 */
+	struct FGrassFarField
+	{
+		bool bEnabled = false;
+		/** Cutoff distance of the cards, as a multiple of the cutoff distance of the blades. */
+		float DistanceScale = 4.0f;
+		/** Side of the square cell a card stands for. */
+		float CellSize = 100.0f;
+		/** Distance before the cutoff distance of the blades over which the blades fade into the cards. */
+		float FadeDistance = 200.0f;
+		/** Blades baked into the mesh of a card. */
+		uint32 BladesPerCard = 16;
+
+		bool IsEnabled() const { return bEnabled && DistanceScale > 1.0f && CellSize > 0.0f && BladesPerCard > 0; }
+	};
+
+	/**
+	 * Packed as the FarFieldFade parameter of CullInstancesCS: start and inverse width of the band ending at the cutoff
+	 * distance of the blades, zero for the blades of a field without a far field.
+	 */
+	inline FVector2f GetFarFieldFadeParameter(const float BladeCutoffDistance, const float FadeDistance)
+	{
+		// Without a band the cards would never grow, they pop in right at the cutoff distance instead
+		const float Width = FMath::Clamp(FadeDistance, 1.0f, FMath::Max(BladeCutoffDistance, 1.0f));
+		return FVector2f(BladeCutoffDistance - Width, 1.0f / Width);
+	}
+
+	// Faded on the GPU by ComputeFarFieldFade in GrassUtils.ush.
+
+	/**
+	 * Progress of the cross-fade at the given distance, from 0 before the band (only blades) to 1 at the cutoff distance
+	 * of the blades (only cards), FarFieldFade being GetFarFieldFadeParameter.
+	 */
+	inline float ComputeFarFieldFade(const float Distance, const FVector2f& FarFieldFade)
+	{
+		return FarFieldFade.Y > 0.0f ? FMath::Clamp((Distance - FarFieldFade.X) * FarFieldFade.Y, 0.0f, 1.0f) : 0.0f;
+	}
+
+	/**
+	 * Height scale of a card at the given distance: grown over the cross-fade band and shrunk back over the same width
+	 * before its own cutoff distance, 0 when the card isn't drawn.
+	 */
+	inline float ComputeFarFieldCardScale(const float Distance, const FVector2f& FarFieldFade, const float CardCutoffDistance)
+	{
+		const float Shrink = FMath::Clamp((CardCutoffDistance - Distance) * FarFieldFade.Y, 0.0f, 1.0f);
+		return FMath::Min(ComputeFarFieldFade(Distance, FarFieldFade), Shrink);
+	}
+
+	/**
+	 * Cards of the blades of a section, one per cell of CellSize and species the blades fall in: the card stands at the mean
+	 * position of the blades of the species in its cell, along their mean up vector and with their mean height, and spans
+	 * the whole cell. The card keeps the species, so that it is drawn with the material of its blades.
+	 * The facing of a card is random but stable, so that the clumps of neighbouring cells don't line up.
+	 */
+	inline void BuildFarFieldCards(const TConstArrayView<FPackedGrassData> Blades, const float CellSize, TArray<FPackedGrassData>& OutCards)
+	{
+		struct FCell
+		{
+			FVector3f Position = FVector3f::ZeroVector;
+			FVector3f Up = FVector3f::ZeroVector;
+			float Height = 0.0f;
+			float Stiffness = 0.0f;
+			uint32 NumBlades = 0;
+		};
+
+		// Insertion order keeps the cards in the sampling order of the blades
+		TMap<FIntVector, FCell> Cells;
+		for (FPackedGrassData Packed : Blades)
+		{
+			const FGrassData Blade(Packed);
+			const FIntVector Key(
+				FMath::FloorToInt(Blade.Position.X / CellSize), FMath::FloorToInt(Blade.Position.Y / CellSize),
+				static_cast<int32>(GetGrassSpecies(Packed.Index, MAX_GRASS_SPECIES)));
+
+			FCell& Cell = Cells.FindOrAdd(Key);
+			Cell.Position += Blade.Position;
+			Cell.Up += Blade.Up;
+			Cell.Height += Blade.Height;
+			Cell.Stiffness += Blade.Stiffness;
+			Cell.NumBlades++;
+		}
+
+		OutCards.Reset(Cells.Num());
+		for (const TPair<FIntVector, FCell>& Pair : Cells)
+		{
+			const FCell& Cell = Pair.Value;
+			const float InvNumBlades = 1.0f / Cell.NumBlades;
+			const uint32 Index = HashBladeIndex(HashCombineFast(HashCombineFast(GetTypeHash(Pair.Key.X), GetTypeHash(Pair.Key.Y)), GetTypeHash(Pair.Key.Z)));
+
+			const FVector3f Up = Cell.Up.GetSafeNormal(UE_SMALL_NUMBER, FVector3f::UpVector);
+			const float Yaw = (Index >> 8) * (2.0f * UE_PI / 16777216.0f);
+			const FVector3f Facing = FVector3f::VectorPlaneProject(FVector3f(FMath::Cos(Yaw), FMath::Sin(Yaw), 0.0f), Up)
+				.GetSafeNormal(UE_SMALL_NUMBER, FVector3f::ForwardVector);
+
+			// The species of the cell with the bend flag clear, the hash only seeds the yaw of the card
+			OutCards.Emplace(
+				PackGrassBladeIndex(Index, static_cast<uint32>(Pair.Key.Z)), Cell.Position * InvNumBlades, Up, Facing,
+				Cell.Height * InvNumBlades, CellSize, Cell.Stiffness * InvNumBlades);
+		}
+	}
+
+	/**
+	 * Width of the blades of a card relative to the cell, so that a card covers about as much of the view as the blades
+	 * of its cell did. Capped at twice the spacing of the blades of the card, past that they'd only overlap.
+	 */
+	inline float ComputeFarFieldCardBladeWidth(
+		const uint32 NumBlades, const uint32 NumCards, const float MeanBladeWidth, const FGrassFarField& FarField)
+	{
+		const float BladesPerCell = static_cast<float>(NumBlades) / FMath::Max<uint32>(NumCards, 1);
+		const float Width = MeanBladeWidth * BladesPerCell / FarField.BladesPerCard / FarField.CellSize;
+		return FMath::Clamp(Width, MeanBladeWidth / FarField.CellSize, 2.0f / FMath::Sqrt(static_cast<float>(FarField.BladesPerCard)));
+	}
+
+	/**
+	 * Mesh of a card: BladesPerCard single triangle blades on a jittered grid of the unit cell centered on the origin,
+	 * of random yaw and height, with the UVs of the blade meshes so that the grass materials apply as they are.
+	 * The instance scales it by the cell size horizontally and by the mean height of the cell vertically.
+	 */
+	inline void CreateFarFieldCardModel(
+		TResourceArray<FPackedGrassVertex>& VertexBuffer,
+		TResourceArray<uint16>& IndexBuffer,
+		const uint32 BladesPerCard,
+		const float BladeWidth)
+	{
+		const uint32 Side = FMath::CeilToInt(FMath::Sqrt(static_cast<float>(BladesPerCard)));
+		FRandomStream RandomStream(0x63617264);
+
+		VertexBuffer.Reset(BladesPerCard * 3);
+		IndexBuffer.Reset(BladesPerCard * 3);
+		for (uint32 Blade = 0; Blade < BladesPerCard; Blade++)
+		{
+			const FVector3f Root(
+				((Blade % Side) + RandomStream.FRand()) / Side - 0.5f,
+				((Blade / Side) + RandomStream.FRand()) / Side - 0.5f,
+				0.0f);
+			const float Yaw = RandomStream.FRandRange(0.0f, 360.0f);
+			const float Height = RandomStream.FRandRange(0.6f, 1.0f);
+
+			const FVector3f Tangent = FVector3f(1, 0, 0).RotateAngleAxis(Yaw, FVector3f(0, 0, 1));
+			const FVector3f Normal = FVector3f(0, -1, 0).RotateAngleAxis(Yaw, FVector3f(0, 0, 1));
+
+			const FVector3f Positions[3] = { Root - Tangent * (BladeWidth / 2), Root + Tangent * (BladeWidth / 2), Root + FVector3f(0, 0, Height) };
+			const FVector2f UVs[3] = { FVector2f(0, 0), FVector2f(1, 0), FVector2f(0.5f, 1) };
+			for (int32 Corner = 0; Corner < 3; Corner++)
+			{
+				FPackedGrassVertex Vertex;
+				Vertex.Position = Positions[Corner];
+				Vertex.UV = PackUV(UVs[Corner]);
+				Vertex.TangentX = PackNormal(Tangent);
+				Vertex.TangentZ = PackNormal(FVector4f(Normal, 1));
+
+				// Same winding as the last triangle of the blade meshes
+				IndexBuffer.Add(static_cast<uint16>(VertexBuffer.Num()));
+				VertexBuffer.Add(Vertex);
+			}
+			Swap(IndexBuffer.Last(0), IndexBuffer.Last(1));
+		}
+	}
+}
@@ -0,0 +1,147 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GrassData.h"
+#include "GrassWind.h"
+
+class FSceneInterface;
+
+namespace GrassUtils
+{
+	/** Most interactors uploaded in a frame, the closest to the view are kept past it. */
+	#define MAX_GRASS_INTERACTORS 512
+
+	// See FGrassInteractor and ApplyForceToBlade in GrassUtils.ush.
+
+	/** Capsule pushing the blades around it. */
+	struct FGrassInteractor
+	{
+		/** Ends of the axis of the capsule. */
+		FVector3f Start;
+		float Radius;
+		FVector3f End;
+		/** Weight of the push, 1 flattens the blades under the axis. */
+		float Strength;
+	};
+	static_assert(sizeof(FGrassInteractor) == 32, "FGrassInteractor must match its layout in GrassCompute.usf");
+
+	/** Capsule of an interactor centered on Center, along the unit Axis. */
+	inline FGrassInteractor MakeGrassInteractor(
+		const FVector& Center, const FVector& Axis, const float HalfHeight, const float Radius, const float Strength)
+	{
+		const FVector HalfSegment = Axis * FMath::Max(HalfHeight - Radius, 0.0f);
+		return FGrassInteractor{ FVector3f(Center - HalfSegment), Radius, FVector3f(Center + HalfSegment), Strength };
+	}
+
+	/**
+	 * World aligned map of the forces the interactors apply to the blades, centered on the view.
+	 * Every frame the interactors are splatted into the map of the last frame, decayed, so that the blades stand back
+	 * up over time. Each texel holds the push in XY, the flattening in Z and the bottom of the interactor in W.
+	 */
+	struct FGrassForceMap
+	{
+		/** Side of the map in texels. */
+		uint32 Resolution = 256;
+		/** Side of the map in world units. */
+		float WorldSize = 4000.0f;
+		/** Rate the forces decay at, per second. */
+		float DecayRate = 2.0f;
+		/** Largest angle in radians the forces bend the blades by. */
+		float MaxBendAngle = 1.4f;
+
+		bool IsEnabled() const { return Resolution > 0 && WorldSize > 0.0f && MaxBendAngle > 0.0f; }
+
+		float GetTexelSize() const { return WorldSize / Resolution; }
+
+		/**
+		 * Texel of the world grid at the corner of the map centered on ViewOrigin. The map moves by whole texels,
+		 * so that the forces of the last frame are carried over without being resampled.
+		 */
+		FIntPoint GetOriginTexel(const FVector& ViewOrigin) const
+		{
+			const double TexelSize = GetTexelSize();
+			return FIntPoint(
+				FMath::FloorToInt(ViewOrigin.X / TexelSize) - static_cast<int32>(Resolution / 2),
+				FMath::FloorToInt(ViewOrigin.Y / TexelSize) - static_cast<int32>(Resolution / 2));
+		}
+
+		/** Scale of the forces after DeltaTime seconds. */
+		float GetDecay(const float DeltaTime) const
+		{
+			return FMath::Exp(-FMath::Max(DecayRate, 0.0f) * FMath::Max(DeltaTime, 0.0f));
+		}
+	};
+
+	/**
+	 * Splat of an interactor on the texel at Position: push away from the axis of the capsule in XY, flattening in Z,
+	 * bottom of the capsule relative to ReferenceZ in W. Zero outside of the capsule.
+	 */
+	inline FVector4f ComputeInteractorSplat(const FVector2f& Position, const FGrassInteractor& Interactor, const float ReferenceZ)
+	{
+		const FVector2f Start(Interactor.Start.X, Interactor.Start.Y);
+		const FVector2f Segment = FVector2f(Interactor.End.X, Interactor.End.Y) - Start;
+		const float SegmentLengthSquared = Segment.SizeSquared();
+		const float Alpha = SegmentLengthSquared > UE_KINDA_SMALL_NUMBER ?
+			FMath::Clamp(FVector2f::DotProduct(Position - Start, Segment) / SegmentLengthSquared, 0.0f, 1.0f) : 0.0f;
+
+		const FVector2f Offset = Position - (Start + Segment * Alpha);
+		const float Distance = Offset.Size();
+		const float Weight = FMath::Clamp(1.0f - Distance / FMath::Max(Interactor.Radius, UE_KINDA_SMALL_NUMBER), 0.0f, 1.0f) * Interactor.Strength;
+		if (Weight <= 0.0f)
+			return FVector4f::Zero();
+
+		const FVector2f Push = Distance > UE_KINDA_SMALL_NUMBER ? Offset / Distance * Weight : FVector2f::ZeroVector;
+		const float Bottom = FMath::Min(Interactor.Start.Z, Interactor.End.Z) - Interactor.Radius - ReferenceZ;
+		return FVector4f(Push.X, Push.Y, Weight, Bottom);
+	}
+
+	/**
+	 * Texel of the last frame scaled by Decay, its bottom moved to the reference height of this frame.
+	 */
+	inline FVector4f DecayForce(const FVector4f& Texel, const float Decay, const float HeightShift)
+	{
+		return FVector4f(Texel.X * Decay, Texel.Y * Decay, Texel.Z * Decay, Texel.W - HeightShift);
+	}
+
+	/**
+	 * Merge a splat into a texel: the pushes add up to a unit length, the strongest flattening wins with the bottom of its interactor.
+	 */
+	inline FVector4f AccumulateForce(const FVector4f& Texel, const FVector4f& Splat)
+	{
+		if (Splat.Z <= 0.0f)
+			return Texel;
+
+		const FVector2f Push = FVector2f(Texel.X + Splat.X, Texel.Y + Splat.Y).GetClampedToMaxSize(1.0f);
+		return FVector4f(Push.X, Push.Y, FMath::Min(FMath::Max(Texel.Z, Splat.Z), 1.0f), Splat.Z > Texel.Z ? Splat.W : Texel.W);
+	}
+
+	/**
+	 * Part of a blade the interactor of a texel reaches, ReferenceZ being the reference height of the map: from 1 when
+	 * the bottom of the interactor is below the root of the blade to 0 at its tip, the blades it passes over are left alone.
+	 */
+	inline float ComputeForceReach(const FGrassData& Blade, const FVector4f& Texel, const float ReferenceZ)
+	{
+		return FMath::Clamp(
+			(Blade.Position.Z + Blade.Height - ReferenceZ - Texel.W) / FMath::Max(Blade.Height, UE_KINDA_SMALL_NUMBER), 0.0f, 1.0f);
+	}
+
+	/**
+	 * Bend and flatten a blade by the texel of the force map at its root.
+	 */
+	inline void ApplyForceToBlade(FGrassData& Blade, const FVector4f& Texel, const float ReferenceZ, const float MaxBendAngle)
+	{
+		const float Reach = ComputeForceReach(Blade, Texel, ReferenceZ);
+		if (Reach <= 0.0f || Texel.Z <= 0.0f)
+			return;
+
+		const FVector3f Push(Texel.X * Reach, Texel.Y * Reach, 0.0f);
+		Blade.Up = ComputeWindBentUp(Blade.Up, Push, Blade.Stiffness, MaxBendAngle);
+		Blade.Facing = ComputeWindBentFacing(Blade.Facing, Blade.Up);
+		Blade.Height *= 1.0f - 0.75f * Texel.Z * Reach;
+	}
+
+	/** Hand the interactors of a world to the renderer, all of them in one batch per scene. Render thread only. */
+	COMPUTESHADERS_API void SetGrassInteractors(const FSceneInterface* InScene, TArray<FGrassInteractor>&& InInteractors);
+}
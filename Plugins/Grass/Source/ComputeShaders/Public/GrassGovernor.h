@@ -0,0 +1,119 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+namespace GrassUtils
+{
+	/**
+	 * Holds the measured GPU time of the grass passes to a target by trading quality away.
+	 * A single quality level in [0, 1] is raised and lowered from the smoothed timings of the culling and instance passes.
+	 * The density gives first, over the upper half of the range, then the cutoff distance over the lower half.
+	 * The LOD bias is lowered alongside the density: it only lightens the draws, the timed passes don't depend on it.
+	 * It has no dependencies on the renderer and can be driven headlessly from synthetic timings.
+	 */
+	class FGrassGovernor
+	{
+	public:
+		struct FSettings
+		{
+			/** GPU time in milliseconds the governor holds the culling and instance passes to, 0 disables it. */
+			float TargetMs = 0.0f;
+			/** Weight of a new timing in the exponential moving average of the timings. */
+			float Smoothing = 0.1f;
+			/** Relative deviation from the target the smoothed time has to exceed before the quality changes. */
+			float HysteresisBand = 0.1f;
+			/** Quality level lost per frame per unit of relative excess over the target, recovered at half the rate. */
+			float Gain = 0.2f;
+			/** Lowest LOD bias, density scale and cutoff scale, reached at quality 0. */
+			float MinLodBias = -2.0f;
+			float MinDensityScale = 0.25f;
+			float MinCutoffScale = 0.5f;
+		};
+
+		/** Output of the governor, quantized so that the culling cache survives small changes. */
+		struct FState
+		{
+			/** Smoothed GPU time of the culling and instance passes of the grass, in milliseconds. */
+			float SmoothedMs = 0.0f;
+			/** Quality level, 1 leaving the grass untouched. */
+			float Quality = 1.0f;
+			/** Steps added to the LOD bias of the views, lightening the draws only. */
+			float LodBias = 0.0f;
+			/** Fraction of the blades kept, on top of the density falloff and the instance budget. */
+			float DensityScale = 1.0f;
+			/** Scale of the cutoff distance of the fields. */
+			float CutoffScale = 1.0f;
+			uint32 NumSamples = 0;
+		};
+
+		FGrassGovernor() = default;
+		explicit FGrassGovernor(const FSettings& InSettings)
+			: Settings(InSettings)
+		{
+		}
+
+		const FSettings& GetSettings() const { return Settings; }
+		const FState& GetState() const { return State; }
+		bool IsEnabled() const { return Settings.TargetMs > 0.0f; }
+
+		/** Change the settings, keeping the quality level reached so far. */
+		void SetSettings(const FSettings& InSettings)
+		{
+			Settings = InSettings;
+			if (!IsEnabled())
+			{
+				Reset();
+			}
+		}
+
+		/** Back to full quality, forgetting the timings. */
+		void Reset()
+		{
+			State = FState();
+		}
+
+		/** Feed the GPU time of the culling and instance passes of a frame and update the outputs. */
+		void AddSample(const float GpuMs)
+		{
+			if (!IsEnabled())
+				return;
+
+			const float Alpha = FMath::Clamp(Settings.Smoothing, UE_KINDA_SMALL_NUMBER, 1.0f);
+			State.SmoothedMs = State.NumSamples == 0 ? GpuMs : FMath::Lerp(State.SmoothedMs, GpuMs, Alpha);
+			State.NumSamples++;
+
+			// Dead band around the target so that the quality doesn't oscillate between two levels
+			const float Ratio = State.SmoothedMs / Settings.TargetMs;
+			if (Ratio > 1.0f + Settings.HysteresisBand)
+			{
+				State.Quality -= Settings.Gain * (Ratio - 1.0f);
+			}
+			else if (Ratio < 1.0f - Settings.HysteresisBand)
+			{
+				State.Quality += 0.5f * Settings.Gain * (1.0f - Ratio);
+			}
+			State.Quality = FMath::Clamp(State.Quality, 0.0f, 1.0f);
+
+			UpdateOutputs();
+		}
+
+	private:
+		void UpdateOutputs()
+		{
+			// The density and the LOD bias over the upper half of the quality range, the cutoff distance over the lower half
+			const float DensityAlpha = FMath::Clamp(2.0f * State.Quality - 1.0f, 0.0f, 1.0f);
+			const float CutoffAlpha = FMath::Clamp(2.0f * State.Quality, 0.0f, 1.0f);
+
+			constexpr float LodBiasSteps = 8.0f;
+			constexpr float ScaleSteps = 64.0f;
+			State.LodBias = FMath::RoundToFloat(FMath::Lerp(Settings.MinLodBias, 0.0f, DensityAlpha) * LodBiasSteps) / LodBiasSteps;
+			State.DensityScale = FMath::RoundToFloat(FMath::Lerp(Settings.MinDensityScale, 1.0f, DensityAlpha) * ScaleSteps) / ScaleSteps;
+			State.CutoffScale = FMath::RoundToFloat(FMath::Lerp(Settings.MinCutoffScale, 1.0f, CutoffAlpha) * ScaleSteps) / ScaleSteps;
+		}
+
+		FSettings Settings;
+		FState State;
+	};
+}
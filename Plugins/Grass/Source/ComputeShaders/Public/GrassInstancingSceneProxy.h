@@ -27,6 +27,14 @@
 
 #include "GrassInstancingVertexFactory.h"
 #include "GrassData.h"
+#include "GrassLod.h"
+#include "GrassBendState.h"
+#include "GrassBudget.h"
+#include "GrassGovernor.h"
+#include "GrassFarField.h"
+#include "GrassForceMap.h"
+#include "GrassSpecies.h"
+#include "GrassWind.h"
 #include "GrassFieldComponent.h"
 #include "GrassShaders.h"
 
@@ -37,30 +45,32 @@ class FGrassInstancingRendererExtension;
 namespace GrassUtils
 {
 	static constexpr int32 IndirectArgsPerElementSize = sizeof(uint32);
-	static constexpr int32 IndirectArgsBytesSize = 5 * IndirectArgsPerElementSize;
+	/** Elements of the DrawIndexedInstancedIndirect args of a single draw, a LOD bucket of a species (see GetGrassDrawIndex). */
+	static constexpr int32 IndirectArgsNumElements = 5;
+	/** First element holding the instance offset of each draw (see GrassCompute.usf). */
+	static constexpr int32 InstanceOffsetsElementOffset = MAX_GRASS_DRAWS * IndirectArgsNumElements;
+	/** Element holding the number of blades that survived the culling. */
+	static constexpr int32 CulledCountElementOffset = InstanceOffsetsElementOffset + MAX_GRASS_DRAWS;
+	/** First element holding the blade count of each distance bin of each draw. */
+	static constexpr int32 DistanceBinCountsElementOffset = CulledCountElementOffset + 1;
+	static constexpr int32 IndirectArgsBytesSize = (DistanceBinCountsElementOffset + MAX_GRASS_DRAWS * NUM_DISTANCE_BINS) * IndirectArgsPerElementSize;
+	/** Largest side of mip 0 of the occlusion HZB, the depth is reduced by a larger footprint past it. */
+	static constexpr int32 MaxOcclusionHZBSize = 1024;
 
 	/** Buffers filled by GPU culling. */
 	struct COMPUTESHADERS_API FPersistentBuffers
 	{
-		FGrassInstancingSectionProxy* SectionProxy = nullptr;
+		/** Section, or scene proxy when the sections are batched, the buffers have been allocated for. */
+		const void* Owner = nullptr;
+		/** Maximum number of instances the buffers can hold. */
+		uint32 Capacity = 0;
 
-		/* GrassData buffer. */
-		FBufferRHIRef GrassDataBuffer;
-		FShaderResourceViewRHIRef GrassDataBufferSRV;
-
-		/* ForceMap buffer. */
-		FBufferRHIRef GrassForceMap;
-		FUnorderedAccessViewRHIRef GrassForceMapUAV;
-		FShaderResourceViewRHIRef GrassForceMapSRV;
-
-		/* Culled instance buffer. */
-		FBufferRHIRef InstanceBuffer;
-		FUnorderedAccessViewRHIRef InstanceBufferUAV;
+		/* Culled instance buffer, pooled so that the render graph can track its accesses and schedule the culling on any pipe. */
+		TRefCountPtr<FRDGPooledBuffer> InstanceBuffer;
 		FShaderResourceViewRHIRef InstanceBufferSRV;
 		
 		/* IndirectArgs buffer for final DrawInstancedIndirect. */
-		FBufferRHIRef IndirectArgsBuffer;
-		FUnorderedAccessViewRHIRef IndirectArgsBufferUAV;
+		TRefCountPtr<FRDGPooledBuffer> IndirectArgsBuffer;
 		FShaderResourceViewRHIRef IndirectArgsBufferSRV;
 	};
 
@@ -80,9 +90,23 @@ namespace GrassUtils
 	{
 		bool IsValid = false;
 		bool bIsCullingEnabled;
-		TResourceArray<GrassUtils::FPackedGrassData>* GrassData;
+		FRHIShaderResourceView* GrassDataBufferSRV;
+		uint32 GrassDataNum;
 		float CutoffDistance;
-		int NumIndices;
+		FUintVector2 MinMaxLod;
+		const FGrassLodPolicy* LodPolicy;
+		/** Box the origins of compact instances are quantized in. */
+		FBox3f InstanceBounds = FBox3f(ForceInitToZero);
+		/** Fraction of the blades granted by the instance budget, on top of the density falloff. Unlike the falloff it doesn't widen the blades. */
+		float DensityScale = 1.0f;
+		/** Cross-fade with the far field, see GetFarFieldFadeParameter, zero without a far field. */
+		FVector2f FarFieldFade = FVector2f::ZeroVector;
+		/** The section holds the cards of the far field. */
+		bool bIsFarField = false;
+		/** First bend state of the blades of the section, NO_BEND_STATE to bend them without a state. */
+		uint32 BendStateOffset = NO_BEND_STATE;
+		/** Species of the blades of the section, each one is culled into its own draws. */
+		uint32 NumSpecies = 1;
 	};
 
 	/** View description used for LOD calculation in the main view. */
@@ -93,8 +117,8 @@ namespace GrassUtils
 		FVector3f ViewOrigin;
 		FMatrix44f ViewMatrix;
 		FMatrix44f ViewProjectionMatrix;
-		float LodBiasScale;
-		FVector4 LodDistances;
+		/** Projection data used by the LOD metric. */
+		FGrassLodView LodView;
 	};
 
 	/** View description used for culling in the child view. */
@@ -106,14 +130,77 @@ namespace GrassUtils
 		FMatrix44f ViewMatrix;
 		FMatrix44f ViewProjectionMatrix;
 		bool bIsMainView;
+		/** Shadow depth views cull against the light frustum with reduced density. */
+		bool bIsShadowView = false;
+		/** Inward facing world space planes of the cull volume, in double precision until they are made view relative. */
+		TArray<FVector4, TInlineAllocator<MAX_CULL_PLANES>> CullPlanes;
+		/** Only one blade every DensityStride is kept. */
+		uint32 DensityStride = 1;
+	};
+
+	/** Light, or cascade of a light, a shadow depth view renders. Matched across frames to find the shadow culled for it. */
+	struct COMPUTESHADERS_API FShadowViewIdentity
+	{
+		bool bPerspective = false;
+		/** World space origin of the shadow, the light of a perspective shadow or the center of a cascade. */
+		FVector Origin = FVector::ZeroVector;
+		FVector3f Direction = FVector3f::ForwardVector;
+		/** Horizontal scale of the projection, each cascade of a light has its own. */
+		float ProjectionScale = 1.0f;
+	};
+
+	/**
+	 * How far apart two shadow identities are from one frame to the next, 1 or more for shadows of different lights
+	 * or cascades: a turn of about 20 degrees, a projection twice as wide, or a light moved by 500 units.
+	 */
+	inline float ComputeShadowMatchCost(const FShadowViewIdentity& A, const FShadowViewIdentity& B)
+	{
+		if (A.bPerspective != B.bPerspective)
+			return MAX_flt;
+
+		const float DirectionCost = (1.0f - FVector3f::DotProduct(A.Direction, B.Direction)) * 16.0f;
+		const float ScaleCost = FMath::Abs(FMath::Log2(
+			FMath::Max(A.ProjectionScale, UE_SMALL_NUMBER) / FMath::Max(B.ProjectionScale, UE_SMALL_NUMBER)));
+		// The cascades follow the camera, only the perspective shadows stay at their light
+		const float OriginCost = A.bPerspective ? static_cast<float>(FVector::Dist(A.Origin, B.Origin)) / 500.0f : 0.0f;
+		return DirectionCost + ScaleCost + OriginCost;
+	}
+
+	/** A section to cull into the buffers of a work item. */
+	struct COMPUTESHADERS_API FSectionWork
+	{
+		FGrassInstancingSectionProxy* Section;
+		/** Buckets the blades of the section are clamped to. */
+		FUintVector2 LodBucketRange;
+		/** Fraction of the blades granted by the instance budget of the view and the governor, set by the renderer extension, 0 to skip the section. */
+		float DensityScale = 1.0f;
+		/** Scale of the cutoff distance of the section applied by the governor. */
+		float CutoffScale = 1.0f;
+		/** First bend state of the blades of the section in the pool of the renderer extension, set at the start of the frame. */
+		uint32 BendStateOffset = NO_BEND_STATE;
 	};
 
 	/** Structure to carry RDG resources. */
 	struct COMPUTESHADERS_API FVolatileResources
 	{
+		/** Persistent buffers of the work item registered in the graph. */
+		FRDGBufferRef InstanceBuffer;
+		FRDGBufferUAVRef InstanceBufferUAV;
+
+		FRDGBufferRef IndirectArgsBuffer;
+		FRDGBufferUAVRef IndirectArgsBufferUAV;
+
 		FRDGBufferRef CulledGrassDataBuffer;
 		FRDGBufferUAVRef CulledGrassDataBufferUAV;
 		FRDGBufferSRVRef CulledGrassDataBufferSRV;
+
+		FRDGBufferRef CulledLodBuffer;
+		FRDGBufferUAVRef CulledLodBufferUAV;
+		FRDGBufferSRVRef CulledLodBufferSRV;
+
+		/** Dispatch args of ComputeInstanceGrassDataCS, sized by the cull pass from the culled count. */
+		FRDGBufferRef DispatchArgsBuffer;
+		FRDGBufferUAVRef DispatchArgsBufferUAV;
 	};
 }
 
@@ -122,13 +209,7 @@ const static FName NAME_GrassInstancing(TEXT("GrassInstancing"));
 class COMPUTESHADERS_API FGrassInstancingSectionProxy
 {
 public:
-	explicit FGrassInstancingSectionProxy(const ERHIFeatureLevel::Type FeatureLevel);
-	
-	~FGrassInstancingSectionProxy()
-	{
-		if (VertexFactory.IsInitialized())
-			VertexFactory.ReleaseResource();
-	}
+	FGrassInstancingSectionProxy() = default;
 
 	static SIZE_T GetTypeHash()
 	{
@@ -137,12 +218,36 @@ public:
 	}
 
 	TResourceArray<GrassUtils::FPackedGrassData> GrassData;
+	/** Number of blades, GrassData may be discarded once uploaded. */
+	uint32 GrassDataNum = 0;
 	FBox Bounds = FBox(ForceInitToZero);
-	uint32 NumIndices = 0;
+	/** Box of the blades of the owning scene proxy, the origins of compact instances are quantized in it. */
+	FBox3f InstanceBounds = FBox3f(ForceInitToZero);
 	float CutoffDistance = 0.0f;
 	bool bIsGPUCullingEnabled = true;
-	
-	FGrassInstancingVertexFactory VertexFactory;
+	/** The section holds the cards of the far field of the blade section of the same index, see GrassUtils::FGrassFarField. */
+	bool bIsFarField = false;
+	/** Cutoff distance of the blades, the cards of a far field section start there. */
+	float BladeCutoffDistance = 0.0f;
+	/** Width of the cross-fade between the blades and the cards before BladeCutoffDistance, 0 without a far field. */
+	float FarFieldFadeDistance = 0.0f;
+	/** Unique across the sections ever created, identifies the content of the section in the culling cache. */
+	uint32 Revision = 0;
+	/** Scene of the owning scene proxy, the blades are bent by the force map of that scene only. */
+	const FSceneInterface* Scene = nullptr;
+
+	/** LOD steps of bucket 0 and of the last bucket. */
+	FUintVector2 MinMaxLodSteps = FUintVector2(0, 0);
+	/** LOD policy of the owning scene proxy. */
+	const GrassUtils::FGrassLodPolicy* LodPolicy = nullptr;
+	/** Indices drawn for each LOD bucket. */
+	uint32 LodNumIndices[MAX_LOD_BUCKETS] = {};
+	/** Species packed in the index of the blades, see GrassUtils::PackGrassBladeIndex. */
+	uint32 NumSpecies = 1;
+
+	/** Blades of the section, uploaded once and shared by all the work items culling it. */
+	FBufferRHIRef GrassDataBuffer;
+	FShaderResourceViewRHIRef GrassDataBufferSRV;
 };
 
 struct COMPUTESHADERS_API FGrassMeshLodData
@@ -155,28 +260,36 @@ struct COMPUTESHADERS_API FGrassMeshLodData
 	FGrassInstancingIndexBuffer* IndexBuffer;
 	FGrassInstancingVertexBuffer* VertexBuffer;
 
-	FGrassMeshLodData()
-		: IndexBuffer(nullptr)
-		, VertexBuffer(nullptr)
-	{
-		
-	}
+	/** Vertex factory bound to this LOD's vertex buffer, shared by all the sections, of the permutation selected by the cvars. */
+	TUniquePtr<FGrassInstancingVertexFactory> VertexFactory;
 
-	explicit FGrassMeshLodData(const uint8 Steps)
+	FGrassMeshLodData(const uint8 Steps, const ERHIFeatureLevel::Type FeatureLevel)
 		: Steps(Steps)
+		, VertexFactory(CreateGrassInstancingVertexFactory(FeatureLevel))
 	{
 		IndexBuffer = new FGrassInstancingIndexBuffer();
 		VertexBuffer = new FGrassInstancingVertexBuffer();
 
-		CreateGrassModels(VertexBuffer->Vertices, IndexBuffer->Indices, Steps);
+		// The procedural blades only need the indices, the vertex buffer stays empty and is never created
+		if (VertexFactory->UsesVertexStreams())
+		{
+			CreateGrassModels(VertexBuffer->Vertices, IndexBuffer->Indices, Steps);
+		}
+		else
+		{
+			GrassUtils::CreateGrassBladeIndices(IndexBuffer->Indices, Steps);
+		}
 		
 		NumIndices = IndexBuffer->Indices.Num();
-		NumVertices = VertexBuffer->Vertices.Num();
+		NumVertices = GrassUtils::GetGrassBladeNumVertices(Steps);
 
 	}
 
 	~FGrassMeshLodData()
 	{
+		if (VertexFactory->IsInitialized())
+			VertexFactory->ReleaseResource();
+
 		if (IndexBuffer->IsInitialized())
 			IndexBuffer->ReleaseResource();
 
@@ -187,6 +300,19 @@ struct COMPUTESHADERS_API FGrassMeshLodData
 		delete IndexBuffer;
 	}
 
+	/** Mesh of the cards of the far field, always drawn with fetched vertices. */
+	FGrassMeshLodData(const GrassUtils::FGrassFarField& FarField, const float BladeWidth, const ERHIFeatureLevel::Type FeatureLevel)
+		: VertexFactory(CreateGrassInstancingVertexFactory(FeatureLevel, GetGrassCardVertexFactoryFlags()))
+	{
+		IndexBuffer = new FGrassInstancingIndexBuffer();
+		VertexBuffer = new FGrassInstancingVertexBuffer();
+
+		GrassUtils::CreateFarFieldCardModel(VertexBuffer->Vertices, IndexBuffer->Indices, FarField.BladesPerCard, BladeWidth);
+
+		NumIndices = IndexBuffer->Indices.Num();
+		NumVertices = VertexBuffer->Vertices.Num();
+	}
+
 	void InitResources() const
 	{
 		IndexBuffer->InitResource();
@@ -207,36 +333,114 @@ protected:
 	virtual void CreateRenderThreadResources() override;
 	virtual void DestroyRenderThreadResources() override;
 	virtual void OnTransformChanged() override;
-	// virtual bool HasSubprimitiveOcclusionQueries() const override;
-	// virtual const TArray<FBoxSphereBounds>* GetOcclusionQueries(const FSceneView* View) const override;
-	// virtual void AcceptOcclusionResults(const FSceneView* View, TArray<bool>* Results, int32 ResultsStart, int32 NumResults) override;
+	virtual bool HasSubprimitiveOcclusionQueries() const override;
+	virtual const TArray<FBoxSphereBounds>* GetOcclusionQueries(const FSceneView* View) const override;
+	virtual void AcceptOcclusionResults(const FSceneView* View, TArray<bool>* Results, int32 ResultsStart, int32 NumResults) override;
 	virtual FPrimitiveViewRelevance GetViewRelevance(const FSceneView *View) const override;
 	virtual void GetDynamicMeshElements(const TArray<const FSceneView *> &Views, const FSceneViewFamily &ViewFamily, uint32 VisibilityMap, FMeshElementCollector &Collector) const override;
 	//~ End FPrimitiveSceneProxy Interface
 
+	/** MainView is the view the blades of the buffers have been culled and LOD'ed for, the lead view of the group of ViewIndex. */
 	void CreateBaseMeshBatch(
         FMeshElementCollector& Collector,
         const FSceneViewFamily& ViewFamily,
         int32 ViewIndex,
-        const FGrassMeshLodData* Lod,
-        FGrassInstancingSectionProxy* Section) const;
+        const FSceneView* MainView,
+        const GrassUtils::FPersistentBuffers& Buffers,
+        uint32 Species,
+        uint32 LodBucket,
+        const FGrassMeshLodData* Lod) const;
+
+	/** One mesh batch per LOD bucket in range of each species, all drawn from the same buffers. */
+	void CreateLodMeshBatches(
+		FMeshElementCollector& Collector,
+		const FSceneViewFamily& ViewFamily,
+		int32 ViewIndex,
+		const FSceneView* MainView,
+		const GrassUtils::FPersistentBuffers& Buffers,
+		FUintVector2 LodBucketRange) const;
+
+	/**
+	 * Gather the mesh batches of a shadow depth view, culled against the light frustum.
+	 * A shadow isn't tied to a camera, its blades take the LODs of the first view of the family.
+	 */
+	void GetShadowMeshElements(
+		const FSceneViewFamily& ViewFamily,
+		int32 ViewIndex,
+		const FSceneView* View,
+		const FConvexVolume& ShadowCullFrustum,
+		const GrassUtils::FGrassLodView& LodView,
+		FMeshElementCollector& Collector) const;
 	
 private:
-	void BuildOcclusionVolumes(TArrayView<FVector2D> const &InMinMaxData, FIntPoint const &InMinMaxSize, TArrayView<int32> const &InMinMaxMips, int32 InNumLods);
+	/** One occlusion query per section, over the section bounds raised by the tallest blade. */
+	void BuildOcclusionVolumes();
+
+	/** Whether the occlusion queries of the last frame found the section occluded in all the given views. */
+	bool IsSectionOccluded(int32 SectionIndex, const TArray<const FSceneView*>& Views, TConstArrayView<int32> ViewIndices) const;
+
+	/** Occlusion query results of a view, per section. */
+	struct FSectionOcclusion
+	{
+		TBitArray<> Occluded;
+		/** Frame the results have been accepted in, they are only valid during that frame. */
+		uint32 FrameNumber = 0;
+	};
+
+	TArray<FBoxSphereBounds> OcclusionVolumes;
+	/** Occlusion results of each view, by view key. */
+	TMap<uint32, FSectionOcclusion> SectionOcclusions;
 
 public:
 	bool bHiddenInEditor;
 	bool bCallbackRegistered;
 	
 	class FMaterialRenderProxy *Material;
+	/** Overrides of Material for the coarser LODs, by increasing maximum LOD steps. */
+	TArray<TPair<uint32, FMaterialRenderProxy*>> LodMaterials;
+	/** Material of each species, nullptr for the species drawn with Material. */
+	TArray<FMaterialRenderProxy*, TInlineAllocator<MAX_GRASS_SPECIES>> SpeciesMaterials;
+	/** Relevance of Material, of the overrides and of the species materials. */
 	FMaterialRelevance MaterialRelevance;
+	/** Species of the blades, at least one. */
+	uint32 NumSpecies = 1;
+
+	/** Material the blades of a species are drawn with at a LOD, the LOD overrides win over the species materials. */
+	FMaterialRenderProxy* GetLodMaterial(const uint32 LodSteps, const uint32 Species = 0) const;
 
 	float CutoffDistance;
 	bool bIsCPUCullingEnabled;
 	FUintVector2 MinMaxLodSteps;
 
+	/** Selects the LOD bucket range of each section, mutable as it tracks the selection history per view. */
+	mutable GrassUtils::FGrassLodPolicy LodPolicy;
+
 	TMap<uint8, FGrassMeshLodData*> Lods;
 	TArray<FGrassInstancingSectionProxy*> Sections;
+	/** Blades of all the sections, capacity of the buffers when the sections are batched. */
+	uint32 TotalGrassDataNum = 0;
+	/** Box of the blades of all the sections, see FGrassInstancingSectionProxy::InstanceBounds. */
+	FBox3f InstanceBounds = FBox3f(ForceInitToZero);
+
+	GrassUtils::FGrassFarField FarField;
+	/** Cards of the far field of each section, by section index, empty without a far field. */
+	TArray<FGrassInstancingSectionProxy*> FarFieldSections;
+	/** Mesh drawn for every card, created with the render thread resources. */
+	TUniquePtr<FGrassMeshLodData> FarFieldCardMesh;
+	/** Relative width of the blades of the card mesh, see GrassUtils::ComputeFarFieldCardBladeWidth. */
+	float FarFieldCardBladeWidth = 0.0f;
+	/** Cards of all the sections, capacity of their buffers. */
+	uint32 TotalFarFieldCardNum = 0;
+
+private:
+	/** Add the culling of the cards of the far field seen by a group of views sharing their culling, and their mesh batches. */
+	void GetFarFieldMeshElements(
+		const TArray<const FSceneView*>& Views,
+		const FSceneViewFamily& ViewFamily,
+		TConstArrayView<int32> ViewIndices,
+		const FConvexVolume& CullVolume,
+		const GrassUtils::FGrassLodView& LodView,
+		FMeshElementCollector& Collector) const;
 };
 
 //  Notes: Looks like GetMeshShaderMap is returning nullptr during the DepthPass
@@ -262,15 +466,59 @@ public:
 	/** Call once per frame for each mesh/view that has relevance.
 	 *  This allocates the buffers to use for the frame and adds
 	 *  the work to fill the buffers to the queue.
+	 *  All the sections are culled into the same buffers, InOwner identifies them across frames
+	 *  and InCapacity is the maximum number of blades they can hold.
+	 *  The blades are culled against InCullVolume, the frustum of InCullView or the union
+	 *  of the frusta of all the views sharing its culling.
+	 *  Buffers of InOwner still holding a valid culling of the sections are returned as they are, without any pass.
+	 *  InSections can't be empty.
+	 *  With bInAllowHZBOcclusion the blades are also tested against the HZB of the last frame of InCullView, when it has one.
 	 */
 	GrassUtils::FPersistentBuffers& AddWork(
-		FGrassInstancingSectionProxy* InSection,
+		const void* InOwner,
+		const uint32 InCapacity,
+		const TConstArrayView<GrassUtils::FSectionWork> InSections,
 		const FSceneView* InMainView,
-		const FSceneView* InCullView);
+		const FSceneView* InCullView,
+		const FConvexVolume& InCullVolume,
+		const bool bInAllowHZBOcclusion);
+
+	/** Shadow depth views are gathered while the frame is already being rendered, so their culling
+	 *  is deferred to the start of the next frame. Returns the buffers culled at the start of this frame
+	 *  for the shadow of the same owner whose identity matched InIdentity during the last frame,
+	 *  nullptr if there are none yet or if InSections is empty. OutLodBucketRange is the range of buckets they have been culled with.
+	 *  The light frustum is pushed out by the motion of the shadow between the last two frames,
+	 *  so that the blades entering it during the frame it lags behind still cast their shadow.
+	 *  Can be called in or out of frame.
+	 */
+	const GrassUtils::FPersistentBuffers* AddShadowWork(
+		const void* InOwner,
+		const uint32 InCapacity,
+		const TConstArrayView<GrassUtils::FSectionWork> InSections,
+		const FUintVector2 InLodBucketRange,
+		const GrassUtils::FMainViewDesc& InMainViewDesc,
+		const GrassUtils::FChildViewDesc& InShadowViewDesc,
+		const GrassUtils::FShadowViewIdentity& InIdentity,
+		FUintVector2& OutLodBucketRange);
+
+	/** Drop the pending work and the buffers of an owner, its sections are about to be destroyed. */
+	void RemoveOwner(const void* InOwner);
 
 	/** Submit all the work added by AddWork(). The work fills all of the buffers ready for use by the referencing mesh batches. */
 	void SubmitWork(FRDGBuilder& GraphBuilder);
 
+	/** Cull a reference field with every thread group size during the next frames and log the timings of the passes. */
+	void RequestThreadGroupBenchmark(const uint32 InNumBlades, const uint32 InIterations);
+
+	/** Reduce the depth of a view into the HZB its blades are tested against during the next frame. */
+	void CaptureOcclusionHZB(FRDGBuilder& GraphBuilder, const FSceneView& InView, FRDGTextureRef InSceneDepth);
+
+	/** Quality the frame-time governor currently applies, full quality while it is disabled. */
+	const GrassUtils::FGrassGovernor::FState& GetGovernorState() const { return Governor.GetState(); }
+
+	/** Interactors splatted into the force map of a scene from the next frame on, until they are replaced. */
+	void SetInteractors(const FSceneInterface* InScene, TArray<GrassUtils::FGrassInteractor>&& InInteractors);
+
 protected:
 	//~ Begin FRenderResource Interface
 	virtual void ReleaseRHI() override;
@@ -284,30 +532,268 @@ private:
 	void EndFrame(FRDGBuilder& GraphBuilder);
 	void EndFrame();
 
+	/** Add the passes culling the sections of a work item into its buffers, once its indirect args have been reset.
+	 *  With bFusedInstanceData the cull passes write the instances themselves and the instance pass is skipped.
+	 *  With bDistanceBins the blades of each LOD bucket are laid out near to far by distance bin, it excludes bFusedInstanceData.
+	 *  HZBParameters is the HZB the blades are tested against, nullptr to skip the occlusion test.
+	 *  WindParameters and ForceMapParameters are the wind and the interactors the instances are bent by as they are written.
+	 *  BendStates holds the bend of the sections with a state, see FSectionWork::BendStateOffset.
+	 */
+	static void AddCullingPasses(
+		FRDGBuilder& GraphBuilder,
+		const TConstArrayView<GrassUtils::FSectionWork> WorkSections,
+		const TRDGUniformBufferRef<GrassUtils::FGrassViewParameters> ViewUniformBuffer,
+		const GrassUtils::FGrassHZBParameters* HZBParameters,
+		const GrassUtils::FGrassWindParameters& WindParameters,
+		const GrassUtils::FGrassForceMapParameters& ForceMapParameters,
+		FRDGBufferSRVRef BendStates,
+		const GrassUtils::FVolatileResources& VolatileResources,
+		const bool bFusedInstanceData,
+		const bool bDistanceBins,
+		const float CullMargin);
+
 	/** Flag for frame validation. */
 	bool bInFrame;
 
-	/** Buffers to fill. Resources can persist between frames to reduce allocation cost, but contents don't persist. */
+	/** Culling a buffer has been filled with, so that work items producing the same result can skip their passes. */
+	struct FCachedCulling
+	{
+		/** Hash of the sections, their revisions and bucket ranges, 0 if the content can't be reused. */
+		uint32 SectionsKey = 0;
+		/** Hash of the quantized views. */
+		uint32 ViewKey = 0;
+		/** Volume and origin the buffer has been culled with, before the amortized culling margin. */
+		FConvexVolume CullVolume;
+		FVector Origin = FVector::ZeroVector;
+		/** Distance the cull volume and the cutoff distance have been pushed out by, 0 for an exact culling. */
+		float Margin = 0.0f;
+	};
+
+	/** Instance budget of a view, r.Grass.InstanceBudget. */
+	struct FInstanceBudget
+	{
+		/** Requests of the sections gathered this frame, the scale is solved from them for the next frame. */
+		TArray<GrassUtils::FGrassBudgetRequest> Requests;
+		/** Scale of the priorities granted to the sections, MAX_flt while everything fits. */
+		float Scale = MAX_flt;
+		/** Frame time stamp of the last request. */
+		uint32 RequestedId = 0;
+	};
+
+	/** Thin out the sections of a work item of InMainView to fit its instance budget, as solved during the last frame. */
+	void ApplyInstanceBudget(const FSceneView* InMainView, TArrayView<GrassUtils::FSectionWork> InOutSections);
+
+	/** Solve the scale of every budget from the requests of the frame. */
+	void UpdateInstanceBudgets();
+
+	/** Budget of each main view, by view key. */
+	TMap<uint32, FInstanceBudget> InstanceBudgets;
+
+	/** Feed the governor with the timings of the last frames that are available, r.Grass.GovernorTargetMs. */
+	void UpdateGovernor();
+
+	GrassUtils::FGrassGovernor Governor;
+	/** Timestamps before and after the culling and instance passes of the frames the governor hasn't read yet, oldest first. Graphics pipe only. */
+	TArray<TPair<FRenderQueryRHIRef, FRenderQueryRHIRef>> GovernorTimestamps;
+
+	/** Time of the view family of the frame, the game time can't be read from the render thread. */
+	FGameTime FrameTime;
+
+	/** Update the wind of the frame from r.Grass.Wind*, creating the gust texture the first time it blows. */
+	void UpdateWind();
+
+	/** Gust texture of the wind, see GrassUtils::BuildWindGustTexture. */
+	FTextureRHIRef WindGustTexture;
+	/** Wind of the frame, disabled at zero strength. */
+	GrassUtils::FGrassWindParameters WindParameters;
+
+	/** Splat the interactors of every scene into its force map, around the first main view of the scene, r.Grass.ForceMap. */
+	void UpdateForceMaps(FRDGBuilder& GraphBuilder);
+
+	/** Force map of the interactors, persistent across frames. */
+	struct FForceMapState
+	{
+		TRefCountPtr<IPooledRenderTarget> Texture;
+		GrassUtils::FGrassForceMap Settings;
+		FVector ViewOrigin = FVector::ZeroVector;
+		FIntPoint OriginTexel = FIntPoint::ZeroValue;
+		float ReferenceZ = 0.0f;
+		/** Largest force left in the map, it is dropped once the blades all stand back up. */
+		float Remaining = 0.0f;
+	};
+
+	/** Interactors of a world and the force map they are splatted into, the blades of other scenes don't see them. */
+	struct FSceneForces
+	{
+		FForceMapState ForceMap;
+		/** Interactors of the last batch handed by the game thread. */
+		TArray<GrassUtils::FGrassInteractor> Interactors;
+		/** Force map parameters of the frame, allocated by its graph. */
+		const GrassUtils::FGrassForceMapParameters* Parameters = nullptr;
+		/** Last frame the scene was drawn or handed interactors, it is dropped some frames later. */
+		uint32 SeenId = 0;
+	};
+
+	/** Splat the interactors of a scene into its force map, centered on the view origin when the scene is drawn this frame. */
+	void UpdateForceMap(FRDGBuilder& GraphBuilder, const GrassUtils::FGrassForceMap& Settings, const FVector* InViewOrigin, FSceneForces& Forces);
+
+	/** Force map parameters of the frame for the blades of a scene, disabled for a scene without interactors. */
+	const GrassUtils::FGrassForceMapParameters& GetForceMapParameters(const FSceneInterface* InScene) const;
+
+	TMap<const FSceneInterface*, FSceneForces> SceneForces;
+	/** Disabled force map parameters of the frame, allocated by its graph. */
+	const GrassUtils::FGrassForceMapParameters* NoForceMapParameters = nullptr;
+
+	/**
+	 * Give the sections of the frame nearest to the first main view a bend state and step it under the wind and the interactors,
+	 * r.Grass.BendState. Sets the bend state offset of the sections of the frame and of the pending shadow work.
+	 */
+	void UpdateBendStates(FRDGBuilder& GraphBuilder);
+
+	/** Ranges of the bend state buffer, by section revision. */
+	GrassUtils::FGrassBendStatePool BendStatePool;
+	/** Bend state of the blades of the pool, persistent across frames. */
+	TRefCountPtr<FRDGPooledBuffer> BendStateBuffer;
+	/** Single zeroed state bound in place of the pool while no section has a state, created once. */
+	TRefCountPtr<FRDGPooledBuffer> NoBendStateBuffer;
+	/** Frame time stamp the sections of the pool have last been culled, by section revision. */
+	TMap<uint32, uint32> BendStateSeenIds;
+	/** Bend states of the frame, a dummy buffer without a pool. */
+	FRDGBufferSRVRef BendStatesSRV = nullptr;
+
+	/** Find a buffer of InOwner that is free this frame and already holds the culling of a work item, INDEX_NONE if there is none. */
+	int32 FindCachedBuffer(
+		const void* InOwner,
+		const uint32 InCapacity,
+		const FCachedCulling& InCulling,
+		const double InCutoffDistance) const;
+
+	/**
+	 * Cull again the work items of the frame whose blades the wind, the force map or their bend state move,
+	 * and keep their buffers from being reused. Runs once the animation of the frame is known.
+	 */
+	void InvalidateAnimatedCullings();
+
+	/** Furthest depth pyramid of the last frame of a view. */
+	struct FOcclusionHZB
+	{
+		TRefCountPtr<IPooledRenderTarget> Texture;
+		/** World space view projection the depth has been rendered with. */
+		FMatrix ViewProjection;
+		/** Size of the view rect in texels of mip 0. */
+		FVector2f ViewSize;
+		uint32 NumMips = 0;
+		/** Frame of the view the depth belongs to. */
+		uint32 FrameNumber = 0;
+		/** Frame time stamp of the capture. */
+		uint32 CapturedId = 0;
+	};
+
+	/** HZB captured during the last frame of a view that can be culled against, nullptr if there is none. */
+	const FOcclusionHZB* FindOcclusionHZB(const FSceneView* InView) const;
+
+	/** HZB of each view, by view key. */
+	TMap<uint32, FOcclusionHZB> OcclusionHZBs;
+
+	/** Thread group size sweep requested by r.Grass.BenchmarkThreadGroupSizes. */
+	struct FThreadGroupBenchmark
+	{
+		uint32 NumBlades = 0;
+		uint32 Iterations = 0;
+		/** Reference field, culled as a single section. */
+		FGrassInstancingSectionProxy Section;
+		GrassUtils::FGrassLodPolicy LodPolicy;
+		GrassUtils::FPersistentBuffers Buffers;
+		/** Before the cull pass, after the cull pass and after the instance pass, for each size and iteration. */
+		TArray<FRenderQueryRHIRef> Timestamps;
+		/** Frames spent waiting for the timestamps. */
+		uint32 FramesWaited = 0;
+	};
+
+	/** Add the passes of a new benchmark, or log the results of the running one once they are available. */
+	void UpdateThreadGroupBenchmark(FRDGBuilder& GraphBuilder);
+	void AddThreadGroupBenchmarkPasses(FRDGBuilder& GraphBuilder);
+
+	TUniquePtr<FThreadGroupBenchmark> Benchmark;
+
+	/** Buffers to fill. Resources can persist between frames to reduce allocation cost, contents are reused while their culling is still valid. */
 	TArray<GrassUtils::FPersistentBuffers> Buffers;
 	/** Per buffer frame time stamp of last usage. */
 	TArray<uint32> DiscardIds;
+	/** Per buffer culling of the content. */
+	TArray<FCachedCulling> CachedCullings;
 	/** Current frame time stamp. */
 	uint32 DiscardId;
 
-	/** Array of unique scene proxies to render this frame. */
-	TArray<FGrassInstancingSectionProxy*> SceneProxies;
+	/** Array of unique buffer owners to render this frame. */
+	TArray<const void*> Owners;
+	/** Sections culled by the work items, each work item references a contiguous range. */
+	TArray<GrassUtils::FSectionWork> SectionWorks;
 	/** Array of unique main views to render this frame. */
 	TArray<const FSceneView*> MainViews;
 	/** Array of unique culling views to render this frame. */
 	TArray<const FSceneView*> CullViews;
+	/** Volume each culling view is culled against. */
+	TArray<FConvexVolume> CullVolumes;
+
+	/** Shadow work gathered during the frame, the view descriptions are copied as the views don't outlive the frame. */
+	struct FShadowWorkDesc
+	{
+		/** Owner and id of the shadow, see FShadowTrack. */
+		TPair<const void*, uint32> Key;
+		uint32 Capacity;
+		TArray<GrassUtils::FSectionWork> Sections;
+		FUintVector2 LodBucketRange;
+		GrassUtils::FMainViewDesc MainViewDesc;
+		GrassUtils::FChildViewDesc ShadowViewDesc;
+		/** Distance the light frustum is pushed out by, the motion of the shadow during the last frame. */
+		float CullMargin = 0.0f;
+	};
+
+	/** Identity of a shadow gathered by an owner, with the id its buffers are kept under as long as it keeps matching. */
+	struct FShadowTrack
+	{
+		uint32 Id;
+		GrassUtils::FShadowViewIdentity Identity;
+	};
+
+	/** Buffers of a shadow gather, persistent across frames. */
+	struct FShadowBuffers
+	{
+		GrassUtils::FPersistentBuffers Buffers;
+		/** Union of the bucket ranges of the sections culled into the buffers. */
+		FUintVector2 LodBucketRange = FUintVector2(0, 0);
+		/** Frame time stamp of the last culling. */
+		uint32 FilledId = 0;
+	};
+
+	/** Shadow work to cull at the start of the next frame. */
+	TArray<FShadowWorkDesc> PendingShadowWorks;
+	/** Shadows gathered by each owner during the last frame, the shadows of this frame are matched against them. */
+	TMap<const void*, TArray<FShadowTrack>> ShadowTracks;
+	/** Shadows gathered by each owner during this frame. */
+	TMap<const void*, TArray<FShadowTrack>> FrameShadowTracks;
+	/** Id of the next shadow without a match. */
+	uint32 NextShadowId = 0;
+	/** Buffers of each shadow, by owner and id. */
+	TMap<TPair<const void*, uint32>, FShadowBuffers> ShadowBuffers;
 
 	/** Key for each buffer we need to generate. */
 	struct FWorkDesc
 	{
-		int8 ProxyIndex;
+		int16 OwnerIndex;
 		int8 MainViewIndex;
 		int8 CullViewIndex;
-		int8 BufferIndex;
+		int16 BufferIndex;
+		/** Range of SectionWorks to cull into the buffer. */
+		int32 FirstSection;
+		int32 NumSections;
+		/** The buffer already holds the culling of the work item, no pass needs to run. */
+		bool bCached = false;
+		/** Distance the cull volume is pushed out by for the amortized culling. */
+		float CullMargin = 0.0f;
+		/** The blades are tested against the HZB of the cull view. */
+		bool bHZBOcclusion = false;
 	};
 
 	/** Keys specifying what to render. */
@@ -316,12 +802,12 @@ private:
 	/** Sort predicate for FWorkDesc. When rendering we want to batch work by proxy, then by main view. */
 	struct FWorkDescSort
 	{
-		static uint32 SortKey(const FWorkDesc& WorkDesc)
+		static uint64 SortKey(const FWorkDesc& WorkDesc)
 		{
-			return (WorkDesc.ProxyIndex    << 24)
-				|  (WorkDesc.MainViewIndex << 16)
-				|  (WorkDesc.CullViewIndex << 8)
-				|  (WorkDesc.BufferIndex);
+			return (static_cast<uint64>(WorkDesc.OwnerIndex)    << 32)
+				|  (static_cast<uint64>(WorkDesc.MainViewIndex) << 24)
+				|  (static_cast<uint64>(WorkDesc.CullViewIndex) << 16)
+				|  (static_cast<uint64>(WorkDesc.BufferIndex));
 		}
 
 		bool operator()(const FWorkDesc& A, const FWorkDesc& B) const
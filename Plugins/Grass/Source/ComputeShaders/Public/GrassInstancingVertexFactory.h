@@ -11,8 +11,15 @@
 struct FGrassInstancingUserData : FOneFrameResource
 {
 	FRHIShaderResourceView *InstanceBufferSRV;
+	/** Indirect args of the work item, they also store the first instance of each LOD bucket. */
+	FRHIShaderResourceView *IndirectArgsBufferSRV;
+	/** Element of IndirectArgsBufferSRV holding the first instance of the drawn bucket. */
+	uint32 InstanceOffsetIndex;
 	uint32 NumVertices;
 	FVector3f LodViewOrigin;
+	/** Box the origins of compact instances are quantized in, see GrassUtils::FGrassCompactInstance. */
+	FVector3f InstanceBoundsMin;
+	FVector3f InstanceBoundsSize;
 };
 
 /**
@@ -33,7 +40,7 @@ public:
 };
 
 /*
- * Index buffer to provide incides for the mesh we're rending.
+ * Index buffer to provide incides for the mesh we're rending, 16 bit as a blade has a few tens of vertices.
  */
 class FGrassInstancingIndexBuffer : public FIndexBuffer
 {
@@ -46,7 +53,7 @@ public:
 	virtual void InitRHI() override;
 	virtual void ReleaseRHI() override;
 	
-	TResourceArray<uint32> Indices;
+	TResourceArray<uint16> Indices;
 };
 
 struct FGrassInstancingVertexDataType
@@ -91,6 +98,9 @@ public:
 	
 	static bool ShouldCompilePermutation(const FVertexFactoryShaderPermutationParameters &Parameters);
 
+	/** Platform and material requirements shared by all the permutations. */
+	static bool SupportsPermutation(const FVertexFactoryShaderPermutationParameters &Parameters);
+
 	static void ModifyCompilationEnvironment(
 		const FVertexFactoryShaderPermutationParameters &Parameters, 
 		FShaderCompilerEnvironment &OutEnvironment);
@@ -108,6 +118,12 @@ public:
 		return Data;
 	}
 
+	/** Whether the vertices are fetched from the vertex buffer of the LOD, false when they are generated from the vertex id. */
+	virtual bool UsesVertexStreams() const
+	{
+		return true;
+	}
+
 
 private:
 	FGrassInstancingVertexDataType Data;
@@ -120,6 +136,66 @@ public:
 	friend class FGrassShaderParameters;
 };
 
+/** Permutations of the vertex factory, selected by read-only cvars. */
+namespace EGrassVertexFactoryFlags
+{
+	enum Type : uint32
+	{
+		None = 0,
+		/** The instances are read in the compact layout, r.Grass.CompactInstances. */
+		CompactInstances = 1 << 0,
+		/** The blade vertices are generated from the vertex id and the LOD, r.Grass.ProceduralBlades. */
+		ProceduralBlade = 1 << 1,
+	};
+}
+
+/** Flags of the vertex factory permutation selected by the cvars, the default factory is used for None. */
+COMPUTESHADERS_API uint32 GetGrassVertexFactoryFlags();
+
+/** Flags of the permutation drawing the cards of the far field: the instance layout of the cvars, always with fetched vertices. */
+COMPUTESHADERS_API uint32 GetGrassCardVertexFactoryFlags();
+
+/** Create the vertex factory of a permutation, by default the one selected by the cvars. */
+COMPUTESHADERS_API TUniquePtr<FGrassInstancingVertexFactory> CreateGrassInstancingVertexFactory(
+	const ERHIFeatureLevel::Type InFeatureLevel,
+	const uint32 InFlags = GetGrassVertexFactoryFlags());
+
+/**
+ * Permutation of the vertex factory, Flags is a combination of EGrassVertexFactoryFlags.
+ * Every permutation is compiled and the cvars pick one at runtime: read-only cvars aren't part of the shader map key,
+ * a cooked shader map would miss the permutation an ini change selects.
+ */
+template <uint32 Flags>
+class TGrassInstancingVertexFactory : public FGrassInstancingVertexFactory
+{
+	DECLARE_VERTEX_FACTORY_TYPE(TGrassInstancingVertexFactory<Flags>);
+
+public:
+	explicit TGrassInstancingVertexFactory(const ERHIFeatureLevel::Type InFeatureLevel)
+		: FGrassInstancingVertexFactory(InFeatureLevel)
+	{
+	}
+
+	static bool ShouldCompilePermutation(const FVertexFactoryShaderPermutationParameters &Parameters)
+	{
+		return FGrassInstancingVertexFactory::SupportsPermutation(Parameters);
+	}
+
+	static void ModifyCompilationEnvironment(
+		const FVertexFactoryShaderPermutationParameters &Parameters, 
+		FShaderCompilerEnvironment &OutEnvironment)
+	{
+		FGrassInstancingVertexFactory::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+		OutEnvironment.SetDefine(TEXT("COMPACT_GRASS_INSTANCES"), (Flags & EGrassVertexFactoryFlags::CompactInstances) != 0);
+		OutEnvironment.SetDefine(TEXT("PROCEDURAL_GRASS_BLADE"), (Flags & EGrassVertexFactoryFlags::ProceduralBlade) != 0);
+	}
+
+	virtual bool UsesVertexStreams() const override
+	{
+		return (Flags & EGrassVertexFactoryFlags::ProceduralBlade) == 0;
+	}
+};
+
 
 /**
  * Shader parameters for vertex factory.
@@ -145,6 +221,10 @@ public:
 protected:
 	// TODO
 	LAYOUT_FIELD(FShaderResourceParameter, InstanceBufferParameter);
+	LAYOUT_FIELD(FShaderResourceParameter, LodIndirectArgsParameter);
+	LAYOUT_FIELD(FShaderParameter, InstanceOffsetIndexParameter);
 	LAYOUT_FIELD(FShaderParameter, NumVerticesParameter);
 	LAYOUT_FIELD(FShaderParameter, LodViewOriginParameter);
+	LAYOUT_FIELD(FShaderParameter, InstanceBoundsMinParameter);
+	LAYOUT_FIELD(FShaderParameter, InstanceBoundsSizeParameter);
 };
\ No newline at end of file
@@ -0,0 +1,412 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GrassData.h"
+
+namespace GrassUtils
+{
+	/** Maximum number of LOD buckets the cull pass can scatter the blades of a work item into. */
+	#define MAX_LOD_BUCKETS 8
+
+	/** Bits of a culled LOD entry that store the rank of the blade inside its bucket. */
+	#define LOD_BUCKET_SHIFT 24
+	#define LOD_RANK_MASK ((1u << LOD_BUCKET_SHIFT) - 1)
+
+	/** Number of distance bins the blades of a LOD bucket are ordered by, near to far, when the distance bins are enabled. */
+	#define NUM_DISTANCE_BINS 4
+
+	/**
+	 * Sag of a fully bent blade tessellated with a single segment, relative to its height.
+	 * A curve of length H and curvature 1/H approximated by N segments deviates from it by ~H / (8 * N^2).
+	 */
+	#define LOD_CURVATURE_ERROR_SCALE 0.125f
+
+	/** Projection data of a view needed by the LOD metric. Filled from an FSceneView by the scene proxy. */
+	struct FGrassLodView
+	{
+		/** Position the LOD distances are measured from. */
+		FVector Origin = FVector::ZeroVector;
+		/** Size in pixels of a unit long object at unit distance from the camera. */
+		float ScreenScale = 1.0f;
+		/** Steps added to the ones selected by the metric, negative values make the view coarser. */
+		float LodBias = 0.0f;
+		/** Key of the view state the hysteresis history is tracked with, 0 for views without a state. */
+		uint32 ViewKey = 0;
+	};
+
+	// Same as ComputeLodStep and the functions following it in GrassUtils.ush.
+
+	/**
+	 * Continuous number of blade steps needed to keep the tessellation error of a blade
+	 * of the given height below the pixel error the LodScreenScale has been computed for.
+	 */
+	inline float ComputeLodStep(
+		const float Distance,
+		const float BladeHeight,
+		const float LodScreenScale,
+		const float LodBias,
+		const FUintVector2 MinMaxLod)
+	{
+		const float ProjectedError = BladeHeight * LodScreenScale / FMath::Max(Distance, 1.0f);
+
+		return FMath::Clamp(
+			FMath::Sqrt(ProjectedError) + LodBias,
+			static_cast<float>(MinMaxLod.X), static_cast<float>(MinMaxLod.Y));
+	}
+
+	/**
+	 * Bucket of a blade, 0 being the coarsest LOD (MinMaxLod.X steps).
+	 * Dither offsets the step of the blade, see ComputeLodDither.
+	 */
+	inline uint32 ComputeLodBucket(
+		const float Distance,
+		const float BladeHeight,
+		const float LodScreenScale,
+		const float LodBias,
+		const FUintVector2 MinMaxLod,
+		const float Dither)
+	{
+		return static_cast<uint32>(ComputeLodStep(Distance, BladeHeight, LodScreenScale, LodBias + Dither, MinMaxLod)) - MinMaxLod.X;
+	}
+
+	/**
+	 * Distance bin of a blade, 0 being the nearest.
+	 * The bins split the squared distance evenly so that they hold about as many blades each on a flat field.
+	 */
+	inline uint32 ComputeDistanceBin(const float DistanceSquared, const float CutoffDistanceSquared)
+	{
+		const float Bin = DistanceSquared / FMath::Max(CutoffDistanceSquared, UE_SMALL_NUMBER) * NUM_DISTANCE_BINS;
+		return FMath::Min(static_cast<uint32>(FMath::Max(Bin, 0.0f)), static_cast<uint32>(NUM_DISTANCE_BINS - 1));
+	}
+
+	/**
+	 * Stable hash of the index of a blade in its section, decorrelated from the sampling order.
+	 */
+	inline uint32 HashBladeIndex(const uint32 BladeIndex)
+	{
+		const uint32 State = BladeIndex * 747796405u + 2891336453u;
+		const uint32 Word = ((State >> ((State >> 28u) + 4u)) ^ State) * 277803737u;
+		return (Word >> 22u) ^ Word;
+	}
+
+	/**
+	 * Offset of the LOD step of a blade in [-HysteresisBand / 2, HysteresisBand / 2), stable from frame to frame.
+	 * The blades of a field cross a LOD boundary spread over a band of distances instead of all at the same distance,
+	 * so that a camera moving back and forth across it only flips a few of them.
+	 */
+	inline float ComputeLodDither(const uint32 BladeIndex, const float HysteresisBand)
+	{
+		return (static_cast<float>(HashBladeIndex(BladeIndex) & 0xff) * (1.0f / 256.0f) - 0.5f) * HysteresisBand;
+	}
+
+	/**
+	 * Thinning of the blades with the distance: all of them are kept up to StartDistance,
+	 * then the kept fraction goes down linearly to MinKeepFraction at EndDistance.
+	 */
+	struct FGrassDensityFalloff
+	{
+		float StartDistance = 0.0f;
+		float EndDistance = 0.0f;
+		/** Fraction of the blades kept past EndDistance, 1 disables the falloff. */
+		float MinKeepFraction = 1.0f;
+
+		bool IsEnabled() const { return MinKeepFraction < 1.0f; }
+
+		/** Packed as the DensityFalloff parameter of CullInstancesCS: start, inverse range, minimum kept fraction. */
+		FVector3f GetShaderParameter() const
+		{
+			const float Range = FMath::Max(EndDistance - StartDistance, UE_KINDA_SMALL_NUMBER);
+			return FVector3f(StartDistance, 1.0f / Range, FMath::Clamp(MinKeepFraction, UE_KINDA_SMALL_NUMBER, 1.0f));
+		}
+	};
+
+	/**
+	 * Fraction of the blades kept at the given distance, DensityFalloff being FGrassDensityFalloff::GetShaderParameter.
+	 */
+	inline float ComputeDensityKeepFraction(const float Distance, const FVector3f& DensityFalloff)
+	{
+		const float Alpha = FMath::Clamp((Distance - DensityFalloff.X) * DensityFalloff.Y, 0.0f, 1.0f);
+		return FMath::Lerp(1.0f, DensityFalloff.Z, Alpha);
+	}
+
+	/**
+	 * Whether a blade survives the density falloff. The same blades are kept from frame to frame and a blade kept
+	 * at some fraction is kept at any larger one, so the field thins out without popping as the camera moves.
+	 */
+	inline bool IsBladeKept(const uint32 BladeIndex, const float KeepFraction)
+	{
+		// 24 bits so that the threshold is exact in float on both sides
+		return static_cast<float>(HashBladeIndex(BladeIndex) >> 8) * (1.0f / 16777216.0f) < KeepFraction;
+	}
+
+	/** Width scale of the kept blades, so that the thinned field covers the same area. */
+	inline float ComputeDensityWidthScale(const float KeepFraction)
+	{
+		return 1.0f / FMath::Max(KeepFraction, UE_KINDA_SMALL_NUMBER);
+	}
+
+	/**
+	 * Selects the blade tessellation from the projected size of the blades.
+	 * Blades get their own LOD on the GPU, the policy picks the range of buckets a section
+	 * is drawn with and keeps it stable with hysteresis so that it doesn't thrash when the
+	 * camera moves back and forth across a LOD boundary.
+	 * It has no dependencies on the renderer and can be driven headlessly.
+	 */
+	class FGrassLodPolicy
+	{
+	public:
+		struct FSettings
+		{
+			/** LOD steps of bucket 0 and of the last bucket. */
+			FUintVector2 MinMaxLod = FUintVector2(0, 0);
+			/** Height range of the blades, in world units. */
+			FVector2f BladeHeightRange = FVector2f(1.0f, 1.0f);
+			/** Blades further than this are culled. */
+			float CutoffDistance = 1000.0f;
+			/** Maximum deviation in pixels between the tessellated blade and its curve. */
+			float MaxPixelError = 0.5f;
+			/**
+			 * Fraction of a step the metric has to move past a LOD boundary before the selection changes,
+			 * and width of the band the blades are dithered across a boundary with, see ComputeLodDither.
+			 */
+			float HysteresisBand = 0.25f;
+			/** Thinning of the blades applied by the cull pass. */
+			FGrassDensityFalloff DensityFalloff;
+		};
+
+		FGrassLodPolicy() = default;
+		explicit FGrassLodPolicy(const FSettings& InSettings)
+			: Settings(InSettings)
+		{
+		}
+
+		const FSettings& GetSettings() const { return Settings; }
+
+		/** Part of the LOD screen scale that depends on the field and not on the view. */
+		float GetPixelErrorScale() const
+		{
+			return 1.0f / FMath::Max(Settings.MaxPixelError, UE_KINDA_SMALL_NUMBER);
+		}
+
+		/** Scale applied to BladeHeight / Distance by ComputeLodStep for the given view. */
+		float GetLodScreenScale(const FGrassLodView& View) const
+		{
+			return View.ScreenScale * LOD_CURVATURE_ERROR_SCALE * GetPixelErrorScale();
+		}
+
+		/** Continuous number of steps of a blade seen from the view. */
+		float ComputeStep(const FGrassLodView& View, const float Distance, const float BladeHeight) const
+		{
+			return ComputeLodStep(Distance, BladeHeight, GetLodScreenScale(View), View.LodBias, Settings.MinMaxLod);
+		}
+
+		/**
+		 * Quantize a continuous step, keeping the previous one while the step stays within the hysteresis band.
+		 */
+		static uint32 ApplyHysteresis(const float Step, const uint32 PreviousStep, const float HysteresisBand)
+		{
+			const float Previous = static_cast<float>(PreviousStep);
+			if (Step >= Previous - HysteresisBand && Step < Previous + 1.0f + HysteresisBand)
+				return PreviousStep;
+
+			return static_cast<uint32>(FMath::FloorToInt(Step));
+		}
+
+		/**
+		 * Range of buckets the blades of a section can fall into when seen from the view.
+		 * SectionKey is a stable id of the section, the range selected for it on the previous call with the same
+		 * section and view is kept as long as the metric stays within the hysteresis band.
+		 */
+		FUintVector2 SelectBucketRange(const uint64 SectionKey, const FGrassLodView& View, const FBox& Bounds, const uint32 FrameNumber)
+		{
+			const FVector FarthestCorner = (View.Origin - Bounds.GetCenter()).GetAbs() + Bounds.GetExtent();
+			const float MinDistance = FMath::Sqrt(Bounds.ComputeSquaredDistanceToPoint(View.Origin));
+			const float MaxDistance = FMath::Min(FarthestCorner.Size(), Settings.CutoffDistance);
+
+			// Coarsest blade: the shortest one at the farthest point, finest: the tallest at the closest point,
+			// both dithered as far as the band goes
+			const float HalfBand = Settings.HysteresisBand * 0.5f;
+			const float CoarseStep = ComputeLodStep(MaxDistance, Settings.BladeHeightRange.X, GetLodScreenScale(View), View.LodBias - HalfBand, Settings.MinMaxLod);
+			const float FineStep = ComputeLodStep(MinDistance, Settings.BladeHeightRange.Y, GetLodScreenScale(View), View.LodBias + HalfBand, Settings.MinMaxLod);
+
+			FUintVector2 Steps(
+				static_cast<uint32>(CoarseStep),
+				static_cast<uint32>(FineStep));
+
+			const TPair<uint64, uint32> Key(SectionKey, View.ViewKey);
+			FHistory* Previous = History.Find(Key);
+			if (Previous != nullptr)
+			{
+				Steps.X = ApplyHysteresis(CoarseStep, Previous->Steps.X, Settings.HysteresisBand);
+				Steps.Y = ApplyHysteresis(FineStep, Previous->Steps.Y, Settings.HysteresisBand);
+				Steps.X = FMath::Clamp(Steps.X, Settings.MinMaxLod.X, Settings.MinMaxLod.Y);
+				Steps.Y = FMath::Clamp(Steps.Y, Steps.X, Settings.MinMaxLod.Y);
+			}
+			History.Add(Key, { Steps, FrameNumber });
+
+			return FUintVector2(Steps.X - Settings.MinMaxLod.X, Steps.Y - Settings.MinMaxLod.X);
+		}
+
+		/** Forget the history of the sections and views that haven't been seen for MaxAge frames. */
+		void PruneHistory(const uint32 FrameNumber, const uint32 MaxAge = 60)
+		{
+			for (auto It = History.CreateIterator(); It; ++It)
+			{
+				if (FrameNumber - It.Value().LastFrame > MaxAge)
+					It.RemoveCurrent();
+			}
+		}
+
+	private:
+		struct FHistory
+		{
+			FUintVector2 Steps;
+			uint32 LastFrame;
+		};
+
+		FSettings Settings;
+		TMap<TPair<uint64, uint32>, FHistory> History;
+	};
+
+	/** Output of BucketBladesReference. */
+	struct FLodBucketingResult
+	{
+		/** Distance bin of each input blade, 0 for all of them without the distance bins. */
+		TArray<uint32> DistanceBins;
+		/** Number of instances drawn with each bucket. */
+		uint32 BucketCounts[MAX_LOD_BUCKETS] = {};
+		/** First instance of each bucket in the instance buffer. */
+		uint32 BucketOffsets[MAX_LOD_BUCKETS] = {};
+		/** Slot of each input blade in the instance buffer, INDEX_NONE if the blade has been culled. */
+		TArray<int32> InstanceSlots;
+		/** Scale of the width of each input blade by the density falloff, 1 for the culled ones. */
+		TArray<float> WidthScales;
+	};
+
+	/**
+	 * CPU reference of the LOD bucketing done by CullInstancesCS, ComputeSlotOffsetsCS and ComputeInstanceGrassDataCS
+	 * (frustum culling and the section bucket range clamp excluded). The GPU orders the blades of a bucket by atomic completion,
+	 * so only the bucket of every instance, the counts and the offsets have to match;
+	 * the reference keeps the input order inside each bucket.
+	 * With bDistanceBins the blades of a bucket are laid out by distance bin, near to far, as the DISTANCE_BINS
+	 * permutation does; the GPU layout can be checked with ValidateDistanceBinOrder.
+	 * The blades thinned out by the density falloff of the policy are culled and the kept ones widened,
+	 * the index of a blade in the arrays being its index in the section.
+	 */
+	inline void BucketBladesReference(
+		const TConstArrayView<FVector3f> Positions,
+		const TConstArrayView<float> Heights,
+		const FGrassLodPolicy& Policy,
+		const FGrassLodView& View,
+		FLodBucketingResult& OutResult,
+		const bool bDistanceBins = false)
+	{
+		const FVector3f CameraPosition = FVector3f(View.Origin);
+		const float CutoffDistance = Policy.GetSettings().CutoffDistance;
+		const float LodScreenScale = Policy.GetLodScreenScale(View);
+		const FUintVector2 MinMaxLod = Policy.GetSettings().MinMaxLod;
+		const FVector3f DensityFalloff = Policy.GetSettings().DensityFalloff.GetShaderParameter();
+
+		OutResult = FLodBucketingResult();
+		OutResult.InstanceSlots.Init(INDEX_NONE, Positions.Num());
+		OutResult.DistanceBins.Init(0, Positions.Num());
+		OutResult.WidthScales.Init(1.0f, Positions.Num());
+
+		// A slot is a distance bin of a bucket, or the bucket itself without the bins (SLOTS_PER_BUCKET in GrassCompute.usf)
+		const uint32 SlotsPerBucket = bDistanceBins ? NUM_DISTANCE_BINS : 1;
+		uint32 SlotCounts[MAX_LOD_BUCKETS * NUM_DISTANCE_BINS] = {};
+
+		TArray<uint32> Slots;
+		TArray<uint32> Ranks;
+		Slots.SetNumUninitialized(Positions.Num());
+		Ranks.SetNumUninitialized(Positions.Num());
+
+		for (int32 Index = 0; Index < Positions.Num(); Index++)
+		{
+			const float DistanceSquared = FVector3f::DistSquared(CameraPosition, Positions[Index]);
+			const float KeepFraction = ComputeDensityKeepFraction(FMath::Sqrt(DistanceSquared), DensityFalloff);
+			if (DistanceSquared >= FMath::Square(CutoffDistance) || !IsBladeKept(Index, KeepFraction))
+			{
+				Slots[Index] = MAX_uint32;
+				continue;
+			}
+			OutResult.WidthScales[Index] = ComputeDensityWidthScale(KeepFraction);
+
+			const float Dither = ComputeLodDither(Index, Policy.GetSettings().HysteresisBand);
+			const uint32 Bucket = FMath::Min<uint32>(ComputeLodBucket(FMath::Sqrt(DistanceSquared), Heights[Index], LodScreenScale, View.LodBias, MinMaxLod, Dither), MAX_LOD_BUCKETS - 1);
+			if (bDistanceBins)
+			{
+				OutResult.DistanceBins[Index] = ComputeDistanceBin(DistanceSquared, FMath::Square(CutoffDistance));
+			}
+			Slots[Index] = Bucket * SlotsPerBucket + OutResult.DistanceBins[Index];
+			Ranks[Index] = SlotCounts[Slots[Index]]++;
+			OutResult.BucketCounts[Bucket]++;
+		}
+
+		uint32 SlotOffsets[MAX_LOD_BUCKETS * NUM_DISTANCE_BINS] = {};
+		uint32 Offset = 0;
+		for (uint32 Slot = 0; Slot < MAX_LOD_BUCKETS * SlotsPerBucket; Slot++)
+		{
+			SlotOffsets[Slot] = Offset;
+			Offset += SlotCounts[Slot];
+		}
+		for (uint32 Bucket = 0; Bucket < MAX_LOD_BUCKETS; Bucket++)
+		{
+			OutResult.BucketOffsets[Bucket] = SlotOffsets[Bucket * SlotsPerBucket];
+		}
+
+		for (int32 Index = 0; Index < Positions.Num(); Index++)
+		{
+			if (Slots[Index] == MAX_uint32)
+				continue;
+
+			OutResult.InstanceSlots[Index] = SlotOffsets[Slots[Index]] + Ranks[Index];
+		}
+	}
+
+	/**
+	 * Check the instance layout produced with the distance bins against the reference: every bucket must cover the
+	 * same range, hold the same blades, and list them with non decreasing distance bins.
+	 * InstanceBlades is the input blade each instance has been written from, as read back from the GPU.
+	 */
+	inline bool ValidateDistanceBinOrder(
+		const FLodBucketingResult& Reference,
+		const TConstArrayView<int32> InstanceBlades,
+		const TConstArrayView<uint32> InstanceBuckets)
+	{
+		if (InstanceBlades.Num() != InstanceBuckets.Num())
+			return false;
+
+		TBitArray<> Seen(false, Reference.InstanceSlots.Num());
+		for (int32 Instance = 0; Instance < InstanceBlades.Num(); Instance++)
+		{
+			const int32 Blade = InstanceBlades[Instance];
+			const uint32 Bucket = InstanceBuckets[Instance];
+			if (!Reference.InstanceSlots.IsValidIndex(Blade) || Reference.InstanceSlots[Blade] == INDEX_NONE || Seen[Blade] || Bucket >= MAX_LOD_BUCKETS)
+				return false;
+			Seen[Blade] = true;
+
+			const uint32 BucketBegin = Reference.BucketOffsets[Bucket];
+			if (static_cast<uint32>(Instance) < BucketBegin || static_cast<uint32>(Instance) >= BucketBegin + Reference.BucketCounts[Bucket])
+				return false;
+
+			// The reference slot of the blade must be in the same bucket
+			const uint32 ReferenceSlot = static_cast<uint32>(Reference.InstanceSlots[Blade]);
+			if (ReferenceSlot < BucketBegin || ReferenceSlot >= BucketBegin + Reference.BucketCounts[Bucket])
+				return false;
+
+			if (Instance > 0 && static_cast<uint32>(Instance) != BucketBegin
+				&& Reference.DistanceBins[InstanceBlades[Instance - 1]] > Reference.DistanceBins[Blade])
+				return false;
+		}
+
+		uint32 NumVisible = 0;
+		for (const int32 Slot : Reference.InstanceSlots)
+		{
+			NumVisible += Slot != INDEX_NONE ? 1 : 0;
+		}
+		return NumVisible == static_cast<uint32>(InstanceBlades.Num());
+	}
+}
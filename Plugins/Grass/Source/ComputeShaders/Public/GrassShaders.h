@@ -3,7 +3,13 @@
 #pragma once
 #include "CoreMinimal.h"
 #include "DataDrivenShaderPlatformInfo.h"
+#include "GrassBendState.h"
+#include "GrassCompaction.h"
 #include "GrassData.h"
+#include "GrassForceMap.h"
+#include "GrassLod.h"
+#include "GrassSpecies.h"
+#include "GrassWind.h"
 
 #include "GlobalShader.h"
 #include "ShaderParameterUtils.h"
@@ -13,8 +19,105 @@
 
 namespace GrassUtils // GrassShaders
 {
+	/** Largest thread group size of the culling passes. */
 	#define MAX_THREADS_PER_GROUP 1024
+	/** Maximum number of planes of the volume the blades are culled against. */
+	#define MAX_CULL_PLANES 16
+	/** Side of the thread groups building the occlusion HZB. */
+	#define HZB_GROUP_SIZE 8
+	/** Side of the thread groups splatting the interactors into the force map. */
+	#define FORCE_MAP_GROUP_SIZE 8
+	/** Thread group size of the bend state integration. */
+	#define BEND_STATE_GROUP_SIZE 64
+
+	/**
+	 * Shares the constants of the grass headers with the shaders. These headers mirror the functions of GrassUtils.ush and
+	 * GrassCommon.ush under the same names, a change to either side must be made to both.
+	 */
+	inline void SetGrassComputeDefines(FShaderCompilerEnvironment& OutEnvironment)
+	{
+		OutEnvironment.SetDefine(TEXT("MAX_THREADS_PER_GROUP"), MAX_THREADS_PER_GROUP);
+		OutEnvironment.SetDefine(TEXT("MAX_LOD_BUCKETS"), MAX_LOD_BUCKETS);
+		OutEnvironment.SetDefine(TEXT("LOD_BUCKET_SHIFT"), LOD_BUCKET_SHIFT);
+		OutEnvironment.SetDefine(TEXT("NUM_DISTANCE_BINS"), NUM_DISTANCE_BINS);
+		OutEnvironment.SetDefine(TEXT("MAX_CULL_PLANES"), MAX_CULL_PLANES);
+		OutEnvironment.SetDefine(TEXT("HZB_GROUP_SIZE"), HZB_GROUP_SIZE);
+		OutEnvironment.SetDefine(TEXT("FORCE_MAP_GROUP_SIZE"), FORCE_MAP_GROUP_SIZE);
+		OutEnvironment.SetDefine(TEXT("BEND_STATE_GROUP_SIZE"), BEND_STATE_GROUP_SIZE);
+		OutEnvironment.SetDefine(TEXT("NO_BEND_STATE"), TEXT("0xFFFFFFFFu"));
+		OutEnvironment.SetDefine(TEXT("BLADE_BENT_BY_STATE"), TEXT("0x80000000u"));
+		OutEnvironment.SetDefine(TEXT("MAX_GRASS_SPECIES"), MAX_GRASS_SPECIES);
+		OutEnvironment.SetDefine(TEXT("MAX_GRASS_DRAWS"), MAX_GRASS_DRAWS);
+		OutEnvironment.SetDefine(TEXT("GRASS_SPECIES_SHIFT"), GRASS_SPECIES_SHIFT);
+		OutEnvironment.SetDefine(TEXT("GRASS_BLADE_INDEX_MASK"), TEXT("((1u << GRASS_SPECIES_SHIFT) - 1)"));
+	}
 	
+	/**
+	 * Constants of a culled view, built once per view and frame by the renderer extension.
+	 * Positions are relative to the view origin, which is split in two floats so that the blades far from the world origin keep their precision.
+	 */
+	BEGIN_GLOBAL_SHADER_PARAMETER_STRUCT(FGrassViewParameters, COMPUTESHADERS_API)
+		SHADER_PARAMETER_ARRAY(FVector4f, CullPlanes, [MAX_CULL_PLANES])
+		SHADER_PARAMETER(FVector3f, ViewOriginHigh)
+		SHADER_PARAMETER(float, LodViewScale)
+		SHADER_PARAMETER(FVector3f, ViewOriginLow)
+		SHADER_PARAMETER(float, LodBias)
+		SHADER_PARAMETER(uint32, NumCullPlanes)
+		SHADER_PARAMETER(uint32, DensityStride)
+	END_GLOBAL_SHADER_PARAMETER_STRUCT()
+
+	/** Thread group sizes the culling passes are compiled with, must be kept in sync with FThreadGroupSizeDim. */
+	static constexpr uint32 GrassThreadGroupSizes[] = { 64, 128, 256, MAX_THREADS_PER_GROUP };
+
+	/**
+	 * Thread group size of the cull and instance passes, THREADS_PER_GROUP in GrassCompute.usf.
+	 * Both passes of a work item must use the same size, the cull pass sizes the dispatch of the instance pass.
+	 */
+	class FThreadGroupSizeDim : SHADER_PERMUTATION_SPARSE_INT("THREADS_PER_GROUP", 64, 128, 256, MAX_THREADS_PER_GROUP);
+
+	/**
+	 * Lay the blades of each LOD bucket out near to far by distance bin, DISTANCE_BINS in GrassCompute.usf.
+	 * Both passes of a work item must agree on it, the bins change the layout of the culled LOD entries.
+	 */
+	class FDistanceBinsDim : SHADER_PERMUTATION_BOOL("DISTANCE_BINS");
+
+	/**
+	 * Write the instances in the FGrassCompactInstance layout, COMPACT_GRASS_INSTANCES in GrassCompute.usf.
+	 * Both layouts are compiled and r.Grass.CompactInstances picks one at runtime: the cvar isn't part of the shader map key,
+	 * a cooked shader map would miss the permutation an ini change selects.
+	 */
+	class FCompactInstancesDim : SHADER_PERMUTATION_BOOL("COMPACT_GRASS_INSTANCES");
+
+	/**
+	 * Furthest depth pyramid of the previous frame of a view, the blades are tested against it by the cull pass.
+	 * Mip 0 is the depth of the view reduced by a power of two footprint.
+	 */
+	BEGIN_SHADER_PARAMETER_STRUCT(FGrassHZBParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D<float>, HZBTexture)
+		/** View projection of the previous frame, from the view relative space of the blades. */
+		SHADER_PARAMETER(FMatrix44f, HZBViewProjection)
+		/** Size of the view rect in texels of mip 0. */
+		SHADER_PARAMETER(FVector2f, HZBViewSize)
+		SHADER_PARAMETER(uint32, HZBMaxMip)
+	END_SHADER_PARAMETER_STRUCT()
+
+	/** Wind the instances are bent by when they are written, see FGrassWind. */
+	BEGIN_SHADER_PARAMETER_STRUCT(FGrassWindParameters, )
+		SHADER_PARAMETER(FVector4f, WindDirectionStrength)
+		SHADER_PARAMETER(FVector3f, WindGustTransform)
+		SHADER_PARAMETER_TEXTURE(Texture2D<float2>, WindGustTexture)
+		SHADER_PARAMETER_SAMPLER(SamplerState, WindGustSampler)
+	END_SHADER_PARAMETER_STRUCT()
+
+	/** Force map of the interactors the instances are bent by when they are written, see FGrassForceMap. */
+	BEGIN_SHADER_PARAMETER_STRUCT(FGrassForceMapParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D<float4>, ForceMapTexture)
+		SHADER_PARAMETER_SAMPLER(SamplerState, ForceMapSampler)
+		SHADER_PARAMETER(FVector3f, ForceMapOrigin)
+		SHADER_PARAMETER(float, ForceMapInvSize)
+		SHADER_PARAMETER(float, ForceMapMaxBend)
+	END_SHADER_PARAMETER_STRUCT()
+
 	// ************************************************************************************************************** //
 	// ********************************************* Compute Shaders ************************************************ //
 	// ************************************************************************************************************** //
@@ -27,8 +130,9 @@ namespace GrassUtils // GrassShaders
 		SHADER_USE_PARAMETER_STRUCT(FInitInstanceBuffer_CS, FGlobalShader);
 
 		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
-			SHADER_PARAMETER(uint32, NumIndices)
-			SHADER_PARAMETER_UAV(RWStructuredBuffer<uint>, RWIndirectArgsBuffer)
+			SHADER_PARAMETER_ARRAY(FUintVector4, LodNumIndices, [MAX_LOD_BUCKETS / 4])
+			SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<uint>, RWIndirectArgsBuffer)
+			SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, RWDispatchArgsBuffer)
 		END_SHADER_PARAMETER_STRUCT()
 
 		static bool ShouldCompilePermutation(FGlobalShaderPermutationParameters const& Parameters)
@@ -39,7 +143,7 @@ namespace GrassUtils // GrassShaders
 			const FGlobalShaderPermutationParameters& Parameters,
 			FShaderCompilerEnvironment& OutEnvironment)
 		{
-			OutEnvironment.SetDefine(TEXT("MAX_THREADS_PER_GROUP"), MAX_THREADS_PER_GROUP);
+			SetGrassComputeDefines(OutEnvironment);
 		}
 	};
 
@@ -51,26 +155,93 @@ namespace GrassUtils // GrassShaders
 		DECLARE_GLOBAL_SHADER(FCullInstances_CS);
 		SHADER_USE_PARAMETER_STRUCT(FCullInstances_CS, FGlobalShader);
 
+		class FCompactionModeDim : SHADER_PERMUTATION_INT("COMPACTION_MODE", static_cast<int32>(EGrassCullCompaction::Num));
+		/** Write the instances directly, for work items drawn with a single LOD bucket. */
+		class FFusedInstanceDataDim : SHADER_PERMUTATION_BOOL("FUSED_INSTANCE_DATA");
+		/** Test the blades against the HZB of the previous frame. */
+		class FHZBOcclusionDim : SHADER_PERMUTATION_BOOL("HZB_OCCLUSION");
+		using FPermutationDomain = TShaderPermutationDomain<FCompactionModeDim, FFusedInstanceDataDim, FHZBOcclusionDim, FThreadGroupSizeDim, FDistanceBinsDim, FCompactInstancesDim>;
+
 		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
-			SHADER_PARAMETER(FMatrix44f, VP_MATRIX)
-			SHADER_PARAMETER(FVector3f, CameraPosition)
+			SHADER_PARAMETER_RDG_UNIFORM_BUFFER(FGrassViewParameters, GrassView)
+			SHADER_PARAMETER_STRUCT_INCLUDE(FGrassHZBParameters, HZB)
+			SHADER_PARAMETER_STRUCT_INCLUDE(FGrassWindParameters, Wind)
+			SHADER_PARAMETER_STRUCT_INCLUDE(FGrassForceMapParameters, ForceMap)
 			SHADER_PARAMETER(int, bIsCullingEnabled)
-			SHADER_PARAMETER(float, CutoffDistance)
+			SHADER_PARAMETER(float, CutoffDistanceSquared)
+			SHADER_PARAMETER(FUintVector2, MinMaxLod)
+			SHADER_PARAMETER(float, LodPixelErrorScale)
+			SHADER_PARAMETER(float, LodHysteresisBand)
+			SHADER_PARAMETER(FUintVector2, LodBucketRange)
+			SHADER_PARAMETER(uint32, NumSpecies)
+			SHADER_PARAMETER(FVector3f, DensityFalloff)
+			SHADER_PARAMETER(float, DensityScale)
+			SHADER_PARAMETER(FVector2f, FarFieldFade)
+			SHADER_PARAMETER(int, bIsFarField)
+			SHADER_PARAMETER(FVector3f, InstanceBoundsMin)
+			SHADER_PARAMETER(FVector3f, InstanceBoundsSize)
 			SHADER_PARAMETER(uint32, GrassDataSize)
 			SHADER_PARAMETER_SRV(StructuredBuffer<FPackedGrassData>, GrassDataBuffer)
 			SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<FPackedGrassData>, RWCulledGrassDataBuffer)
-			SHADER_PARAMETER_UAV(RWStructuredBuffer<uint32>, RWIndirectArgsBuffer)
+			SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<uint32>, RWCulledLodBuffer)
+			SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, RWDispatchArgsBuffer)
+			SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<FGrassInstance>, RWInstanceBuffer)
+			SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<uint32>, RWIndirectArgsBuffer)
+			SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<float4>, BendStates)
+			SHADER_PARAMETER(uint32, BendStateOffset)
 		END_SHADER_PARAMETER_STRUCT()
 
 		static bool ShouldCompilePermutation(FGlobalShaderPermutationParameters const& Parameters)
 		{
+			const FPermutationDomain PermutationVector(Parameters.PermutationId);
+			if (PermutationVector.Get<FCompactionModeDim>() == static_cast<int32>(EGrassCullCompaction::Wave)
+				&& FDataDrivenShaderPlatformInfo::GetSupportsWaveOperations(Parameters.Platform) == ERHIFeatureSupport::Unsupported)
+				return false;
+
+			// The fused pass writes the instances before the bucket offsets are known, it can't bin
+			if (PermutationVector.Get<FFusedInstanceDataDim>() && PermutationVector.Get<FDistanceBinsDim>())
+				return false;
+
 			return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM6);
 		}
 		static void ModifyCompilationEnvironment(
 			const FGlobalShaderPermutationParameters& Parameters,
 			FShaderCompilerEnvironment& OutEnvironment)
 		{
-			OutEnvironment.SetDefine(TEXT("MAX_THREADS_PER_GROUP"), MAX_THREADS_PER_GROUP);
+			SetGrassComputeDefines(OutEnvironment);
+
+			const FPermutationDomain PermutationVector(Parameters.PermutationId);
+			if (PermutationVector.Get<FCompactionModeDim>() == static_cast<int32>(EGrassCullCompaction::Wave))
+			{
+				OutEnvironment.CompilerFlags.Add(CFLAG_WaveOperations);
+			}
+		}
+	};
+
+	/** Prefix sum over the slot counts of the cull pass, the first instance of each slot read by FComputeInstanceData_CS. */
+	class COMPUTESHADERS_API FComputeSlotOffsets_CS : public FGlobalShader
+	{
+
+	public:
+		DECLARE_GLOBAL_SHADER(FComputeSlotOffsets_CS);
+		SHADER_USE_PARAMETER_STRUCT(FComputeSlotOffsets_CS, FGlobalShader);
+
+		using FPermutationDomain = TShaderPermutationDomain<FDistanceBinsDim>;
+
+		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<uint32>, RWIndirectArgsBuffer)
+		END_SHADER_PARAMETER_STRUCT()
+
+		static bool ShouldCompilePermutation(FGlobalShaderPermutationParameters const& Parameters)
+		{
+			return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM6);
+		}
+
+		static void ModifyCompilationEnvironment(
+			const FGlobalShaderPermutationParameters& Parameters,
+			FShaderCompilerEnvironment& OutEnvironment)
+		{
+			SetGrassComputeDefines(OutEnvironment);
 		}
 	};
 
@@ -81,10 +252,18 @@ namespace GrassUtils // GrassShaders
 		DECLARE_GLOBAL_SHADER(FComputeInstanceData_CS);
 		SHADER_USE_PARAMETER_STRUCT(FComputeInstanceData_CS, FGlobalShader);
 
+		using FPermutationDomain = TShaderPermutationDomain<FThreadGroupSizeDim, FDistanceBinsDim, FCompactInstancesDim>;
+
 		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			SHADER_PARAMETER_STRUCT_INCLUDE(FGrassWindParameters, Wind)
+			SHADER_PARAMETER_STRUCT_INCLUDE(FGrassForceMapParameters, ForceMap)
+			SHADER_PARAMETER(FVector3f, InstanceBoundsMin)
+			SHADER_PARAMETER(FVector3f, InstanceBoundsSize)
 			SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<FPackedGrassData>, CulledGrassDataBuffer)
-			SHADER_PARAMETER_UAV(RWStructuredBuffer<FGrassInstance>, RWInstanceBuffer)
-			SHADER_PARAMETER_UAV(RWStructuredBuffer<uint32>, RWIndirectArgsBuffer)
+			SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<uint32>, CulledLodBuffer)
+			SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<FGrassInstance>, RWInstanceBuffer)
+			SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<uint32>, RWIndirectArgsBuffer)
+			RDG_BUFFER_ACCESS(DispatchArgsBuffer, ERHIAccess::IndirectArgs)
 		END_SHADER_PARAMETER_STRUCT()
 
 		static bool ShouldCompilePermutation(FGlobalShaderPermutationParameters const& Parameters)
@@ -96,7 +275,104 @@ namespace GrassUtils // GrassShaders
 			const FGlobalShaderPermutationParameters& Parameters,
 			FShaderCompilerEnvironment& OutEnvironment)
 		{
-			OutEnvironment.SetDefine(TEXT("MAX_THREADS_PER_GROUP"), MAX_THREADS_PER_GROUP);
+			SetGrassComputeDefines(OutEnvironment);
+		}
+	};
+
+	/** Reduces a depth texture, or a mip of the occlusion HZB, into the next mip of the HZB. */
+	class COMPUTESHADERS_API FBuildHZB_CS : public FGlobalShader
+	{
+
+	public:
+		DECLARE_GLOBAL_SHADER(FBuildHZB_CS);
+		SHADER_USE_PARAMETER_STRUCT(FBuildHZB_CS, FGlobalShader);
+
+		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2D<float>, ParentTexture)
+			SHADER_PARAMETER(FUintVector2, ParentOffset)
+			SHADER_PARAMETER(FUintVector2, ParentSize)
+			SHADER_PARAMETER(uint32, ParentFootprint)
+			SHADER_PARAMETER(FUintVector2, MipSize)
+			SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float>, RWHZBMip)
+		END_SHADER_PARAMETER_STRUCT()
+
+		static bool ShouldCompilePermutation(FGlobalShaderPermutationParameters const& Parameters)
+		{
+			return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM6);
+		}
+
+		static void ModifyCompilationEnvironment(
+			const FGlobalShaderPermutationParameters& Parameters,
+			FShaderCompilerEnvironment& OutEnvironment)
+		{
+			SetGrassComputeDefines(OutEnvironment);
+		}
+	};
+
+	/** Decays the force map of the last frame into the map of this frame and splats the interactors on it. */
+	class COMPUTESHADERS_API FSplatForceMap_CS : public FGlobalShader
+	{
+
+	public:
+		DECLARE_GLOBAL_SHADER(FSplatForceMap_CS);
+		SHADER_USE_PARAMETER_STRUCT(FSplatForceMap_CS, FGlobalShader);
+
+		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D<float4>, PreviousForceMap)
+			SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float4>, RWForceMap)
+			SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<FGrassInteractor>, Interactors)
+			SHADER_PARAMETER(uint32, NumInteractors)
+			SHADER_PARAMETER(FIntPoint, ForceMapShift)
+			SHADER_PARAMETER(uint32, ForceMapResolution)
+			SHADER_PARAMETER(FVector3f, ForceMapOrigin)
+			SHADER_PARAMETER(float, ForceMapTexelSize)
+			SHADER_PARAMETER(float, ForceMapDecay)
+			SHADER_PARAMETER(float, ForceMapHeightShift)
+		END_SHADER_PARAMETER_STRUCT()
+
+		static bool ShouldCompilePermutation(FGlobalShaderPermutationParameters const& Parameters)
+		{
+			return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM6);
+		}
+
+		static void ModifyCompilationEnvironment(
+			const FGlobalShaderPermutationParameters& Parameters,
+			FShaderCompilerEnvironment& OutEnvironment)
+		{
+			SetGrassComputeDefines(OutEnvironment);
+		}
+	};
+
+	/** Steps the bend state of the blades of a section towards their rest tilt under the wind and the interactors, see FGrassBendState. */
+	class COMPUTESHADERS_API FIntegrateBendState_CS : public FGlobalShader
+	{
+
+	public:
+		DECLARE_GLOBAL_SHADER(FIntegrateBendState_CS);
+		SHADER_USE_PARAMETER_STRUCT(FIntegrateBendState_CS, FGlobalShader);
+
+		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			SHADER_PARAMETER_STRUCT_INCLUDE(FGrassWindParameters, Wind)
+			SHADER_PARAMETER_STRUCT_INCLUDE(FGrassForceMapParameters, ForceMap)
+			SHADER_PARAMETER(uint32, GrassDataSize)
+			SHADER_PARAMETER_SRV(StructuredBuffer<FPackedGrassData>, GrassDataBuffer)
+			SHADER_PARAMETER(uint32, BendStateOffset)
+			SHADER_PARAMETER(float, BendStateDeltaTime)
+			SHADER_PARAMETER(float, BendStateMaxAngle)
+			SHADER_PARAMETER(uint32, bResetBendState)
+			SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<float4>, RWBendStates)
+		END_SHADER_PARAMETER_STRUCT()
+
+		static bool ShouldCompilePermutation(FGlobalShaderPermutationParameters const& Parameters)
+		{
+			return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM6);
+		}
+
+		static void ModifyCompilationEnvironment(
+			const FGlobalShaderPermutationParameters& Parameters,
+			FShaderCompilerEnvironment& OutEnvironment)
+		{
+			SetGrassComputeDefines(OutEnvironment);
 		}
 	};
-}
\ No newline at end of file
+}
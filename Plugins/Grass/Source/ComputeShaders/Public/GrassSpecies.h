@@ -0,0 +1,93 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GrassBendState.h"
+#include "GrassLod.h"
+
+namespace GrassUtils
+{
+	/** Most species of a field, each one multiplies the draws of a work item. */
+	#define MAX_GRASS_SPECIES 4
+	/** Draws of a work item, one per LOD bucket of each species: the indirect args and instance ranges it is culled into. */
+	#define MAX_GRASS_DRAWS (MAX_GRASS_SPECIES * MAX_LOD_BUCKETS)
+
+	/** First bit of the species in the index of a blade, the bits below hold its index in the section. */
+	#define GRASS_SPECIES_SHIFT 29
+	#define GRASS_BLADE_INDEX_MASK ((1u << GRASS_SPECIES_SHIFT) - 1)
+	static_assert(((MAX_GRASS_SPECIES - 1u) << GRASS_SPECIES_SHIFT & BLADE_BENT_BY_STATE) == 0, "The species bits must leave BLADE_BENT_BY_STATE free");
+
+	// Read back on the GPU by GetGrassSpecies in GrassUtils.ush.
+
+	/**
+	 * Index of a blade packed with its species, see FPackedGrassData::Index.
+	 */
+	inline uint32 PackGrassBladeIndex(const uint32 BladeIndex, const uint32 Species)
+	{
+		check(Species < MAX_GRASS_SPECIES);
+		return (BladeIndex & GRASS_BLADE_INDEX_MASK) | (Species << GRASS_SPECIES_SHIFT);
+	}
+
+	/** Index of a blade in its section, without the species. */
+	inline uint32 GetGrassBladeIndex(const uint32 PackedIndex)
+	{
+		return PackedIndex & GRASS_BLADE_INDEX_MASK;
+	}
+
+	/**
+	 * Species of a blade, clamped to the species of its field.
+	 */
+	inline uint32 GetGrassSpecies(const uint32 PackedIndex, const uint32 NumSpecies)
+	{
+		return FMath::Min((PackedIndex >> GRASS_SPECIES_SHIFT) & (MAX_GRASS_SPECIES - 1), FMath::Max(NumSpecies, 1u) - 1);
+	}
+
+	/** Draw of the blades of a species falling in a LOD bucket, the index of its indirect args. */
+	inline uint32 GetGrassDrawIndex(const uint32 Species, const uint32 LodBucket)
+	{
+		return Species * MAX_LOD_BUCKETS + LodBucket;
+	}
+
+	/** Blade shape of a species, the blades are drawn with the same mesh scaled by their own height and width. */
+	struct FGrassSpeciesShape
+	{
+		FVector2f HeightRange = FVector2f(7.0f, 12.0f);
+		FVector2f WidthRange = FVector2f(0.3f, 0.4f);
+		/** Stiffness of the blades in [0, 1], the stiffer blades bend less under the wind and the interactors. */
+		FVector2f StiffnessRange = FVector2f(0.0f, 1.0f);
+	};
+
+	/**
+	 * Species of a blade sampled by the bake, Random being uniform in [0, 1): each species gets a share of the blades
+	 * proportional to its weight. Species 0 without any positive weight.
+	 */
+	inline uint32 PickGrassSpecies(const TConstArrayView<float> DensityWeights, const float Random)
+	{
+		float TotalWeight = 0.0f;
+		for (const float Weight : DensityWeights)
+		{
+			TotalWeight += FMath::Max(Weight, 0.0f);
+		}
+		if (TotalWeight <= 0.0f)
+			return 0;
+
+		float Threshold = Random * TotalWeight;
+		const uint32 NumSpecies = FMath::Min<uint32>(DensityWeights.Num(), MAX_GRASS_SPECIES);
+		for (uint32 Species = 0; Species < NumSpecies; Species++)
+		{
+			const float Weight = FMath::Max(DensityWeights[Species], 0.0f);
+			if (Threshold < Weight)
+				return Species;
+			Threshold -= Weight;
+		}
+
+		// Rounding past the last weight falls on the last species that has one
+		for (uint32 Species = NumSpecies; Species-- > 0;)
+		{
+			if (DensityWeights[Species] > 0.0f)
+				return Species;
+		}
+		return 0;
+	}
+}
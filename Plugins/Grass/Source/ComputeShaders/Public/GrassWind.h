@@ -0,0 +1,132 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Math/Float16.h"
+
+namespace GrassUtils
+{
+	/** Side in texels of the gust texture, it tiles. */
+	#define WIND_GUST_TEXTURE_SIZE 32
+	/** Cells of the value noise along a side of the gust texture. */
+	#define WIND_GUST_NOISE_CELLS 4
+
+	/**
+	 * Global wind of the grass, evaluated once per blade by the instance pass and folded into the instance transform.
+	 * The wind blows along Direction with Strength, modulated by a low resolution gust texture scrolling with it.
+	 */
+	struct FGrassWind
+	{
+		/** Horizontal direction the wind blows to, normalized. */
+		FVector2f Direction = FVector2f(1.0f, 0.0f);
+		/** Push of the wind on a blade of no stiffness, 0 disables the wind. */
+		float Strength = 0.0f;
+		/** Speed the gusts travel at, in world units per second. */
+		float Speed = 300.0f;
+		/** World size of a tile of the gust texture. */
+		float GustSize = 2000.0f;
+		/** Largest angle in radians the blades bend by. */
+		float MaxBendAngle = 1.2f;
+
+		bool IsEnabled() const { return Strength > 0.0f; }
+
+		/** Packed as the WindDirectionStrength parameter of the instance passes: direction, strength, maximum bend angle. */
+		FVector4f GetDirectionStrengthParameter() const
+		{
+			return FVector4f(Direction.X, Direction.Y, Strength, MaxBendAngle);
+		}
+
+		/**
+		 * Packed as the WindGustTransform parameter of the instance passes: UV offset of the gusts at the given time
+		 * and inverse world size of a tile. The offset wraps so that it keeps its precision.
+		 */
+		FVector3f GetGustTransformParameter(const double Time) const
+		{
+			const double Distance = Time * Speed / FMath::Max(GustSize, 1.0f);
+			const FVector2f Offset(
+				static_cast<float>(FMath::Frac(-Direction.X * Distance)),
+				static_cast<float>(FMath::Frac(-Direction.Y * Distance)));
+			return FVector3f(Offset.X, Offset.Y, 1.0f / FMath::Max(GustSize, 1.0f));
+		}
+	};
+
+	/** Tileable value noise lattice value, in [0, 1]. */
+	inline float GetWindGustLatticeValue(const int32 X, const int32 Y, const uint32 Channel)
+	{
+		const uint32 Hash = HashCombineFast(HashCombineFast(GetTypeHash(X & (WIND_GUST_NOISE_CELLS - 1)), GetTypeHash(Y & (WIND_GUST_NOISE_CELLS - 1))), Channel);
+		return static_cast<float>(MurmurFinalize32(Hash) >> 8) / 16777215.0f;
+	}
+
+	/**
+	 * Texels of the gust texture, row major: R is the strength of the gust in [0.25, 1] along the wind, G the sway
+	 * across it in [-1, 1]. Smoothed value noise, so that the bilinear lookups of neighbouring blades stay coherent.
+	 */
+	inline void BuildWindGustTexture(TArray<FFloat16>& OutTexels)
+	{
+		OutTexels.SetNumUninitialized(WIND_GUST_TEXTURE_SIZE * WIND_GUST_TEXTURE_SIZE * 2);
+		constexpr float TexelsPerCell = static_cast<float>(WIND_GUST_TEXTURE_SIZE) / WIND_GUST_NOISE_CELLS;
+		for (int32 Y = 0; Y < WIND_GUST_TEXTURE_SIZE; Y++)
+		{
+			for (int32 X = 0; X < WIND_GUST_TEXTURE_SIZE; X++)
+			{
+				const FVector2f Cell(X / TexelsPerCell, Y / TexelsPerCell);
+				const int32 CellX = FMath::FloorToInt(Cell.X);
+				const int32 CellY = FMath::FloorToInt(Cell.Y);
+				const float AlphaX = FMath::SmoothStep(0.0f, 1.0f, Cell.X - CellX);
+				const float AlphaY = FMath::SmoothStep(0.0f, 1.0f, Cell.Y - CellY);
+
+				float Values[2];
+				for (uint32 Channel = 0; Channel < 2; Channel++)
+				{
+					Values[Channel] = FMath::BiLerp(
+						GetWindGustLatticeValue(CellX, CellY, Channel), GetWindGustLatticeValue(CellX + 1, CellY, Channel),
+						GetWindGustLatticeValue(CellX, CellY + 1, Channel), GetWindGustLatticeValue(CellX + 1, CellY + 1, Channel),
+						AlphaX, AlphaY);
+				}
+
+				const int32 Texel = (Y * WIND_GUST_TEXTURE_SIZE + X) * 2;
+				OutTexels[Texel + 0] = FFloat16(FMath::Lerp(0.25f, 1.0f, Values[0]));
+				OutTexels[Texel + 1] = FFloat16(Values[1] * 2.0f - 1.0f);
+			}
+		}
+	}
+
+	// Sampled on the GPU by ComputeWindVector in GrassUtils.ush.
+
+	/**
+	 * World space push of the wind on a blade, from the gust sampled at its position.
+	 */
+	inline FVector3f ComputeWindVector(const FVector2f Gust, const FVector4f& WindDirectionStrength)
+	{
+		const FVector2f Along(WindDirectionStrength.X, WindDirectionStrength.Y);
+		const FVector2f Across(-Along.Y, Along.X);
+		const FVector2f Push = (Along * Gust.X + Across * (Gust.Y * 0.5f)) * WindDirectionStrength.Z;
+		return FVector3f(Push.X, Push.Y, 0.0f);
+	}
+
+	/**
+	 * Up vector of a blade bent by the wind: rotated towards the part of the push across the blade by an angle growing
+	 * with the push and saturating at MaxBendAngle, the stiffer blades (Stiffness in [0, 1]) bending up to 5 times less.
+	 * The length of the blade is kept, only its tip moves.
+	 */
+	inline FVector3f ComputeWindBentUp(const FVector3f& Up, const FVector3f& Wind, const float Stiffness, const float MaxBendAngle)
+	{
+		const FVector3f Push = Wind - Up * FVector3f::DotProduct(Wind, Up);
+		const float PushLength = Push.Size();
+		if (PushLength < UE_KINDA_SMALL_NUMBER)
+			return Up;
+
+		const float Angle = MaxBendAngle * (1.0f - FMath::Exp(-PushLength / (0.25f + FMath::Clamp(Stiffness, 0.0f, 1.0f))));
+		return Up * FMath::Cos(Angle) + Push / PushLength * FMath::Sin(Angle);
+	}
+
+	/**
+	 * Facing of a bent blade: the original facing made orthogonal to the bent up vector again.
+	 */
+	inline FVector3f ComputeWindBentFacing(const FVector3f& Facing, const FVector3f& BentUp)
+	{
+		const FVector3f Projected = Facing - BentUp * FVector3f::DotProduct(Facing, BentUp);
+		return Projected.GetSafeNormal(UE_SMALL_NUMBER, Facing);
+	}
+}
@@ -36,6 +36,7 @@ public class Grass : ModuleRules
 			{
 				"CoreUObject",
 				"Engine",
+				"RenderCore",
 				"Slate",
 				"SlateCore",
                 "ProceduralMeshComponent",
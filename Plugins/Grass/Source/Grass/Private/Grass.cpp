@@ -2,17 +2,22 @@
 
 #include "Grass.h"
 
+#include "GrassInteractorComponent.h"
+#include "Engine/World.h"
+
 #define LOCTEXT_NAMESPACE "FGrassModule"
 
 void FGrassModule::StartupModule()
 {
 	// This code will execute after your module is loaded into memory; the exact timing is specified in the .uplugin file per-module
+	InteractorsHandle = FWorldDelegates::OnWorldPostActorTick.AddStatic(&UGrassInteractorComponent::GatherInteractors);
 }
 
 void FGrassModule::ShutdownModule()
 {
 	// This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
 	// we call this function before unloading the module.
+	FWorldDelegates::OnWorldPostActorTick.Remove(InteractorsHandle);
 }
 
 #undef LOCTEXT_NAMESPACE
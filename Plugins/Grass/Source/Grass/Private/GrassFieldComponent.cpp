@@ -19,7 +19,8 @@ bool UGrassMeshSection::AddGrassData(GrassUtils::FPackedGrassData& Data)
 
 	if (Result)
 	{
-		Data.Index = DataNum;
+		// The species picked by the sampling stays packed above the index
+		Data.Index = GrassUtils::PackGrassBladeIndex(DataNum, GrassUtils::GetGrassSpecies(Data.Index, MAX_GRASS_SPECIES));
 		GrassData.Add(Data);
 		DataNum++;
 	}
@@ -94,6 +95,30 @@ void UGrassFieldComponent::SetMaterial(int32 InElementIndex, UMaterialInterface*
 		Material = InMaterial;
 		MarkRenderStateDirty();
 	}
+	else if (LodMaterials.IsValidIndex(InElementIndex - 1) && LodMaterials[InElementIndex - 1].Material != InMaterial)
+	{
+		LodMaterials[InElementIndex - 1].Material = InMaterial;
+		MarkRenderStateDirty();
+	}
+	else if (const int32 SpeciesIndex = InElementIndex - 1 - LodMaterials.Num();
+		Species.IsValidIndex(SpeciesIndex) && Species[SpeciesIndex].Material != InMaterial)
+	{
+		Species[SpeciesIndex].Material = InMaterial;
+		MarkRenderStateDirty();
+	}
+}
+
+UMaterialInterface* UGrassFieldComponent::GetMaterial(int32 Index) const
+{
+	if (LodMaterials.IsValidIndex(Index - 1))
+	{
+		return LodMaterials[Index - 1].Material;
+	}
+	if (Species.IsValidIndex(Index - 1 - LodMaterials.Num()))
+	{
+		return Species[Index - 1 - LodMaterials.Num()].Material;
+	}
+	return Material;
 }
 
 void UGrassFieldComponent::GetUsedMaterials(TArray<UMaterialInterface*>& OutMaterials, bool bGetDebugMaterials) const
@@ -102,6 +127,50 @@ void UGrassFieldComponent::GetUsedMaterials(TArray<UMaterialInterface*>& OutMate
 	{
 		OutMaterials.Add(Material);
 	}
+	for (const FGrassLodMaterial& LodMaterial : LodMaterials)
+	{
+		if (LodMaterial.Material != nullptr)
+		{
+			OutMaterials.AddUnique(LodMaterial.Material);
+		}
+	}
+	for (const FGrassSpecies& Kind : Species)
+	{
+		if (Kind.Material != nullptr)
+		{
+			OutMaterials.AddUnique(Kind.Material);
+		}
+	}
+}
+
+GrassUtils::FGrassSpeciesShape UGrassFieldComponent::GetSpeciesShape(const uint32 SpeciesIndex) const
+{
+	GrassUtils::FGrassSpeciesShape Shape;
+	if (Species.IsValidIndex(SpeciesIndex))
+	{
+		const FGrassSpecies& Kind = Species[SpeciesIndex];
+		Shape.HeightRange = FVector2f(Kind.MinHeight, Kind.MaxHeight);
+		Shape.WidthRange = FVector2f(Kind.MinWidth, Kind.MaxWidth);
+		Shape.StiffnessRange = FVector2f(Kind.MinStiffness, Kind.MaxStiffness);
+	}
+	else
+	{
+		Shape.HeightRange = FVector2f(MinHeight, MaxHeight);
+		Shape.WidthRange = FVector2f(MinWidth, MaxWidth);
+	}
+	return Shape;
+}
+
+FVector2f UGrassFieldComponent::GetHeightRange() const
+{
+	FVector2f Range = GetSpeciesShape(0).HeightRange;
+	for (uint32 SpeciesIndex = 1; SpeciesIndex < GetNumSpecies(); SpeciesIndex++)
+	{
+		const FVector2f HeightRange = GetSpeciesShape(SpeciesIndex).HeightRange;
+		Range.X = FMath::Min(Range.X, HeightRange.X);
+		Range.Y = FMath::Max(Range.Y, HeightRange.Y);
+	}
+	return Range;
 }
 
 void UGrassFieldComponent::EmptyGrassData()
@@ -181,6 +250,15 @@ void UGrassFieldComponent::SampleGrassData()
 	float MaxZ = Box.GetCenter().Z + Box.GetExtent().Z;
 	float MinZ = Box.GetCenter().Z - Box.GetExtent().Z;
 	
+	// Every blade picks its species by weight, the species beyond the supported count are ignored
+	TArray<float, TInlineAllocator<MAX_GRASS_SPECIES>> DensityWeights;
+	TArray<GrassUtils::FGrassSpeciesShape, TInlineAllocator<MAX_GRASS_SPECIES>> Shapes;
+	for (uint32 SpeciesIndex = 0; SpeciesIndex < GetNumSpecies(); SpeciesIndex++)
+	{
+		DensityWeights.Add(Species.IsValidIndex(SpeciesIndex) ? Species[SpeciesIndex].DensityWeight : 1.0f);
+		Shapes.Add(GetSpeciesShape(SpeciesIndex));
+	}
+	
 	UProceduralMeshComponent* SurfaceMesh = Terrain->GetComponentByClass<UProceduralMeshComponent>();
 	for (auto Point : Points)
 	{
@@ -201,7 +279,12 @@ void UGrassFieldComponent::SampleGrassData()
 			Up.Normalize();
 			FVector Position = Hit.ImpactPoint;
 			
-			GrassUtils::FPackedGrassData Data = GrassUtils::ComputeData(Position, Up, MinHeight, MaxHeight, MinWidth, MaxWidth);
+			const uint32 SpeciesIndex = GrassUtils::PickGrassSpecies(DensityWeights, FMath::FRand());
+			const GrassUtils::FGrassSpeciesShape& Shape = Shapes[SpeciesIndex];
+			GrassUtils::FPackedGrassData Data = GrassUtils::ComputeData(
+				Position, Up, Shape.HeightRange.X, Shape.HeightRange.Y, Shape.WidthRange.X, Shape.WidthRange.Y,
+				Shape.StiffnessRange.X, Shape.StiffnessRange.Y);
+			Data.Index = GrassUtils::PackGrassBladeIndex(0, SpeciesIndex);
 			for (const auto& Section : Sections)
 			{
 				if (Section->AddGrassData(Data))
@@ -0,0 +1,81 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GrassInteractorComponent.h"
+
+#include "Engine/World.h"
+#include "GrassForceMap.h"
+#include "RenderingThread.h"
+
+
+/** Registered interactors of every world, game thread only. */
+static TMap<const UWorld*, TArray<UGrassInteractorComponent*>> GrassInteractors;
+/** Worlds whose last batch handed to the renderer wasn't empty, game thread only. */
+static TSet<const UWorld*> GrassInteractorWorlds;
+
+UGrassInteractorComponent::UGrassInteractorComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	bAutoActivate = true;
+}
+
+void UGrassInteractorComponent::OnRegister()
+{
+	Super::OnRegister();
+	GrassInteractors.FindOrAdd(GetWorld()).AddUnique(this);
+}
+
+void UGrassInteractorComponent::OnUnregister()
+{
+	if (TArray<UGrassInteractorComponent*>* WorldInteractors = GrassInteractors.Find(GetWorld()))
+	{
+		WorldInteractors->RemoveSingleSwap(this);
+		if (WorldInteractors->Num() == 0)
+		{
+			GrassInteractors.Remove(GetWorld());
+		}
+	}
+	Super::OnUnregister();
+}
+
+void UGrassInteractorComponent::GatherInteractors(UWorld* InWorld, ELevelTick InTickType, float InDeltaSeconds)
+{
+	check(IsInGameThread());
+
+	// Every world bends the grass of its own scene only
+	const FSceneInterface* Scene = InWorld->Scene;
+	if (Scene == nullptr)
+		return;
+
+	TArray<GrassUtils::FGrassInteractor> Interactors;
+	if (const TArray<UGrassInteractorComponent*>* WorldInteractors = GrassInteractors.Find(InWorld))
+	{
+		Interactors.Reserve(WorldInteractors->Num());
+		for (const UGrassInteractorComponent* Interactor : *WorldInteractors)
+		{
+			if (!Interactor->IsActive() || Interactor->Strength <= 0.0f)
+				continue;
+
+			const FTransform& Transform = Interactor->GetComponentTransform();
+			Interactors.Add(GrassUtils::MakeGrassInteractor(
+				Transform.GetLocation(), Transform.GetUnitAxis(EAxis::Z),
+				Interactor->HalfHeight, Interactor->Radius, Interactor->Strength));
+		}
+	}
+
+	// The renderer keeps the last batch of the scene, only the first empty one has to be sent
+	if (Interactors.Num() == 0)
+	{
+		if (GrassInteractorWorlds.Remove(InWorld) == 0)
+			return;
+	}
+	else
+	{
+		GrassInteractorWorlds.Add(InWorld);
+	}
+
+	ENQUEUE_RENDER_COMMAND(SetGrassInteractors)([Scene, Interactors = MoveTemp(Interactors)](FRHICommandListImmediate&) mutable
+	{
+		GrassUtils::SetGrassInteractors(Scene, MoveTemp(Interactors));
+	});
+}
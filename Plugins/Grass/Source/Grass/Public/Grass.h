@@ -12,4 +12,8 @@ public:
 	/** IModuleInterface implementation */
 	virtual void StartupModule() override;
 	virtual void ShutdownModule() override;
+
+private:
+	/** Gathers the grass interactors once per frame, see UGrassInteractorComponent. */
+	FDelegateHandle InteractorsHandle;
 };
@@ -11,6 +11,7 @@
 #include "GrassData.h"
 
 #include "GrassInstancingSceneProxy.h"
+#include "GrassSpecies.h"
 // #include "GrassSceneProxy.h"
 #include "GrassUtils.h"
 #include "GrassFieldComponent.generated.h"
@@ -20,6 +21,54 @@ class UMaterialInterface;
 class UGrassFieldComponent;
 class UGrassMeshSection;
 
+/** Material drawn in place of the material of the field for its coarser LODs. */
+USTRUCT(BlueprintType)
+struct FGrassLodMaterial
+{
+	GENERATED_BODY()
+
+	/** Applies to the blades tessellated with at most this many steps, and to the cards of the far field. */
+	UPROPERTY(EditAnywhere, Category = Rendering)
+		uint32 MaxLodSteps = 0;
+
+	UPROPERTY(EditAnywhere, Category = Rendering)
+		UMaterialInterface* Material = nullptr;
+};
+
+/** Kind of blade growing in a field, all the species of a field are culled together and cost a draw per LOD each. */
+USTRUCT(BlueprintType)
+struct FGrassSpecies
+{
+	GENERATED_BODY()
+
+	/** Material of the blades of the species, the material of the field if none. The LOD overrides of the field still apply. */
+	UPROPERTY(EditAnywhere, Category = Rendering)
+		UMaterialInterface* Material = nullptr;
+
+	/** Share of the blades of the field given to the species, relative to the weights of the other species. */
+	UPROPERTY(EditAnywhere, Category = Rendering, meta = (ClampMin = "0.0"))
+		float DensityWeight = 1.0f;
+
+	UPROPERTY(EditAnywhere, Category = Rendering)
+		float MinHeight = 7;
+
+	UPROPERTY(EditAnywhere, Category = Rendering)
+		float MaxHeight = 12;
+
+	UPROPERTY(EditAnywhere, Category = Rendering)
+		float MinWidth = .3;
+
+	UPROPERTY(EditAnywhere, Category = Rendering)
+		float MaxWidth = .4;
+
+	/** Stiffness of the blades, the stiffer ones bend less under the wind and the interactors. */
+	UPROPERTY(EditAnywhere, Category = Rendering, meta = (ClampMin = "0.0", ClampMax = "1.0"))
+		float MinStiffness = 0.0f;
+
+	UPROPERTY(EditAnywhere, Category = Rendering, meta = (ClampMin = "0.0", ClampMax = "1.0"))
+		float MaxStiffness = 1.0f;
+};
+
 UCLASS(Blueprintable, ClassGroup = Rendering, hideCategories = (Activation, Collision, Cooking, HLOD, Navigation, Object, Physics, VirtualTexture))
 class UGrassMeshSection : public UObject
 {
@@ -66,6 +115,13 @@ protected:
 	UPROPERTY(EditAnywhere, Category = Rendering)
 		UMaterialInterface* Material = nullptr;
 	
+	/**
+	 * Cheaper materials for the distant blades, the coarser LODs only cover a few pixels each.
+	 * A LOD is drawn with the override of the lowest MaxLodSteps covering it, with Material if none does.
+	 */
+	UPROPERTY(EditAnywhere, Category = Rendering)
+		TArray<FGrassLodMaterial> LodMaterials;
+
 	UPROPERTY(EditAnywhere, Category = Rendering)
 		bool bIsGPUCullingEnabled = true;
 	
@@ -96,9 +152,59 @@ protected:
 	UPROPERTY(EditAnywhere, Category = Rendering)
 		float MinWidth = .3;
 
+	/**
+	 * Species of the blades, up to 4, picked for each blade by their density weight when the field is sampled.
+	 * Without any species the blades are a single species shaped by the height and width ranges of the field.
+	 */
+	UPROPERTY(EditAnywhere, Category = Rendering)
+		TArray<FGrassSpecies> Species;
+
 	UPROPERTY(EditAnywhere, Category = Rendering)
 		FUintVector2 LodStepsRange = FUintVector2(0, 6);
 
+	/** Maximum deviation in pixels between a tessellated blade and its curve, drives the LOD selection. */
+	UPROPERTY(EditAnywhere, Category = Rendering, meta = (ClampMin = "0.01"))
+		float LodMaxPixelError = 0.5f;
+
+	/**
+	 * Fraction of a step the LOD metric has to move past a boundary before a section changes LOD,
+	 * and width of the band the blades cross a boundary over, each at its own distance.
+	 */
+	UPROPERTY(EditAnywhere, Category = Rendering, meta = (ClampMin = "0.0", ClampMax = "1.0"))
+		float LodHysteresis = 0.25f;
+
+	/** Distance past which the blades start being thinned out. */
+	UPROPERTY(EditAnywhere, Category = Rendering, meta = (ClampMin = "0.0"))
+		float DensityFalloffStartDistance = 500.0f;
+
+	/** Distance at which the thinning reaches DensityFalloffMinKeepFraction. */
+	UPROPERTY(EditAnywhere, Category = Rendering, meta = (ClampMin = "0.0"))
+		float DensityFalloffEndDistance = 1000.0f;
+
+	/** Fraction of the blades kept past DensityFalloffEndDistance, widened to cover the same area. 1 disables the falloff. */
+	UPROPERTY(EditAnywhere, Category = Rendering, meta = (ClampMin = "0.05", ClampMax = "1.0"))
+		float DensityFalloffMinKeepFraction = 1.0f;
+
+	/** Draw the field past CutoffDistance as cards, each a clump of blades standing for a cell of the field. */
+	UPROPERTY(EditAnywhere, Category = Rendering)
+		bool bFarField = false;
+
+	/** Cutoff distance of the cards, as a multiple of CutoffDistance. */
+	UPROPERTY(EditAnywhere, Category = Rendering, meta = (ClampMin = "1.0", EditCondition = "bFarField"))
+		float FarFieldDistanceScale = 4.0f;
+
+	/** Side of the cell of the field a card stands for. */
+	UPROPERTY(EditAnywhere, Category = Rendering, meta = (ClampMin = "1.0", EditCondition = "bFarField"))
+		float FarFieldCellSize = 100.0f;
+
+	/** Distance before CutoffDistance over which the blades fade out and the cards grow in. */
+	UPROPERTY(EditAnywhere, Category = Rendering, meta = (ClampMin = "0.0", EditCondition = "bFarField"))
+		float FarFieldFadeDistance = 200.0f;
+
+	/** Blades baked into the mesh of a card. */
+	UPROPERTY(EditAnywhere, Category = Rendering, meta = (ClampMin = "1", ClampMax = "256", EditCondition = "bFarField"))
+		uint32 FarFieldBladesPerCard = 16;
+
 	UPROPERTY(VisibleAnywhere, Category = Rendering)
 		uint32 TotalBladesCount = 0;
 	
@@ -123,6 +229,16 @@ public:
 
 	
 	UMaterialInterface* GetMaterial() const { return Material; }
+	const TArray<FGrassLodMaterial>& GetLodMaterials() const { return LodMaterials; }
+
+	/** Species the blades are sampled with, at least one. */
+	uint32 GetNumSpecies() const { return FMath::Clamp<uint32>(Species.Num(), 1, MAX_GRASS_SPECIES); }
+	/** Material of a species, nullptr to draw it with the material of the field. */
+	UMaterialInterface* GetSpeciesMaterial(const uint32 SpeciesIndex) const
+	{
+		return Species.IsValidIndex(SpeciesIndex) ? Species[SpeciesIndex].Material : nullptr;
+	}
+	GrassUtils::FGrassSpeciesShape GetSpeciesShape(const uint32 SpeciesIndex) const;
 
 	float GetCutoffDistance() const { return CutoffDistance; }
 	
@@ -130,6 +246,28 @@ public:
 	bool IsCPUCullingEnabled() const { return bIsCPUCullingEnabled; }
 	
 	FUintVector2 GetLodStepsRange() const { return LodStepsRange; }
+	float GetLodMaxPixelError() const { return LodMaxPixelError; }
+	float GetLodHysteresis() const { return LodHysteresis; }
+	GrassUtils::FGrassDensityFalloff GetDensityFalloff() const
+	{
+		GrassUtils::FGrassDensityFalloff Falloff;
+		Falloff.StartDistance = DensityFalloffStartDistance;
+		Falloff.EndDistance = DensityFalloffEndDistance;
+		Falloff.MinKeepFraction = DensityFalloffMinKeepFraction;
+		return Falloff;
+	}
+	GrassUtils::FGrassFarField GetFarField() const
+	{
+		GrassUtils::FGrassFarField FarField;
+		FarField.bEnabled = bFarField;
+		FarField.DistanceScale = FarFieldDistanceScale;
+		FarField.CellSize = FarFieldCellSize;
+		FarField.FadeDistance = FarFieldFadeDistance;
+		FarField.BladesPerCard = FarFieldBladesPerCard;
+		return FarField;
+	}
+	/** Heights of the blades of all the species. */
+	FVector2f GetHeightRange() const;
 	TArray<UGrassMeshSection *>& GetMeshSections() { return Sections; }
 
 protected:
@@ -149,7 +287,9 @@ protected:
 	virtual FPrimitiveSceneProxy* CreateSceneProxy() override;
 	virtual bool SupportsStaticLighting() const override { return true; }
 	virtual void SetMaterial(int32 ElementIndex, class UMaterialInterface* Material) override;
-	virtual UMaterialInterface* GetMaterial(int32 Index) const override { return Material; }
+	/** Element 0 is Material, the next ones are the LodMaterials overrides, then the materials of the species. */
+	virtual UMaterialInterface* GetMaterial(int32 Index) const override;
+	virtual int32 GetNumMaterials() const override { return 1 + LodMaterials.Num() + Species.Num(); }
 	virtual void GetUsedMaterials(TArray<UMaterialInterface*>& OutMaterials, bool bGetDebugMaterials = false) const override;
 	//~ End UPrimitiveComponent Interface
 
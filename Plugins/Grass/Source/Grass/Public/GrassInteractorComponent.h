@@ -0,0 +1,48 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SceneComponent.h"
+
+#include "GrassInteractorComponent.generated.h"
+
+/**
+ * Capsule bending and flattening the grass around it, along the up axis of the component.
+ * The interactors of a world are gathered once per frame and handed to the renderer in one batch,
+ * which splats them into the force map of the scene of the world, sampled by its grass instance passes.
+ */
+UCLASS(Blueprintable, ClassGroup = Rendering, meta = (BlueprintSpawnableComponent), hideCategories = (Collision, Cooking, Object, Physics))
+class GRASS_API UGrassInteractorComponent : public USceneComponent
+{
+	GENERATED_UCLASS_BODY()
+
+protected:
+	/** Radius of the capsule. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Rendering, meta = (ClampMin = "1.0"))
+		float Radius = 40.0f;
+
+	/** Half height of the capsule including its caps, a sphere when it is no larger than the radius. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Rendering, meta = (ClampMin = "0.0"))
+		float HalfHeight = 0.0f;
+
+	/** Weight of the push, 1 flattens the blades under the axis of the capsule. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Rendering, meta = (ClampMin = "0.0"))
+		float Strength = 1.0f;
+
+public:
+	float GetRadius() const { return Radius; }
+	float GetHalfHeight() const { return HalfHeight; }
+	float GetStrength() const { return Strength; }
+
+	/** Gather the active interactors of a world and send them to the render thread, for the scene of the world. */
+	static void GatherInteractors(UWorld* InWorld, ELevelTick InTickType, float InDeltaSeconds);
+
+protected:
+
+	//~ Begin UActorComponent Interface
+	virtual void OnRegister() override;
+	virtual void OnUnregister() override;
+	//~ End UActorComponent Interface
+
+};
@@ -3,7 +3,8 @@
 
 namespace GrassUtils
 {
-	static GrassUtils::FPackedGrassData ComputeData(const FVector& Position, const FVector& Up, const float MinHeight, const float MaxHeight, const float MinWidth, const float MaxWidth)
+	static GrassUtils::FPackedGrassData ComputeData(const FVector& Position, const FVector& Up, const float MinHeight, const float MaxHeight, const float MinWidth, const float MaxWidth,
+		const float MinStiffness = 0.0f, const float MaxStiffness = 1.0f)
 	{
 		FVector V = FMath::VRand();
 		while (V.Dot(Up) >= .95f)
@@ -14,7 +15,7 @@ namespace GrassUtils
 		const float Extraction = FMath::SRand();
 		const float Height = Extraction * (MaxHeight - MinHeight) + MinHeight;
 		const float Width = Extraction * (MaxWidth - MinWidth) + MinWidth;
-		const float Stiffness = FMath::SRand();
+		const float Stiffness = FMath::SRand() * (MaxStiffness - MinStiffness) + MinStiffness;
 		return GrassUtils::FPackedGrassData
 		{
 			0,